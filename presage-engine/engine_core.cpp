@@ -0,0 +1,533 @@
+// engine_core.cpp
+// presage_engine_core: the C ABI in presage_engine.h
+//
+// Runs the SDK in the caller's process on video files or pushed frames,
+// writing each session to the archive layout in engine_core.hpp. This is the
+// processing path of main.cpp without the HTTP server, container pool,
+// checkpoints or cost model: embedders schedule work themselves.
+
+#include "presage_engine.h"
+#include "engine_core.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <condition_variable>
+#include <cstdlib>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
+#ifdef PRESAGE_SDK_AVAILABLE
+#include <smartspectra/container/foreground_container.hpp>
+#include <smartspectra/container/settings.hpp>
+#include <glog/logging.h>
+
+using namespace presage::smartspectra;
+#endif
+
+struct presage_engine {
+    std::string api_key;
+    std::string archive_dir;
+    std::mutex mutex;
+    int sessions = 0;  // Live session handles
+};
+
+struct presage_session {
+    presage_engine* engine = nullptr;
+    std::string id;
+    std::string dir;
+    double buffer_duration_s = 0.5;
+    double frames_fps = 30.0;
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::atomic<int> state{PRESAGE_SESSION_IDLE};
+    std::string video_path;
+    std::string error;
+    std::thread worker;
+
+    // Pushed frames, encoded as they arrive
+    cv::VideoWriter frames_writer;
+    cv::Size frame_size;
+    int64_t frames_pushed = 0;
+
+    std::shared_ptr<ReadingsStore> store;
+    std::vector<json> readings;  // For the summary
+    uint64_t rows = 0;
+    presage_reading_callback callback = nullptr;
+    void* callback_data = nullptr;
+};
+
+namespace {
+
+thread_local std::string last_error;
+
+presage_status fail(presage_status status, const std::string& message) {
+    last_error = message;
+    return status;
+}
+
+// Run an entry point's body. No C++ exception may reach the host through the
+// C ABI (it would terminate it), so one becomes on_error, with its message in
+// presage_last_error().
+template <typename Result, typename Body>
+Result guarded(Result on_error, Body&& body) noexcept {
+    try {
+        return body();
+    } catch (const std::exception& e) {
+        last_error = e.what();
+    } catch (...) {
+        last_error = "Unknown error";
+    }
+    return on_error;
+}
+
+// Behind presage_readings_view::internal
+struct MappedColumns {
+    MappedFile timestamps;
+    MappedFile heart_rates;
+    MappedFile breathing_rates;
+
+    explicit MappedColumns(const std::string& dir)
+        : timestamps(dir + "/ts.col"), heart_rates(dir + "/hr.col"), breathing_rates(dir + "/br.col") {}
+};
+
+presage_reading to_c_reading(const ReadingRow& row) {
+    return {row.timestamp, row.heart_rate, row.breathing_rate};
+}
+
+// Final state and summary.json, in the engine's format
+void finish_session(presage_session* session, bool completed, const std::string& error) {
+    json summary = {
+        {"session_id", session->id},
+        {"status", completed ? "complete" : "failed"},
+        {"video_path", session->video_path},
+        {"completed_at", static_cast<int64_t>(std::time(nullptr))},
+        {"settings", {{"buffer_duration_s", session->buffer_duration_s}}},
+        {"client", "presage_engine_core"}
+    };
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        summary["vitals"] = calculate_vitals_summary(session->readings);
+        session->error = error;
+        session->store.reset();
+    }
+    if (!error.empty()) {
+        summary["error"] = error;
+    }
+    if (!write_json_file(session->dir + "/summary.json", summary)) {
+        std::cerr << "Failed to write summary for " << session->id << std::endl;
+    }
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->state = completed ? PRESAGE_SESSION_COMPLETE : PRESAGE_SESSION_FAILED;
+    }
+    session->finished.notify_all();
+}
+
+// Store a reading and hand it to the subscriber
+void add_reading(presage_session* session, const json& reading) {
+    ReadingRow row = reading_to_row(reading);
+    presage_reading_callback callback;
+    void* callback_data;
+    uint64_t index;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->readings.push_back(reading);
+        if (session->store && !session->store->append(row)) {
+            std::cerr << "Failed to append reading to the session store" << std::endl;
+        }
+        index = session->rows++;
+        callback = session->callback;
+        callback_data = session->callback_data;
+    }
+    if (callback) {
+        presage_reading c_reading = to_c_reading(row);
+        callback(callback_data, &c_reading, index);
+    }
+}
+
+#ifdef PRESAGE_SDK_AVAILABLE
+std::once_flag sdk_logging_once;
+
+// Run the SDK over a video file on the calling thread; empty string on success
+std::string run_sdk(presage_session* session, const std::string& video_path) {
+    std::call_once(sdk_logging_once, []() { google::InitGoogleLogging("presage_engine_core"); });
+    try {
+        container::settings::Settings<
+            container::settings::OperationMode::Continuous,
+            container::settings::IntegrationMode::Rest
+        > settings;
+        settings.video_source.input_video_path = video_path;
+        settings.video_source.device_index = -1;
+        settings.headless = true;
+        settings.enable_edge_metrics = true;
+        settings.verbosity_level = 1;
+        settings.continuous.preprocessed_data_buffer_duration_s = session->buffer_duration_s;
+        settings.integration.api_key = session->engine->api_key;
+
+        container::CpuContinuousRestForegroundContainer container(settings);
+        auto status = container.SetOnCoreMetricsOutput(
+            [session](const presage::physiology::MetricsBuffer& metrics, int64_t timestamp) {
+                add_reading(session, metrics_to_reading(metrics, timestamp));
+                return absl::OkStatus();
+            });
+        if (!status.ok()) {
+            return std::string(status.message());
+        }
+        if (auto init_status = container.Initialize(); !init_status.ok()) {
+            return std::string(init_status.message());
+        }
+        if (auto run_status = container.Run(); !run_status.ok()) {
+            return std::string(run_status.message());
+        }
+        return "";
+    } catch (const std::exception& e) {
+        return e.what();
+    }
+}
+#else
+std::string run_sdk(presage_session*, const std::string&) {
+    return "Presage SDK not available";
+}
+#endif
+
+presage_status start_processing(presage_session* session, const std::string& video_path) {
+    auto store = ReadingsStore::open_for_append(session->dir);
+    if (!store) {
+        return fail(PRESAGE_ERROR_IO, "Cannot open the readings store in " + session->dir);
+    }
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->store = store;
+        session->video_path = video_path;
+        session->state = PRESAGE_SESSION_RUNNING;
+    }
+    try {
+        session->worker = std::thread([session, video_path]() {
+            std::string error = run_sdk(session, video_path);
+            finish_session(session, error.empty(), error);
+        });
+    } catch (const std::system_error& e) {
+        // Otherwise the session would stay RUNNING and presage_session_wait never return
+        finish_session(session, false, e.what());
+        return fail(PRESAGE_ERROR_IO, std::string("Cannot start the processing thread: ") + e.what());
+    }
+    return PRESAGE_OK;
+}
+
+}  // namespace
+
+extern "C" {
+
+uint32_t presage_engine_abi_version(void) {
+    return PRESAGE_ENGINE_ABI_VERSION;
+}
+
+const char* presage_last_error(void) {
+    return last_error.c_str();
+}
+
+void presage_free(void* pointer) {
+    std::free(pointer);
+}
+
+presage_status presage_engine_create(const char* api_key, const char* archive_dir, presage_engine** engine) {
+    return guarded(PRESAGE_ERROR_IO, [&]() -> presage_status {
+        if (!api_key || !archive_dir || !engine) {
+            return fail(PRESAGE_ERROR_INVALID_ARGUMENT, "api_key, archive_dir and engine are required");
+        }
+        std::error_code ec;
+        std::filesystem::create_directories(archive_dir, ec);
+        if (!std::filesystem::is_directory(archive_dir, ec)) {
+            return fail(PRESAGE_ERROR_IO, std::string("Cannot create archive directory ") + archive_dir);
+        }
+        auto created = std::make_unique<presage_engine>();
+        created->api_key = api_key;
+        created->archive_dir = archive_dir;
+        *engine = created.release();
+        return PRESAGE_OK;
+    });
+}
+
+void presage_engine_destroy(presage_engine* engine) {
+    if (!engine) {
+        return;
+    }
+    guarded(0, [engine]() {
+        std::lock_guard<std::mutex> lock(engine->mutex);
+        if (engine->sessions > 0) {
+            std::cerr << "presage_engine_destroy: " << engine->sessions << " sessions still open" << std::endl;
+        }
+        return 0;
+    });
+    delete engine;
+}
+
+presage_status presage_session_create(presage_engine* engine, const char* settings_json, presage_session** session) {
+    return guarded(PRESAGE_ERROR_IO, [&]() -> presage_status {
+        if (!engine || !session) {
+            return fail(PRESAGE_ERROR_INVALID_ARGUMENT, "engine and session are required");
+        }
+        auto created = std::make_unique<presage_session>();
+        if (settings_json) {
+            json settings = json::parse(settings_json, nullptr, false);
+            if (!settings.is_object()) {
+                return fail(PRESAGE_ERROR_INVALID_ARGUMENT, "settings_json must be a JSON object");
+            }
+            for (const char* key : {"buffer_duration_s", "frames_fps"}) {
+                if (settings.contains(key) && !settings[key].is_number()) {
+                    return fail(PRESAGE_ERROR_INVALID_ARGUMENT, std::string(key) + " must be a number");
+                }
+            }
+            created->buffer_duration_s = settings.value("buffer_duration_s", created->buffer_duration_s);
+            created->frames_fps = settings.value("frames_fps", created->frames_fps);
+            if (created->buffer_duration_s < 0.2 || created->buffer_duration_s > 10.0 ||
+                created->frames_fps <= 0 || created->frames_fps > 240) {
+                return fail(PRESAGE_ERROR_INVALID_ARGUMENT, "buffer_duration_s must be 0.2-10 and frames_fps 0-240");
+            }
+        }
+        created->engine = engine;
+        created->id = make_session_id();
+        created->dir = engine->archive_dir + "/" + created->id;
+        std::error_code ec;
+        if (!std::filesystem::create_directories(created->dir, ec)) {
+            return fail(PRESAGE_ERROR_IO, "Cannot create session directory " + created->dir);
+        }
+        {
+            std::lock_guard<std::mutex> lock(engine->mutex);
+            engine->sessions++;
+        }
+        *session = created.release();
+        return PRESAGE_OK;
+    });
+}
+
+presage_status presage_session_open(presage_engine* engine, const char* session_id, presage_session** session) {
+    return guarded(PRESAGE_ERROR_IO, [&]() -> presage_status {
+        if (!engine || !session_id || !session) {
+            return fail(PRESAGE_ERROR_INVALID_ARGUMENT, "engine, session_id and session are required");
+        }
+        std::string id = session_id;
+        if (id.empty() || id.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_") != std::string::npos) {
+            return fail(PRESAGE_ERROR_INVALID_ARGUMENT, "Invalid session id");
+        }
+        std::string dir = engine->archive_dir + "/" + id;
+        json summary;
+        if (!read_json_file(dir + "/summary.json", summary)) {
+            return fail(PRESAGE_ERROR_STATE, "Session " + id + " is unknown or still running");
+        }
+        auto opened = std::make_unique<presage_session>();
+        opened->engine = engine;
+        opened->id = id;
+        opened->dir = dir;
+        opened->video_path = summary.value("video_path", "");
+        opened->rows = ReadingsStore::row_count(dir);
+        opened->state = summary.value("status", "") == "complete" ? PRESAGE_SESSION_COMPLETE : PRESAGE_SESSION_FAILED;
+        {
+            std::lock_guard<std::mutex> lock(engine->mutex);
+            engine->sessions++;
+        }
+        *session = opened.release();
+        return PRESAGE_OK;
+    });
+}
+
+void presage_session_destroy(presage_session* session) {
+    if (!session) {
+        return;
+    }
+    // Each step is guarded on its own, so a failing one does not leak the rest
+    guarded(0, [session]() {
+        if (session->state.load() == PRESAGE_SESSION_RECEIVING) {
+            session->frames_writer.release();
+        }
+        return 0;
+    });
+    guarded(0, [session]() {
+        if (session->worker.joinable()) {
+            session->worker.join();
+        }
+        return 0;
+    });
+    if (session->worker.joinable()) {
+        session->worker.detach();  // join failed (e.g. called from a reading callback); ~thread would terminate
+    }
+    guarded(0, [session]() {
+        if (session->state.load() == PRESAGE_SESSION_IDLE) {
+            // Never given input - drop its (empty) directory
+            std::error_code ec;
+            std::filesystem::remove(session->dir, ec);
+        }
+        return 0;
+    });
+    guarded(0, [session]() {
+        std::lock_guard<std::mutex> lock(session->engine->mutex);
+        session->engine->sessions--;
+        return 0;
+    });
+    delete session;
+}
+
+const char* presage_session_id(const presage_session* session) {
+    return session ? session->id.c_str() : "";
+}
+
+presage_session_state presage_session_get_state(const presage_session* session) {
+    return session ? static_cast<presage_session_state>(session->state.load()) : PRESAGE_SESSION_FAILED;
+}
+
+presage_status presage_session_process_file(presage_session* session, const char* video_path) {
+    return guarded(PRESAGE_ERROR_IO, [&]() -> presage_status {
+        if (!session || !video_path) {
+            return fail(PRESAGE_ERROR_INVALID_ARGUMENT, "session and video_path are required");
+        }
+        if (session->state.load() != PRESAGE_SESSION_IDLE) {
+            return fail(PRESAGE_ERROR_STATE, "Session already has input");
+        }
+        std::error_code ec;
+        if (!std::filesystem::is_regular_file(video_path, ec)) {
+            return fail(PRESAGE_ERROR_IO, std::string("No such video file ") + video_path);
+        }
+        return start_processing(session, video_path);
+    });
+}
+
+presage_status presage_session_push_frame(presage_session* session, const uint8_t* bgr,
+                                          int width, int height, size_t stride) {
+    return guarded(PRESAGE_ERROR_IO, [&]() -> presage_status {
+        if (!session || !bgr || width <= 0 || height <= 0 || stride < static_cast<size_t>(width) * 3) {
+            return fail(PRESAGE_ERROR_INVALID_ARGUMENT, "Invalid frame");
+        }
+        int state = session->state.load();
+        if (state == PRESAGE_SESSION_IDLE) {
+            session->frame_size = cv::Size(width, height);
+            std::string path = session->dir + "/frames.mp4";
+            if (!session->frames_writer.open(path, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), session->frames_fps,
+                                             session->frame_size)) {
+                return fail(PRESAGE_ERROR_IO, "Cannot write " + path);
+            }
+            session->state = PRESAGE_SESSION_RECEIVING;
+        } else if (state != PRESAGE_SESSION_RECEIVING) {
+            return fail(PRESAGE_ERROR_STATE, "Session is no longer receiving frames");
+        }
+        if (cv::Size(width, height) != session->frame_size) {
+            return fail(PRESAGE_ERROR_INVALID_ARGUMENT, "Frame size differs from the first frame");
+        }
+        // Wraps the caller's pixels; the writer copies them while encoding
+        cv::Mat frame(height, width, CV_8UC3, const_cast<uint8_t*>(bgr), stride);
+        session->frames_writer.write(frame);
+        session->frames_pushed++;
+        return PRESAGE_OK;
+    });
+}
+
+presage_status presage_session_end_frames(presage_session* session) {
+    return guarded(PRESAGE_ERROR_IO, [&]() -> presage_status {
+        if (!session) {
+            return fail(PRESAGE_ERROR_INVALID_ARGUMENT, "session is required");
+        }
+        if (session->state.load() != PRESAGE_SESSION_RECEIVING) {
+            return fail(PRESAGE_ERROR_STATE, "No frames were pushed");
+        }
+        session->frames_writer.release();
+        return start_processing(session, session->dir + "/frames.mp4");
+    });
+}
+
+presage_status presage_session_wait(presage_session* session, int timeout_ms) {
+    return guarded(PRESAGE_ERROR_IO, [&]() -> presage_status {
+        if (!session) {
+            return fail(PRESAGE_ERROR_INVALID_ARGUMENT, "session is required");
+        }
+        std::unique_lock<std::mutex> lock(session->mutex);
+        auto done = [session]() {
+            int state = session->state.load();
+            return state == PRESAGE_SESSION_COMPLETE || state == PRESAGE_SESSION_FAILED;
+        };
+        if (timeout_ms < 0) {
+            session->finished.wait(lock, done);
+        } else if (!session->finished.wait_for(lock, std::chrono::milliseconds(timeout_ms), done)) {
+            return fail(PRESAGE_ERROR_TIMEOUT, "Session still processing");
+        }
+        if (session->state.load() == PRESAGE_SESSION_FAILED) {
+            return fail(PRESAGE_ERROR_SDK, session->error.empty() ? "Processing failed" : session->error);
+        }
+        return PRESAGE_OK;
+    });
+}
+
+size_t presage_session_poll(presage_session* session, uint64_t after, presage_reading* readings, size_t capacity) {
+    return guarded(size_t{0}, [&]() -> size_t {
+        if (!session || !readings || capacity == 0) {
+            return 0;
+        }
+        std::vector<ReadingRow> rows = ReadingsStore::read(session->dir, after, capacity);
+        for (size_t i = 0; i < rows.size(); ++i) {
+            readings[i] = to_c_reading(rows[i]);
+        }
+        return rows.size();
+    });
+}
+
+presage_status presage_session_subscribe(presage_session* session, presage_reading_callback callback, void* user_data) {
+    return guarded(PRESAGE_ERROR_IO, [&]() -> presage_status {
+        if (!session) {
+            return fail(PRESAGE_ERROR_INVALID_ARGUMENT, "session is required");
+        }
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->callback = callback;
+        session->callback_data = user_data;
+        return PRESAGE_OK;
+    });
+}
+
+presage_status presage_session_map_readings(presage_session* session, presage_readings_view* view) {
+    return guarded(PRESAGE_ERROR_IO, [&]() -> presage_status {
+        if (!session || !view) {
+            return fail(PRESAGE_ERROR_INVALID_ARGUMENT, "session and view are required");
+        }
+        auto* columns = new MappedColumns(session->dir);
+        view->rows = std::min({static_cast<uint64_t>(columns->timestamps.count<int64_t>()),
+                               static_cast<uint64_t>(columns->heart_rates.count<float>()),
+                               static_cast<uint64_t>(columns->breathing_rates.count<float>())});
+        view->timestamp_ms = columns->timestamps.as<int64_t>();
+        view->heart_rate_bpm = columns->heart_rates.as<float>();
+        view->breathing_rate_bpm = columns->breathing_rates.as<float>();
+        view->internal = columns;
+        return PRESAGE_OK;
+    });
+}
+
+void presage_readings_view_release(presage_readings_view* view) {
+    if (!view || !view->internal) {
+        return;
+    }
+    delete static_cast<MappedColumns*>(view->internal);
+    *view = presage_readings_view{};
+}
+
+presage_status presage_session_summary(presage_session* session, char** summary_json) {
+    return guarded(PRESAGE_ERROR_IO, [&]() -> presage_status {
+        if (!session || !summary_json) {
+            return fail(PRESAGE_ERROR_INVALID_ARGUMENT, "session and summary_json are required");
+        }
+        int state = session->state.load();
+        if (state != PRESAGE_SESSION_COMPLETE && state != PRESAGE_SESSION_FAILED) {
+            return fail(PRESAGE_ERROR_STATE, "Session has not finished");
+        }
+        json summary;
+        if (!read_json_file(session->dir + "/summary.json", summary)) {
+            return fail(PRESAGE_ERROR_IO, "Cannot read the session summary");
+        }
+        std::string text = summary.dump();
+        char* copy = static_cast<char*>(std::malloc(text.size() + 1));
+        if (!copy) {
+            return fail(PRESAGE_ERROR_IO, "Out of memory");
+        }
+        std::memcpy(copy, text.c_str(), text.size() + 1);
+        *summary_json = copy;
+        return PRESAGE_OK;
+    });
+}
+
+}  // extern "C"
@@ -0,0 +1,499 @@
+// engine_core.hpp
+// Session archive layer shared by the HTTP engine and presage_engine_core
+//
+// A session lives in one directory of the archive: its readings as an
+// append-only columnar store (ts.col, hr.col, br.col, plus the zones.col zone
+// map), and summary.json once it finishes. Everything here depends only on
+// the directory it is given, so main.cpp (the HTTP engine) and engine_core.cpp
+// (the embeddable library behind presage_engine.h) read and write the same
+// layout, and sessions created by either can be served by the other.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "deps/json.hpp"
+
+#ifdef PRESAGE_SDK_AVAILABLE
+#include <physiology/modules/messages/metrics.h>
+#endif
+
+using json = nlohmann::json;
+
+// Write JSON atomically (temp file + rename) so a crash never leaves a torn file
+inline bool write_json_file(const std::string& path, const json& data) {
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out << data.dump();
+        if (!out.good()) {
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    return !ec;
+}
+
+inline bool read_json_file(const std::string& path, json& data) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    try {
+        in >> data;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to parse " << path << ": " << e.what() << std::endl;
+        return false;
+    }
+}
+
+inline std::string make_session_id(const std::string& prefix = "session") {
+    static std::atomic<int> counter{0};
+    auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    return prefix + "_" + std::to_string(now_ms) + "_" + std::to_string(counter++);
+}
+
+// One row of the readings store; NaN marks a channel the SDK didn't report
+struct ReadingRow {
+    int64_t timestamp;
+    float heart_rate;
+    float breathing_rate;
+};
+
+// Min/max/count of each channel over one block of zone_block_rows rows.
+// Queries skip blocks whose range cannot match (see ReadingsStore::scan).
+struct ZoneEntry {
+    int64_t timestamp_min;
+    int64_t timestamp_max;
+    float heart_rate_min;
+    float heart_rate_max;
+    float breathing_rate_min;
+    float breathing_rate_max;
+    uint32_t rows;
+    uint32_t heart_rate_count;
+    uint32_t breathing_rate_count;
+    uint32_t reserved;
+
+    static ZoneEntry empty() {
+        float inf = std::numeric_limits<float>::infinity();
+        return {std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min(), inf, -inf, inf, -inf, 0, 0, 0, 0};
+    }
+
+    void add(const ReadingRow& row) {
+        timestamp_min = std::min(timestamp_min, row.timestamp);
+        timestamp_max = std::max(timestamp_max, row.timestamp);
+        if (!std::isnan(row.heart_rate)) {
+            heart_rate_min = std::min(heart_rate_min, row.heart_rate);
+            heart_rate_max = std::max(heart_rate_max, row.heart_rate);
+            heart_rate_count++;
+        }
+        if (!std::isnan(row.breathing_rate)) {
+            breathing_rate_min = std::min(breathing_rate_min, row.breathing_rate);
+            breathing_rate_max = std::max(breathing_rate_max, row.breathing_rate);
+            breathing_rate_count++;
+        }
+        rows++;
+    }
+};
+static_assert(sizeof(ZoneEntry) == 48, "zones.col layout");
+
+// Channel thresholds for GET /sessions. A reading matches when all set
+// predicates hold (or any, with match_any); NaN means not set.
+struct ReadingPredicate {
+    float heart_rate_gt = std::numeric_limits<float>::quiet_NaN();
+    float heart_rate_lt = std::numeric_limits<float>::quiet_NaN();
+    float breathing_rate_gt = std::numeric_limits<float>::quiet_NaN();
+    float breathing_rate_lt = std::numeric_limits<float>::quiet_NaN();
+    bool match_any = false;
+
+    bool empty() const {
+        return std::isnan(heart_rate_gt) && std::isnan(heart_rate_lt) &&
+               std::isnan(breathing_rate_gt) && std::isnan(breathing_rate_lt);
+    }
+
+    bool matches(const ReadingRow& row) const {
+        return combine(row.heart_rate > heart_rate_gt, row.heart_rate < heart_rate_lt,
+                       row.breathing_rate > breathing_rate_gt, row.breathing_rate < breathing_rate_lt);
+    }
+
+    // False only if no row in the block can match
+    bool may_match(const ZoneEntry& zone) const {
+        bool hr = zone.heart_rate_count > 0;
+        bool br = zone.breathing_rate_count > 0;
+        return combine(hr && zone.heart_rate_max > heart_rate_gt, hr && zone.heart_rate_min < heart_rate_lt,
+                       br && zone.breathing_rate_max > breathing_rate_gt, br && zone.breathing_rate_min < breathing_rate_lt);
+    }
+
+private:
+    bool combine(bool hr_gt, bool hr_lt, bool br_gt, bool br_lt) const {
+        bool set[4] = {!std::isnan(heart_rate_gt), !std::isnan(heart_rate_lt),
+                       !std::isnan(breathing_rate_gt), !std::isnan(breathing_rate_lt)};
+        bool hold[4] = {hr_gt, hr_lt, br_gt, br_lt};
+        bool any = false;
+        bool all = true;
+        for (int i = 0; i < 4; ++i) {
+            if (set[i]) {
+                any = any || hold[i];
+                all = all && hold[i];
+            }
+        }
+        return match_any ? any : all;
+    }
+};
+
+struct PredicateScan {
+    uint64_t rows = 0;
+    uint64_t matches = 0;
+    uint64_t blocks = 0;
+    uint64_t blocks_read = 0;
+    std::optional<ReadingRow> first_match;
+};
+
+// Read-only mapping of a whole file; pages are only read when touched
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED) {
+                data_ = data;
+                size_ = static_cast<size_t>(st.st_size);
+                madvise(data_, size_, MADV_RANDOM);
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data_) {
+            munmap(data_, size_);
+        }
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    template <typename T>
+    const T* as() const { return static_cast<const T*>(data_); }
+    template <typename T>
+    size_t count() const { return size_ / sizeof(T); }
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Append-only columnar store of a session's readings in its archive directory,
+// one file per channel (ts.col int64, hr.col and br.col float). Row numbers never
+// change once written, so they double as cursors for incremental reads.
+// zones.col holds a ZoneEntry per block of rows, rewritten in place as the
+// last block fills, so predicate queries can skip most of the archive.
+class ReadingsStore {
+public:
+    static constexpr uint64_t zone_block_rows = 64;
+
+    ~ReadingsStore() {
+        for (int fd : fds_) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        if (zones_fd_ >= 0) {
+            close(zones_fd_);
+        }
+    }
+
+    static std::shared_ptr<ReadingsStore> open_for_append(const std::string& dir) {
+        auto store = std::shared_ptr<ReadingsStore>(new ReadingsStore());
+        for (int c = 0; c < column_count; ++c) {
+            store->fds_[c] = ::open((dir + "/" + column_files[c]).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (store->fds_[c] < 0) {
+                std::cerr << "Failed to open readings store in " << dir << ": " << strerror(errno) << std::endl;
+                return nullptr;
+            }
+        }
+        // Bring the zone map up to date, then keep the last block's entry in memory
+        if (!sync_zones(dir)) {
+            std::cerr << "Failed to build zone map in " << dir << std::endl;
+            return nullptr;
+        }
+        store->zones_fd_ = ::open((dir + "/zones.col").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (store->zones_fd_ < 0) {
+            return nullptr;
+        }
+        store->rows_ = row_count(dir);
+        store->zone_ = ZoneEntry::empty();
+        if (store->rows_ % zone_block_rows != 0 &&
+            pread(store->zones_fd_, &store->zone_, sizeof(ZoneEntry),
+                  static_cast<off_t>(store->rows_ / zone_block_rows * sizeof(ZoneEntry))) != sizeof(ZoneEntry)) {
+            return nullptr;
+        }
+        return store;
+    }
+
+    bool append(const ReadingRow& row) {
+        if (!write_value(0, &row.timestamp, sizeof(row.timestamp)) ||
+            !write_value(1, &row.heart_rate, sizeof(row.heart_rate)) ||
+            !write_value(2, &row.breathing_rate, sizeof(row.breathing_rate))) {
+            return false;
+        }
+        if (rows_ % zone_block_rows == 0) {
+            zone_ = ZoneEntry::empty();
+        }
+        zone_.add(row);
+        off_t offset = static_cast<off_t>(rows_ / zone_block_rows * sizeof(ZoneEntry));
+        rows_++;
+        return pwrite(zones_fd_, &zone_, sizeof(ZoneEntry), offset) == sizeof(ZoneEntry);
+    }
+
+    // Make zones.col cover every row, rebuilding the entries it lacks from the
+    // columns (sessions archived before zone maps, or truncated on resume)
+    static bool sync_zones(const std::string& dir) {
+        std::string path = dir + "/zones.col";
+        uint64_t rows = row_count(dir);
+        uint64_t blocks = (rows + zone_block_rows - 1) / zone_block_rows;
+        struct stat st;
+        uint64_t entries = stat(path.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) / sizeof(ZoneEntry) : 0;
+        if (entries >= blocks) {
+            return true;
+        }
+        uint64_t first_block = std::min(entries, rows / zone_block_rows);
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = ftruncate(fd, static_cast<off_t>(first_block * sizeof(ZoneEntry))) == 0;
+        for (uint64_t block = first_block; ok && block < blocks; ++block) {
+            ZoneEntry zone = ZoneEntry::empty();
+            for (const auto& row : read(dir, block * zone_block_rows, zone_block_rows)) {
+                zone.add(row);
+            }
+            ok = pwrite(fd, &zone, sizeof(zone), static_cast<off_t>(block * sizeof(ZoneEntry))) == sizeof(zone);
+        }
+        close(fd);
+        return ok;
+    }
+
+    // Count readings matching a predicate. Blocks the zone map rules out are
+    // never touched; rows past the zone map (a write in flight) are scanned.
+    static PredicateScan scan(const std::string& dir, const ReadingPredicate& predicate) {
+        PredicateScan result;
+        result.rows = row_count(dir);
+        MappedFile zones(dir + "/zones.col");
+        MappedFile timestamps(dir + "/ts.col");
+        MappedFile heart_rates(dir + "/hr.col");
+        MappedFile breathing_rates(dir + "/br.col");
+        if (result.rows == 0 || timestamps.count<int64_t>() < result.rows ||
+            heart_rates.count<float>() < result.rows || breathing_rates.count<float>() < result.rows) {
+            return result;
+        }
+        const ZoneEntry* zone = zones.as<ZoneEntry>();
+        uint64_t indexed = zones.count<ZoneEntry>();
+        result.blocks = (result.rows + zone_block_rows - 1) / zone_block_rows;
+        for (uint64_t block = 0; block < result.blocks; ++block) {
+            uint64_t end = std::min(result.rows, (block + 1) * zone_block_rows);
+            bool current = block < indexed && zone[block].rows == end - block * zone_block_rows;
+            if (current && !predicate.may_match(zone[block])) {
+                continue;
+            }
+            result.blocks_read++;
+            for (uint64_t i = block * zone_block_rows; i < end; ++i) {
+                ReadingRow row{timestamps.as<int64_t>()[i], heart_rates.as<float>()[i], breathing_rates.as<float>()[i]};
+                if (predicate.matches(row)) {
+                    if (!result.first_match) {
+                        result.first_match = row;
+                    }
+                    result.matches++;
+                }
+            }
+        }
+        return result;
+    }
+
+    // Complete rows in a session's store (a row is complete once every column has it)
+    static uint64_t row_count(const std::string& dir) {
+        uint64_t rows = UINT64_MAX;
+        for (int c = 0; c < column_count; ++c) {
+            struct stat st;
+            if (stat((dir + "/" + column_files[c]).c_str(), &st) != 0) {
+                return 0;
+            }
+            rows = std::min<uint64_t>(rows, static_cast<uint64_t>(st.st_size) / column_sizes[c]);
+        }
+        return rows;
+    }
+
+    // Drop rows past a checkpoint, before a resumed run appends again
+    static bool truncate(const std::string& dir, uint64_t rows) {
+        for (int c = 0; c < column_count; ++c) {
+            if (::truncate((dir + "/" + column_files[c]).c_str(), static_cast<off_t>(rows * column_sizes[c])) != 0 &&
+                errno != ENOENT) {
+                return false;
+            }
+        }
+        // Full blocks below the cut are still valid; sync_zones rebuilds the rest
+        off_t zones_size = static_cast<off_t>(rows / zone_block_rows * sizeof(ZoneEntry));
+        return ::truncate((dir + "/zones.col").c_str(), zones_size) == 0 || errno == ENOENT;
+    }
+
+    // Read up to limit rows starting at row `after`
+    static std::vector<ReadingRow> read(const std::string& dir, uint64_t after, uint64_t limit) {
+        std::vector<ReadingRow> rows;
+        uint64_t available = row_count(dir);
+        if (after >= available) {
+            return rows;
+        }
+        uint64_t count = std::min(limit, available - after);
+        std::vector<int64_t> timestamps(count);
+        std::vector<float> heart_rates(count);
+        std::vector<float> breathing_rates(count);
+        void* columns[column_count] = {timestamps.data(), heart_rates.data(), breathing_rates.data()};
+        for (int c = 0; c < column_count; ++c) {
+            int fd = ::open((dir + "/" + column_files[c]).c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return rows;
+            }
+            size_t bytes = count * column_sizes[c];
+            ssize_t n = pread(fd, columns[c], bytes, static_cast<off_t>(after * column_sizes[c]));
+            close(fd);
+            if (n != static_cast<ssize_t>(bytes)) {
+                return rows;
+            }
+        }
+        rows.reserve(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            rows.push_back({timestamps[i], heart_rates[i], breathing_rates[i]});
+        }
+        return rows;
+    }
+
+private:
+    static constexpr int column_count = 3;
+    static constexpr const char* column_files[column_count] = {"ts.col", "hr.col", "br.col"};
+    static constexpr size_t column_sizes[column_count] = {sizeof(int64_t), sizeof(float), sizeof(float)};
+    int fds_[column_count] = {-1, -1, -1};
+    int zones_fd_ = -1;
+    uint64_t rows_ = 0;     // Rows in the store, including this instance's appends
+    ZoneEntry zone_;        // Entry of the block being filled
+
+    ReadingsStore() = default;
+
+    bool write_value(int column, const void* data, size_t size) {
+        return ::write(fds_[column], data, size) == static_cast<ssize_t>(size);
+    }
+};
+
+inline ReadingRow reading_to_row(const json& reading) {
+    auto channel = [&reading](const char* key) {
+        return reading.contains(key) && reading[key].is_number() ? reading[key].get<float>()
+                                                                  : std::numeric_limits<float>::quiet_NaN();
+    };
+    return {reading.value("timestamp_ms", int64_t{0}), channel("heart_rate_bpm"), channel("breathing_rate_bpm")};
+}
+
+// Same shape as the readings the SDK callback produces
+inline json row_to_reading(const ReadingRow& row) {
+    json reading = {{"timestamp_ms", row.timestamp}, {"source", "presage_sdk"}};
+    if (!std::isnan(row.heart_rate)) {
+        reading["heart_rate_bpm"] = row.heart_rate;
+    }
+    if (!std::isnan(row.breathing_rate)) {
+        reading["breathing_rate_bpm"] = row.breathing_rate;
+    }
+    return reading;
+}
+
+// Calculate vitals summary statistics
+inline json calculate_vitals_summary(const std::vector<json>& readings) {
+    if (readings.empty()) {
+        return json::object();
+    }
+    
+    std::vector<float> heart_rates;
+    std::vector<float> breathing_rates;
+    
+    // Extract all readings
+    for (const auto& reading : readings) {
+        if (reading.contains("heart_rate_bpm") && reading["heart_rate_bpm"].is_number()) {
+            heart_rates.push_back(reading["heart_rate_bpm"]);
+        }
+        if (reading.contains("breathing_rate_bpm") && reading["breathing_rate_bpm"].is_number()) {
+            breathing_rates.push_back(reading["breathing_rate_bpm"]);
+        }
+    }
+    
+    // Calculate statistics helper
+    auto calc_stats = [](const std::vector<float>& values) -> json {
+        if (values.empty()) {
+            return json::object();
+        }
+        
+        float sum = 0.0f;
+        float min_val = values[0];
+        float max_val = values[0];
+        
+        for (float v : values) {
+            sum += v;
+            min_val = std::min(min_val, v);
+            max_val = std::max(max_val, v);
+        }
+        
+        return {
+            {"avg", sum / values.size()},
+            {"min", min_val},
+            {"max", max_val},
+            {"count", values.size()}
+        };
+    };
+    
+    json summary = {
+        {"heart_rate", calc_stats(heart_rates)},
+        {"breathing_rate", calc_stats(breathing_rates)},
+        {"readings_count", readings.size()},
+        {"all_readings", readings}
+    };
+    
+    return summary;
+}
+
+#ifdef PRESAGE_SDK_AVAILABLE
+// Reading for one SDK metrics callback: the latest heart and breathing rate
+// it carries, if any
+inline json metrics_to_reading(const presage::physiology::MetricsBuffer& metrics, int64_t timestamp) {
+    json reading = {{"timestamp_ms", timestamp}, {"source", "presage_sdk"}};
+    if (!metrics.pulse().rate().empty()) {
+        reading["heart_rate_bpm"] = metrics.pulse().rate().rbegin()->value();
+    }
+    if (!metrics.breathing().rate().empty()) {
+        reading["breathing_rate_bpm"] = metrics.breathing().rate().rbegin()->value();
+    }
+    return reading;
+}
+#endif
@@ -0,0 +1,11 @@
+{
+  "targets": [
+    {
+      "target_name": "presage_addon",
+      "sources": ["presage_addon.c"],
+      "include_dirs": ["../.."],
+      "libraries": ["-L<(module_root_dir)/../../build", "-lpresage_engine_core",
+                    "-Wl,-rpath,<(module_root_dir)/../../build"]
+    }
+  ]
+}
@@ -0,0 +1,20 @@
+// Process a video in-process and print its readings
+//   SMARTSPECTRA_API_KEY=... node example.mjs /app/uploads/test-video.mp4
+import { PresageEngine } from './index.mjs';
+
+const videoPath = process.argv[2] ?? '/app/uploads/test-video.mp4';
+const engine = new PresageEngine(process.env.SMARTSPECTRA_API_KEY, process.env.PRESAGE_ARCHIVE_DIR);
+
+const started = performance.now();
+let live = 0;
+const summary = await engine.processFile(videoPath, {
+  settings: { buffer_duration_s: 0.5 },
+  onReading: () => { live++; },
+});
+console.log(`${summary.session_id}: ${summary.status} in ${((performance.now() - started) / 1000).toFixed(1)} s, ` +
+            `${live} live readings`);
+console.log('heart rate', summary.vitals.heart_rate, 'breathing rate', summary.vitals.breathing_rate);
+
+const { rows, heartRateBpm } = engine.readings(summary.session_id);
+const valid = heartRateBpm.filter((v) => !Number.isNaN(v));
+console.log(`${rows} stored readings, heart rate mean ${(valid.reduce((a, b) => a + b, 0) / valid.length).toFixed(1)} bpm`);
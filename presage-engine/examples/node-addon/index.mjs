@@ -0,0 +1,24 @@
+// In-process Presage engine for Node, over the presage_addon binding
+import { createRequire } from 'module';
+
+const require = createRequire(import.meta.url);
+const addon = require('./build/Release/presage_addon.node');
+
+export class PresageEngine {
+  constructor(apiKey, archiveDir = '/app/uploads/sessions') {
+    this.engine = addon.open(apiKey, archiveDir);
+  }
+
+  // Process a video file; onReading receives { timestampMs, heartRateBpm, breathingRateBpm }
+  // as the SDK produces them. Resolves with the session summary (same as GET /sessions/<id>).
+  async processFile(videoPath, { settings = null, onReading = null } = {}) {
+    const summary = await addon.processFile(this.engine, videoPath, settings && JSON.stringify(settings), onReading);
+    return JSON.parse(summary);
+  }
+
+  // A finished session's readings as typed arrays over the archive, without copying.
+  // NaN marks a channel the SDK did not report.
+  readings(sessionId) {
+    return addon.readings(this.engine, sessionId);
+  }
+}
@@ -0,0 +1,324 @@
+// presage_addon.c
+// N-API addon embedding presage_engine_core in a Node process
+//
+// A thin binding over presage_engine.h: no HTTP hop, no JSON for readings.
+// processFile() runs a session on a libuv worker and resolves with its
+// summary; readings reach JavaScript through a thread-safe function as the
+// SDK produces them; readings() exposes a finished session's columns as typed
+// arrays over the library's memory mapping, without copying.
+//
+// JavaScript API (see index.mjs):
+//   open(apiKey, archiveDir) -> engine
+//   processFile(engine, videoPath, settingsJson | null, onReading | null) -> Promise<summaryJson>
+//   readings(engine, sessionId) -> { rows, timestampMs: BigInt64Array, heartRateBpm: Float32Array,
+//                                    breathingRateBpm: Float32Array }
+
+#define NAPI_VERSION 8
+#include <node_api.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "presage_engine.h"
+
+#define CHECK(env, call)                                             \
+    do {                                                             \
+        if ((call) != napi_ok) {                                     \
+            napi_throw_error((env), NULL, "N-API call failed: " #call); \
+            return NULL;                                             \
+        }                                                            \
+    } while (0)
+
+static napi_value throw_presage(napi_env env, const char* what) {
+    char message[512];
+    snprintf(message, sizeof(message), "%s: %s", what, presage_last_error());
+    napi_throw_error(env, NULL, message);
+    return NULL;
+}
+
+// Caller frees the result
+static char* get_string(napi_env env, napi_value value) {
+    size_t length = 0;
+    if (napi_get_value_string_utf8(env, value, NULL, 0, &length) != napi_ok) {
+        return NULL;
+    }
+    char* text = malloc(length + 1);
+    napi_get_value_string_utf8(env, value, text, length + 1, &length);
+    return text;
+}
+
+static int is_nullish(napi_env env, napi_value value) {
+    napi_valuetype type;
+    napi_typeof(env, value, &type);
+    return type == napi_null || type == napi_undefined;
+}
+
+// The engine must outlive its sessions, but the GC may collect the JS handle
+// first (new PresageEngine(key).readings(id)). The handle and every session
+// holder (ProcessJob, MappedReadings) each count as a reference, so the engine
+// is destroyed after the last session. Only touched on the JS thread.
+typedef struct {
+    presage_engine* engine;
+    int references;
+} EngineRef;
+
+static EngineRef* engine_retain(EngineRef* ref) {
+    ref->references++;
+    return ref;
+}
+
+static void engine_release(EngineRef* ref) {
+    if (--ref->references == 0) {
+        presage_engine_destroy(ref->engine);
+        free(ref);
+    }
+}
+
+static void engine_finalize(napi_env env, void* data, void* hint) {
+    engine_release(data);
+}
+
+// open(apiKey, archiveDir)
+static napi_value open_engine(napi_env env, napi_callback_info info) {
+    size_t argc = 2;
+    napi_value argv[2];
+    CHECK(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+    char* api_key = get_string(env, argv[0]);
+    char* archive_dir = get_string(env, argv[1]);
+    if (!api_key || !archive_dir) {
+        free(api_key);
+        free(archive_dir);
+        napi_throw_type_error(env, NULL, "open(apiKey, archiveDir) takes two strings");
+        return NULL;
+    }
+    presage_engine* engine = NULL;
+    presage_status status = presage_engine_create(api_key, archive_dir, &engine);
+    free(api_key);
+    free(archive_dir);
+    if (status != PRESAGE_OK) {
+        return throw_presage(env, "presage_engine_create");
+    }
+    EngineRef* ref = malloc(sizeof(*ref));
+    ref->engine = engine;
+    ref->references = 1;
+    napi_value result;
+    if (napi_create_external(env, ref, engine_finalize, NULL, &result) != napi_ok) {
+        engine_release(ref);
+        napi_throw_error(env, NULL, "N-API call failed: napi_create_external");
+        return NULL;
+    }
+    return result;
+}
+
+// One processFile() call, from the JS thread to the worker and back
+typedef struct {
+    EngineRef* engine;
+    presage_session* session;
+    napi_async_work work;
+    napi_deferred deferred;
+    napi_threadsafe_function on_reading;
+    presage_status status;
+    char* error;
+} ProcessJob;
+
+// SDK thread: hand the reading to the JS thread
+static void forward_reading(void* user_data, const presage_reading* reading, uint64_t index) {
+    ProcessJob* job = user_data;
+    presage_reading* copy = malloc(sizeof(*copy));
+    *copy = *reading;
+    if (napi_call_threadsafe_function(job->on_reading, copy, napi_tsfn_nonblocking) != napi_ok) {
+        free(copy);
+    }
+}
+
+// JS thread: onReading({ timestampMs, heartRateBpm, breathingRateBpm })
+static void call_on_reading(napi_env env, napi_value callback, void* context, void* data) {
+    presage_reading* reading = data;
+    if (env) {
+        napi_value object, value, undefined;
+        napi_create_object(env, &object);
+        napi_create_int64(env, reading->timestamp_ms, &value);
+        napi_set_named_property(env, object, "timestampMs", value);
+        napi_create_double(env, reading->heart_rate_bpm, &value);
+        napi_set_named_property(env, object, "heartRateBpm", value);
+        napi_create_double(env, reading->breathing_rate_bpm, &value);
+        napi_set_named_property(env, object, "breathingRateBpm", value);
+        napi_get_undefined(env, &undefined);
+        napi_call_function(env, undefined, callback, 1, &object, NULL);
+    }
+    free(reading);
+}
+
+// Worker thread: block until the session finishes
+static void process_execute(napi_env env, void* data) {
+    ProcessJob* job = data;
+    job->status = presage_session_wait(job->session, -1);
+    if (job->status != PRESAGE_OK) {
+        // Errors are per thread, so keep this one for the JS thread
+        const char* error = presage_last_error();
+        job->error = malloc(strlen(error) + 1);
+        memcpy(job->error, error, strlen(error) + 1);
+    }
+}
+
+// JS thread: resolve with the summary JSON, or reject with the session's error
+static void process_complete(napi_env env, napi_status napi_result, void* data) {
+    ProcessJob* job = data;
+    char* summary = NULL;
+    if (job->status == PRESAGE_OK && presage_session_summary(job->session, &summary) == PRESAGE_OK) {
+        napi_value value;
+        napi_create_string_utf8(env, summary, NAPI_AUTO_LENGTH, &value);
+        napi_resolve_deferred(env, job->deferred, value);
+        presage_free(summary);
+    } else {
+        napi_value message, error;
+        napi_create_string_utf8(env, job->error ? job->error : presage_last_error(), NAPI_AUTO_LENGTH, &message);
+        napi_create_error(env, NULL, message, &error);
+        napi_reject_deferred(env, job->deferred, error);
+    }
+    presage_session_subscribe(job->session, NULL, NULL);
+    presage_session_destroy(job->session);
+    engine_release(job->engine);
+    if (job->on_reading) {
+        napi_release_threadsafe_function(job->on_reading, napi_tsfn_release);
+    }
+    napi_delete_async_work(env, job->work);
+    free(job->error);
+    free(job);
+}
+
+// processFile(engine, videoPath, settingsJson, onReading)
+static napi_value process_file(napi_env env, napi_callback_info info) {
+    size_t argc = 4;
+    napi_value argv[4];
+    CHECK(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+    if (argc < 2) {
+        napi_throw_type_error(env, NULL, "processFile(engine, videoPath, settingsJson?, onReading?)");
+        return NULL;
+    }
+    EngineRef* engine = NULL;
+    CHECK(env, napi_get_value_external(env, argv[0], (void**)&engine));
+    char* video_path = get_string(env, argv[1]);
+    char* settings = argc > 2 && !is_nullish(env, argv[2]) ? get_string(env, argv[2]) : NULL;
+
+    ProcessJob* job = calloc(1, sizeof(*job));
+    presage_status status = presage_session_create(engine->engine, settings, &job->session);
+    free(settings);
+    if (status != PRESAGE_OK) {
+        free(video_path);
+        free(job);
+        return throw_presage(env, "presage_session_create");
+    }
+    job->engine = engine_retain(engine);
+    if (argc > 3 && !is_nullish(env, argv[3])) {
+        napi_value name;
+        napi_create_string_utf8(env, "presage.onReading", NAPI_AUTO_LENGTH, &name);
+        napi_create_threadsafe_function(env, argv[3], NULL, name, 0, 1, NULL, NULL, NULL, call_on_reading, &job->on_reading);
+        presage_session_subscribe(job->session, forward_reading, job);
+    }
+    status = presage_session_process_file(job->session, video_path);
+    free(video_path);
+    if (status != PRESAGE_OK) {
+        napi_value error = throw_presage(env, "presage_session_process_file");
+        presage_session_destroy(job->session);
+        engine_release(job->engine);
+        if (job->on_reading) {
+            napi_release_threadsafe_function(job->on_reading, napi_tsfn_release);
+        }
+        free(job);
+        return error;
+    }
+
+    napi_value promise, resource_name;
+    CHECK(env, napi_create_promise(env, &job->deferred, &promise));
+    napi_create_string_utf8(env, "presage.processFile", NAPI_AUTO_LENGTH, &resource_name);
+    CHECK(env, napi_create_async_work(env, NULL, resource_name, process_execute, process_complete, job, &job->work));
+    CHECK(env, napi_queue_async_work(env, job->work));
+    return promise;
+}
+
+// Keeps the session and its mapping alive until all three typed arrays are collected
+typedef struct {
+    EngineRef* engine;
+    presage_session* session;
+    presage_readings_view view;
+    int references;
+} MappedReadings;
+
+static void mapped_finalize(napi_env env, void* data, void* hint) {
+    MappedReadings* mapped = hint;
+    if (--mapped->references == 0) {
+        presage_readings_view_release(&mapped->view);
+        presage_session_destroy(mapped->session);
+        engine_release(mapped->engine);
+        free(mapped);
+    }
+}
+
+static napi_value typed_array(napi_env env, MappedReadings* mapped, const void* data, size_t element_size,
+                              napi_typedarray_type type) {
+    napi_value buffer, array;
+    size_t bytes = mapped->view.rows * element_size;
+    // A zero-length external buffer is not allowed; empty sessions get a plain one
+    if (bytes == 0) {
+        CHECK(env, napi_create_arraybuffer(env, 0, NULL, &buffer));
+        mapped_finalize(env, NULL, mapped);
+    } else {
+        CHECK(env, napi_create_external_arraybuffer(env, (void*)data, bytes, mapped_finalize, mapped, &buffer));
+    }
+    CHECK(env, napi_create_typedarray(env, type, mapped->view.rows, buffer, 0, &array));
+    return array;
+}
+
+// readings(engine, sessionId)
+static napi_value readings(napi_env env, napi_callback_info info) {
+    size_t argc = 2;
+    napi_value argv[2];
+    CHECK(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+    EngineRef* engine = NULL;
+    CHECK(env, napi_get_value_external(env, argv[0], (void**)&engine));
+    char* session_id = get_string(env, argv[1]);
+    if (!session_id) {
+        napi_throw_type_error(env, NULL, "readings(engine, sessionId)");
+        return NULL;
+    }
+    MappedReadings* mapped = calloc(1, sizeof(*mapped));
+    presage_status status = presage_session_open(engine->engine, session_id, &mapped->session);
+    free(session_id);
+    if (status != PRESAGE_OK) {
+        free(mapped);
+        return throw_presage(env, "presage_session_open");
+    }
+    mapped->engine = engine_retain(engine);
+    if (presage_session_map_readings(mapped->session, &mapped->view) != PRESAGE_OK) {
+        presage_session_destroy(mapped->session);
+        engine_release(mapped->engine);
+        free(mapped);
+        return throw_presage(env, "presage_session_map_readings");
+    }
+    mapped->references = 3;
+
+    napi_value result, rows;
+    CHECK(env, napi_create_object(env, &result));
+    CHECK(env, napi_create_int64(env, (int64_t)mapped->view.rows, &rows));
+    napi_set_named_property(env, result, "rows", rows);
+    napi_set_named_property(env, result, "timestampMs",
+                            typed_array(env, mapped, mapped->view.timestamp_ms, sizeof(int64_t), napi_bigint64_array));
+    napi_set_named_property(env, result, "heartRateBpm",
+                            typed_array(env, mapped, mapped->view.heart_rate_bpm, sizeof(float), napi_float32_array));
+    napi_set_named_property(env, result, "breathingRateBpm",
+                            typed_array(env, mapped, mapped->view.breathing_rate_bpm, sizeof(float), napi_float32_array));
+    return result;
+}
+
+static napi_value init(napi_env env, napi_value exports) {
+    napi_property_descriptor properties[] = {
+        {"open", NULL, open_engine, NULL, NULL, NULL, napi_default, NULL},
+        {"processFile", NULL, process_file, NULL, NULL, NULL, napi_default, NULL},
+        {"readings", NULL, readings, NULL, NULL, NULL, napi_default, NULL},
+    };
+    napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties);
+    return exports;
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -4,11 +4,43 @@
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
 #include <cstring>
 #include <ctime>
 #include <algorithm>
 #include <vector>
+#include <deque>
+#include <functional>
+#include <future>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <sstream>
+#include <cerrno>
+#include <cmath>
+#include <limits>
+#include <csignal>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
 
 // HTTP server (single header)
 #include "deps/httplib.h"
@@ -28,109 +60,3862 @@
 
 #include <opencv2/opencv.hpp>
 
+// Face-tracking crop stage (the "roi_crop" setting)
+#include "roi_crop.hpp"
+#include "v4l2_capture.hpp"
+
+// Session archive layout, readings store and vitals summary (shared with presage_engine_core)
+#include "engine_core.hpp"
+#include "pipeline.hpp"
+
 using json = nlohmann::json;
 
-// Global state
-std::atomic<bool> sdk_initialized{false};
-std::atomic<bool> camera_running{false};
-std::mutex vitals_mutex;
-json latest_vitals;
-std::string video_file_path = "";  // Path to uploaded video file
+// Wait and hold times of one named lock, in fixed buckets. Only the lock's
+// holder writes, so updates are plain relaxed stores rather than atomic RMWs.
+struct LockTimeHistogram {
+    static constexpr double bounds[] = {1e-6, 4e-6, 16e-6, 64e-6, 256e-6, 1e-3, 4e-3, 16e-3, 64e-3, 0.25, 1.0};
+    static constexpr size_t bucket_count = sizeof(bounds) / sizeof(bounds[0]);
+    std::atomic<int64_t> buckets[bucket_count + 1] = {};
+    std::atomic<int64_t> count{0};
+    std::atomic<int64_t> sum_ns{0};
+    std::atomic<int64_t> max_ns{0};
+
+    void observe(int64_t ns) {
+        double seconds = ns / 1e9;
+        size_t i = 0;
+        while (i < bucket_count && seconds > bounds[i]) {
+            ++i;
+        }
+        bump(buckets[i], 1);
+        bump(count, 1);
+        bump(sum_ns, ns);
+        if (ns > max_ns.load(std::memory_order_relaxed)) {
+            max_ns.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    void reset() {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        count.store(0, std::memory_order_relaxed);
+        sum_ns.store(0, std::memory_order_relaxed);
+        max_ns.store(0, std::memory_order_relaxed);
+    }
+
+    // Upper bound of the bucket holding quantile q (+Inf past the last bound)
+    double quantile_bound(double q) const {
+        int64_t total = count.load(std::memory_order_relaxed);
+        int64_t cumulative = 0;
+        for (size_t i = 0; i < bucket_count; ++i) {
+            cumulative += buckets[i].load(std::memory_order_relaxed);
+            if (total > 0 && cumulative >= q * total) {
+                return bounds[i];
+            }
+        }
+        return std::numeric_limits<double>::infinity();
+    }
+
+    json to_json() const {
+        auto ms = [](double seconds) { return std::isinf(seconds) ? json(nullptr) : json(seconds * 1e3); };
+        return {
+            {"count", count.load(std::memory_order_relaxed)},
+            {"total_ms", sum_ns.load(std::memory_order_relaxed) / 1e6},
+            {"max_ms", max_ns.load(std::memory_order_relaxed) / 1e6},
+            {"p50_le_ms", ms(quantile_bound(0.50))},
+            {"p99_le_ms", ms(quantile_bound(0.99))}
+        };
+    }
+
+    std::string prometheus(const std::string& name, const std::string& lock) const {
+        std::string out;
+        int64_t cumulative = 0;
+        for (size_t i = 0; i <= bucket_count; ++i) {
+            cumulative += buckets[i].load(std::memory_order_relaxed);
+            std::string le = i < bucket_count ? std::to_string(bounds[i]) : "+Inf";
+            out += name + "_bucket{lock=\"" + lock + "\",le=\"" + le + "\"} " + std::to_string(cumulative) + "\n";
+        }
+        out += name + "_sum{lock=\"" + lock + "\"} " + std::to_string(sum_ns.load(std::memory_order_relaxed) / 1e9) + "\n";
+        out += name + "_count{lock=\"" + lock + "\"} " + std::to_string(count.load(std::memory_order_relaxed)) + "\n";
+        return out;
+    }
+
+private:
+    static void bump(std::atomic<int64_t>& value, int64_t by) {
+        value.store(value.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+};
+
+// Drop-in std::mutex that records how long callers wait for it and how long
+// they hold it, exported by GET /metrics and GET /debug/locks. An uncontended
+// lock costs a try_lock and two clock reads; only contended acquisitions time
+// the wait. Instances must be globals (they register themselves at startup).
+class InstrumentedMutex {
+public:
+    explicit InstrumentedMutex(const char* name) : name_(name) {
+        registry().push_back(this);
+    }
+    InstrumentedMutex(const InstrumentedMutex&) = delete;
+    InstrumentedMutex& operator=(const InstrumentedMutex&) = delete;
+
+    void lock() {
+        if (mutex_.try_lock()) {
+            held_since_ns_ = now_ns();
+        } else {
+            int64_t waiting_since = now_ns();
+            mutex_.lock();
+            held_since_ns_ = now_ns();
+            wait_.observe(held_since_ns_ - waiting_since);
+        }
+    }
+
+    bool try_lock() {
+        if (!mutex_.try_lock()) {
+            return false;
+        }
+        held_since_ns_ = now_ns();
+        return true;
+    }
+
+    void unlock() {
+        hold_.observe(now_ns() - held_since_ns_);
+        mutex_.unlock();
+    }
+
+    // Zero the statistics, e.g. before a load test
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wait_.reset();
+        hold_.reset();
+    }
+
+    const std::string& name() const { return name_; }
+    const LockTimeHistogram& wait() const { return wait_; }  // Contended acquisitions only
+    const LockTimeHistogram& hold() const { return hold_; }  // Every acquisition
+
+    static std::vector<InstrumentedMutex*>& registry() {
+        static std::vector<InstrumentedMutex*> locks;
+        return locks;
+    }
+
+private:
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    std::string name_;
+    std::mutex mutex_;
+    int64_t held_since_ns_ = 0;  // Written by the holder only
+    LockTimeHistogram wait_;
+    LockTimeHistogram hold_;
+};
+
+// Global state
+std::atomic<bool> sdk_initialized{false};
+std::atomic<bool> camera_running{false};
+InstrumentedMutex vitals_mutex("vitals");
+json latest_vitals;
+std::string video_file_path = "";  // Path to uploaded video file
+std::string camera_device_path = "/dev/video0";  // PRESAGE_CAMERA_DEVICE, or /test?device=
+
+// Store all vitals readings for comprehensive analysis
+std::vector<json> all_vitals_readings;
+InstrumentedMutex vitals_readings_mutex("vitals_readings");
+
+// Session archive - each processing run gets a directory under the uploads volume
+// holding its checkpoint while running and its summary once finished, so progress
+// survives engine restarts (docker-compose uses restart: unless-stopped)
+const std::string session_archive_dir = "/app/uploads/sessions";
+std::string current_session_id = "";
+int64_t checkpoint_interval_s = 10;  // PRESAGE_CHECKPOINT_INTERVAL_S
+int64_t resume_warmup_s = 10;        // PRESAGE_RESUME_WARMUP_S - video re-fed to the SDK before the checkpoint
+int64_t batch_max_videos = 16;       // PRESAGE_BATCH_MAX_VIDEOS - per POST /batch request
+bool roi_crop_default = false;       // PRESAGE_ROI_CROP - roi_crop for requests that do not set it
+std::string face_cascade_path = RoiCropOptions().cascade_path;  // PRESAGE_FACE_CASCADE
+
+// Where a resumed run picks up in the original video (see resume_from)
+struct ResumePoint {
+    int64_t start_frame = 0;            // First frame of the trimmed video, in original-video frames
+    int64_t checkpoint_frame = 0;       // Frame offset recorded by the last checkpoint
+    int64_t checkpoint_timestamp = 0;   // SDK timestamp of the checkpoint frame in the original run
+    int64_t start_timestamp = 0;        // Estimated SDK timestamp of start_frame in the original run
+    int64_t first_timestamp = 0;        // SDK timestamp of the first frame of the original run
+    std::string input_path;             // Trimmed video to feed the SDK (empty: the original)
+};
+
+// Per-run SDK settings a client may override (the multipart "settings" field)
+struct ProcessingSettings {
+    double buffer_duration_s = 0.5;  // settings.continuous.preprocessed_data_buffer_duration_s
+    int capture_width_px = 1280;
+    int capture_height_px = 720;
+    bool roi_crop = roi_crop_default;  // Feed the SDK a face crop of uploaded videos (see roi_crop.hpp)
+    int roi_output_px = 480;           // Side of the cropped frames
+
+    json to_json() const {
+        return {
+            {"buffer_duration_s", buffer_duration_s},
+            {"capture_width_px", capture_width_px},
+            {"capture_height_px", capture_height_px},
+            {"roi_crop", roi_crop},
+            {"roi_output_px", roi_output_px}
+        };
+    }
+
+    // Apply the keys present in overrides; false with a message on invalid values
+    bool update_from_json(const json& overrides, std::string& error) {
+        if (!overrides.is_object()) {
+            error = "settings must be a JSON object";
+            return false;
+        }
+        try {
+            if (overrides.contains("buffer_duration_s")) {
+                buffer_duration_s = overrides["buffer_duration_s"].get<double>();
+            }
+            if (overrides.contains("capture_width_px")) {
+                capture_width_px = overrides["capture_width_px"].get<int>();
+            }
+            if (overrides.contains("capture_height_px")) {
+                capture_height_px = overrides["capture_height_px"].get<int>();
+            }
+            if (overrides.contains("roi_crop")) {
+                roi_crop = overrides["roi_crop"].get<bool>();
+            }
+            if (overrides.contains("roi_output_px")) {
+                roi_output_px = overrides["roi_output_px"].get<int>();
+            }
+        } catch (const std::exception& e) {
+            error = std::string("Invalid settings: ") + e.what();
+            return false;
+        }
+        if (buffer_duration_s < 0.2 || buffer_duration_s > 5.0) {
+            error = "buffer_duration_s must be between 0.2 and 5.0";
+            return false;
+        }
+        if (capture_width_px < 160 || capture_width_px > 3840 || capture_height_px < 120 || capture_height_px > 2160) {
+            error = "capture size must be between 160x120 and 3840x2160";
+            return false;
+        }
+        if (roi_output_px < 128 || roi_output_px > 1080) {
+            error = "roi_output_px must be between 128 and 1080";
+            return false;
+        }
+        return true;
+    }
+};
+
+// What the cost model knows about a job before it runs (see probe_job)
+struct JobFeatures {
+    double duration_s = 0.0;
+    double fps = 0.0;
+    int width = 0;
+    int height = 0;
+    double buffer_duration_s = 0.5;
+    bool roi_crop = false;
+
+    // Megapixels the job decodes - the main driver of SDK preprocessing cost
+    double megapixels() const { return duration_s * fps * width * height / 1e6; }
+
+    json to_json() const {
+        return {
+            {"duration_s", duration_s},
+            {"fps", fps},
+            {"width", width},
+            {"height", height},
+            {"buffer_duration_s", buffer_duration_s},
+            {"roi_crop", roi_crop}
+        };
+    }
+};
+
+// CPU time of the calling thread, in nanoseconds
+int64_t thread_cpu_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Add the calling thread's CPU time over this scope to `total`
+struct ThreadCpuCharge {
+    std::atomic<int64_t>& total;
+    int64_t started = thread_cpu_ns();
+    ~ThreadCpuCharge() { total += thread_cpu_ns() - started; }
+};
+
+// What a session costs, for billing and capacity planning. Filled in while its
+// job runs and reported as "usage" (see usage_summary). SDK threads serve
+// every container at once, so besides the CPU measured on threads that only
+// work for this session, the watchdog gives each running session a share of
+// the process's CPU and RSS in proportion to the frames it processed.
+struct SessionUsage {
+    std::atomic<int64_t> stage_cpu_ns{0};       // Probe and crop, before the container
+    std::atomic<int64_t> sdk_thread_cpu_ns{0};  // Its SDK run thread and callbacks
+    std::atomic<int64_t> cpu_share_ns{0};       // Share of process CPU while its container ran
+    std::atomic<int64_t> rss_share_peak{0};     // Largest share of process RSS, in bytes
+    std::atomic<int64_t> memory_peak{0};        // Largest estimate of its in-memory readings and samples
+    std::atomic<int64_t> bytes_in{0};           // Input video (the upload)
+    std::atomic<int64_t> frames_decoded{0};     // Decoded by the engine itself (crop stage)
+    int64_t frames_at_sample = 0;               // Watchdog only: frames at its last sample
+};
+
+// Response bytes served per session since the engine started: session routes,
+// job results and artifact downloads. Keeps the most recent sessions only.
+class SessionEgress {
+public:
+    void add(const std::string& session_id, int64_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        total_ += bytes;
+        auto [it, inserted] = bytes_.try_emplace(session_id, 0);
+        it->second += bytes;
+        if (inserted) {
+            order_.push_back(session_id);
+            if (order_.size() > max_sessions) {
+                bytes_.erase(order_.front());
+                order_.pop_front();
+            }
+        }
+    }
+
+    int64_t get(const std::string& session_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = bytes_.find(session_id);
+        return it == bytes_.end() ? 0 : it->second;
+    }
+
+    int64_t total() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return total_;
+    }
+
+private:
+    static constexpr size_t max_sessions = 4096;
+    std::mutex mutex_;
+    std::unordered_map<std::string, int64_t> bytes_;
+    std::deque<std::string> order_;  // Oldest first
+    int64_t total_ = 0;
+};
+SessionEgress session_egress;
+
+// A running SDK container. Shared between the job that started it, the
+// container's callbacks and the stall watchdog, so a recycled container can
+// outlive its job. Everything a run produces lives here, so several can run
+// at once (see POST /batch).
+struct ContainerRun {
+    std::string session_id;
+    std::string video_path;            // Original upload checkpoints refer to (empty: camera)
+    ProcessingSettings processing;
+    bool feeds_live = true;            // Also update all_vitals_readings and latest_vitals (single jobs)
+    json roi_crop = json::object();    // Crop stage statistics, when it ran
+    bool feeds_camera_ring = false;    // Camera run - its frames keep camera_ring current
+    std::string source_path;           // What the SDK reads: the input, or the crop stage's roi.mp4
+    bool completed = false;            // The SDK stage processed the whole input
+    json cost = json::object();        // Cost model observation, recorded by the persist stage
+    std::string shadow_of;             // Shadow run: the primary session it re-processes (see ShadowEvaluation)
+    std::atomic<bool> archived{false};  // Its final result is written; no checkpoint may follow
+
+    // Cost model inputs and prediction (video jobs; see probe_job)
+    std::optional<JobFeatures> features;
+    double predicted_wall_s = 0.0;
+    std::atomic<int64_t> job_started_ms{0};  // Steady ms the run got its pool slot (0: queued)
+    std::optional<ResumePoint> resume;
+    std::atomic<int64_t> timestamp_shift{0};  // Maps this run's SDK timestamps onto the original video
+    std::atomic<bool> timestamp_shift_known{false};
+
+    // Liveness, in steady-clock milliseconds
+    std::atomic<int64_t> started_ms{0};
+    std::atomic<int64_t> last_frame_ms{0};
+    std::atomic<int64_t> last_callback_ms{0};
+    std::atomic<int64_t> frames{0};
+    std::atomic<int64_t> callbacks{0};
+
+    std::atomic<bool> finished{false};  // Run() returned
+    std::atomic<bool> stalled{false};   // Recycled by the watchdog; callbacks refuse further work
+    std::atomic<bool> preempted{false}; // Shadow run stopped for a real job (stalled is set with it)
+    AsyncEvent ended;                   // Set with finished or stalled; wakes the SDK stage
+    std::shared_ptr<ReadingsStore> store;  // The session's readings in the archive
+    SessionUsage usage;
+
+    // Progress in original-video frames and SDK timestamps, for checkpoints
+    std::atomic<int64_t> frame_offset{0};
+    std::atomic<int64_t> first_frame_timestamp{-1};
+    std::atomic<int64_t> last_frame_timestamp{0};
+
+    std::mutex readings_mutex;
+    std::vector<json> readings;
+
+    // REST integration latency - from the SDK handing us a frame to the metrics
+    // covering it coming back, which spans buffering, upload and server time
+    std::mutex latency_mutex;
+    std::deque<std::pair<int64_t, int64_t>> frame_times;  // SDK timestamp -> steady ms, oldest first
+    std::vector<double> integration_latency_ms;
+};
+
+// Fixed-bucket histogram exported in Prometheus format
+struct LatencyHistogram {
+    static constexpr double bounds[] = {0.05, 0.1, 0.25, 0.5, 1.0, 2.0, 5.0, 10.0, 30.0};
+    static constexpr size_t bucket_count = sizeof(bounds) / sizeof(bounds[0]);
+    std::atomic<int64_t> buckets[bucket_count + 1] = {};
+    std::atomic<int64_t> count{0};
+    std::atomic<int64_t> sum_us{0};
+
+    void observe(double seconds) {
+        size_t i = 0;
+        while (i < bucket_count && seconds > bounds[i]) {
+            ++i;
+        }
+        buckets[i]++;
+        count++;
+        sum_us += static_cast<int64_t>(seconds * 1e6);
+    }
+
+    std::string prometheus(const std::string& name, const std::string& help) const {
+        std::string out = "# HELP " + name + " " + help + "\n# TYPE " + name + " histogram\n";
+        int64_t cumulative = 0;
+        for (size_t i = 0; i <= bucket_count; ++i) {
+            cumulative += buckets[i].load();
+            std::string le = i < bucket_count ? std::to_string(bounds[i]) : "+Inf";
+            out += name + "_bucket{le=\"" + le + "\"} " + std::to_string(cumulative) + "\n";
+        }
+        out += name + "_sum " + std::to_string(sum_us.load() / 1e6) + "\n";
+        out += name + "_count " + std::to_string(count.load()) + "\n";
+        return out;
+    }
+};
+LatencyHistogram rest_integration_latency;
+
+// Usage of every archived session, for /metrics (see usage_summary)
+struct UsageTotals {
+    std::atomic<int64_t> sessions{0};
+    std::atomic<int64_t> cpu_ns{0};
+    std::atomic<int64_t> thread_cpu_ns{0};
+    std::atomic<int64_t> bytes_in{0};
+    std::atomic<int64_t> frames_decoded{0};
+    std::atomic<int64_t> frames_processed{0};
+    LatencyHistogram cpu_per_video_second;  // Video sessions: CPU seconds per second of video
+};
+UsageTotals usage_totals;
+
+// Per-host processing cost model. Predicts a video job's wall and CPU time from
+// its probed features by exponentially weighted least squares over completed
+// jobs: the normal equations decay by a forgetting factor on every update and
+// are re-solved for each prediction, so the fit follows changes to the host.
+// Drives ETAs, Retry-After and batch placement; its prediction error is
+// exported in /metrics.
+class CostModel {
+public:
+    static constexpr int dims = 5;
+    static constexpr int min_samples = 8;   // Before this, predictions use the prior
+    static constexpr double forgetting = 0.98;
+
+    double predict_wall(const JobFeatures& job) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return predict(wall_, job, prior_wall(job));
+    }
+
+    double predict_cpu(const JobFeatures& job) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return predict(cpu_, job, prior_wall(job) * 2.0);
+    }
+
+    // Learn from a completed job; cpu_s < 0 when it could not be attributed
+    void observe(const JobFeatures& job, double wall_s, double cpu_s) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        double predicted = predict(wall_, job, prior_wall(job));
+        wall_error_seconds.observe(std::fabs(predicted - wall_s));
+        record_error(wall_errors_, predicted, wall_s);
+        fit(wall_, job, wall_s);
+        if (cpu_s >= 0) {
+            record_error(cpu_errors_, predict(cpu_, job, prior_wall(job) * 2.0), cpu_s);
+            fit(cpu_, job, cpu_s);
+        }
+        samples_++;
+    }
+
+    // Mean absolute percentage error over recent jobs (0 before any)
+    double wall_mape() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return mean(wall_errors_);
+    }
+    double cpu_mape() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return mean(cpu_errors_);
+    }
+    int64_t samples() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return samples_;
+    }
+
+    json to_json() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return {{"samples", samples_}, {"wall", wall_.to_json()}, {"cpu", cpu_.to_json()}};
+    }
+
+    void from_json(const json& data) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        samples_ = data.value("samples", int64_t{0});
+        wall_.from_json(data.value("wall", json::object()));
+        cpu_.from_json(data.value("cpu", json::object()));
+    }
+
+    LatencyHistogram wall_error_seconds;
+
+private:
+    // Normal equations of a weighted least-squares fit
+    struct Fit {
+        double xtx[dims][dims] = {};
+        double xty[dims] = {};
+        int64_t samples = 0;
+
+        json to_json() const {
+            json rows = json::array();
+            for (const auto& row : xtx) {
+                rows.push_back(std::vector<double>(row, row + dims));
+            }
+            return {{"xtx", rows}, {"xty", std::vector<double>(xty, xty + dims)}, {"samples", samples}};
+        }
+
+        void from_json(const json& data) {
+            try {
+                for (int i = 0; i < dims; ++i) {
+                    xty[i] = data.at("xty").at(i).get<double>();
+                    for (int j = 0; j < dims; ++j) {
+                        xtx[i][j] = data.at("xtx").at(i).at(j).get<double>();
+                    }
+                }
+                samples = data.value("samples", int64_t{0});
+            } catch (const std::exception&) {
+                *this = Fit();
+            }
+        }
+    };
+
+    static void features(const JobFeatures& job, double x[dims]) {
+        x[0] = 1.0;
+        x[1] = job.duration_s;
+        x[2] = job.megapixels();
+        x[3] = job.roi_crop ? job.megapixels() : 0.0;  // Crop pre-pass decodes the full frames once more
+        x[4] = job.duration_s / std::max(0.2, job.buffer_duration_s);  // REST round trips
+    }
+
+    // Before the model has data: about real time plus start-up
+    static double prior_wall(const JobFeatures& job) { return 5.0 + job.duration_s; }
+
+    static double predict(const Fit& fit, const JobFeatures& job, double prior) {
+        if (fit.samples < min_samples) {
+            return prior;
+        }
+        // Solve (XtX + ridge) w = Xty by Gaussian elimination with partial pivoting
+        double a[dims][dims + 1];
+        for (int i = 0; i < dims; ++i) {
+            for (int j = 0; j < dims; ++j) {
+                a[i][j] = fit.xtx[i][j];
+            }
+            a[i][i] += 1e-6 * (1.0 + fit.xtx[i][i]);
+            a[i][dims] = fit.xty[i];
+        }
+        for (int col = 0; col < dims; ++col) {
+            int pivot = col;
+            for (int row = col + 1; row < dims; ++row) {
+                if (std::fabs(a[row][col]) > std::fabs(a[pivot][col])) {
+                    pivot = row;
+                }
+            }
+            if (std::fabs(a[pivot][col]) < 1e-12) {
+                return prior;
+            }
+            std::swap(a[col], a[pivot]);
+            for (int row = 0; row < dims; ++row) {
+                if (row != col) {
+                    double factor = a[row][col] / a[col][col];
+                    for (int k = col; k <= dims; ++k) {
+                        a[row][k] -= factor * a[col][k];
+                    }
+                }
+            }
+        }
+        double x[dims];
+        features(job, x);
+        double prediction = 0.0;
+        for (int i = 0; i < dims; ++i) {
+            prediction += x[i] * a[i][dims] / a[i][i];
+        }
+        return std::max(0.0, prediction);
+    }
+
+    static void fit(Fit& fit, const JobFeatures& job, double y) {
+        double x[dims];
+        features(job, x);
+        for (int i = 0; i < dims; ++i) {
+            for (int j = 0; j < dims; ++j) {
+                fit.xtx[i][j] = forgetting * fit.xtx[i][j] + x[i] * x[j];
+            }
+            fit.xty[i] = forgetting * fit.xty[i] + x[i] * y;
+        }
+        fit.samples++;
+    }
+
+    static void record_error(std::deque<double>& errors, double predicted, double actual) {
+        errors.push_back(std::fabs(predicted - actual) / std::max(actual, 1.0));
+        if (errors.size() > 100) {
+            errors.pop_front();
+        }
+    }
+
+    static double mean(const std::deque<double>& values) {
+        double sum = 0.0;
+        for (double v : values) {
+            sum += v;
+        }
+        return values.empty() ? 0.0 : sum / values.size();
+    }
+
+    std::mutex mutex_;
+    Fit wall_;
+    Fit cpu_;
+    int64_t samples_ = 0;
+    std::deque<double> wall_errors_;
+    std::deque<double> cpu_errors_;
+};
+CostModel cost_model;
+const std::string cost_model_path = "/app/uploads/cost_model.json";
+
+// Stall watchdog - recycles containers that stop delivering frames and callbacks
+InstrumentedMutex containers_mutex("containers");
+std::vector<std::shared_ptr<ContainerRun>> active_containers;
+std::vector<std::shared_ptr<ContainerRun>> scheduled_runs;  // Queued for or holding a pool slot
+std::vector<std::shared_ptr<ContainerRun>> submitted_runs;  // Every job from submit_job to its notify stage
+std::vector<std::pair<std::shared_ptr<ContainerRun>, std::thread>> abandoned_runs;  // Recycled, Run() not yet returned
+std::atomic<int64_t> containers_recycled{0};
+std::atomic<bool> engine_stopping{false};  // Service loops return once this is set
+
+// Drain on SIGTERM (see signal_loop)
+int64_t drain_timeout_s = 25;               // PRESAGE_DRAIN_TIMEOUT_S - for jobs in flight to finish
+std::atomic<bool> engine_draining{false};   // Listeners closed; jobs in flight finishing
+std::atomic<bool> engine_handed_off{false}; // Drain ran out; unfinished runs are checkpointed for the next engine
+
+// Shared executor (PRESAGE_EXECUTOR_THREADS) and the timers job coroutines
+// sleep on; built in main
+std::unique_ptr<Executor> executor;
+std::unique_ptr<TimerService> timers;
+
+// Container pool - caps how many SDK containers run at once across single
+// jobs and batches (PRESAGE_CONTAINER_POOL_SIZE). A job waiting for a slot is
+// a suspended coroutine, resumed on the executor when a slot is handed to it.
+class ContainerPool {
+public:
+    void resize(int slots) {
+        std::vector<std::coroutine_handle<>> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_ = std::max(1, slots);
+            hand_out(ready);
+        }
+        resume(ready);
+    }
+
+    // co_await container_pool.acquire() - holds a slot once it resumes
+    auto acquire() {
+        struct Awaiter {
+            ContainerPool& pool;
+            bool await_ready() { return false; }
+            bool await_suspend(std::coroutine_handle<> handle) {
+                std::lock_guard<std::mutex> lock(pool.mutex_);
+                if (pool.busy_ < pool.size_ && pool.waiters_.empty()) {
+                    pool.busy_++;
+                    pool.acquisitions_++;
+                    return false;
+                }
+                pool.waiters_.push_back(handle);
+                return true;
+            }
+            void await_resume() {}
+        };
+        return Awaiter{*this};
+    }
+
+    void release() {
+        std::vector<std::coroutine_handle<>> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            busy_--;
+            hand_out(ready);
+        }
+        resume(ready);
+    }
+
+    int size() { std::lock_guard<std::mutex> lock(mutex_); return size_; }
+    int64_t acquisitions() { std::lock_guard<std::mutex> lock(mutex_); return acquisitions_; }
+    int busy() { std::lock_guard<std::mutex> lock(mutex_); return busy_; }
+    int waiting() { std::lock_guard<std::mutex> lock(mutex_); return static_cast<int>(waiters_.size()); }
+
+private:
+    std::mutex mutex_;
+    int size_ = 4;
+    int busy_ = 0;
+    int64_t acquisitions_ = 0;
+    std::deque<std::coroutine_handle<>> waiters_;  // Oldest first
+
+    // Give free slots to waiters in arrival order (mutex_ held)
+    void hand_out(std::vector<std::coroutine_handle<>>& ready) {
+        while (busy_ < size_ && !waiters_.empty()) {
+            busy_++;
+            acquisitions_++;
+            ready.push_back(waiters_.front());
+            waiters_.pop_front();
+        }
+    }
+
+    static void resume(const std::vector<std::coroutine_handle<>>& ready) {
+        for (auto handle : ready) {
+            executor->submit([handle]() { handle.resume(); });
+        }
+    }
+};
+ContainerPool container_pool;
+
+// Camera frame ring - the last PRESAGE_CAMERA_RING_S seconds of camera frames,
+// JPEG-compressed, so POST /camera/analyze-recent can process footage that was
+// already captured. Fed by the engine's capture thread while the camera is idle
+// and by the SDK's video callback while a camera run owns the device.
+class FrameRing {
+public:
+    struct Frame {
+        int64_t timestamp_ms;  // Wall clock
+        std::shared_ptr<const std::vector<unsigned char>> jpeg;
+    };
+
+    void configure(int64_t seconds, size_t max_bytes, int quality) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        seconds_ = std::max<int64_t>(0, seconds);
+        max_bytes_ = max_bytes;
+        quality_ = std::clamp(quality, 10, 100);
+    }
+
+    bool enabled() const { return seconds_ > 0; }
+    int64_t capacity_seconds() const { return seconds_; }
+
+    void push(const cv::Mat& frame, int64_t timestamp_ms) {
+        // Encode outside the lock so readers never wait on the encoder
+        auto jpeg = std::make_shared<std::vector<unsigned char>>();
+        if (frame.empty() || !cv::imencode(".jpg", frame, *jpeg, {cv::IMWRITE_JPEG_QUALITY, quality_})) {
+            return;
+        }
+        push_jpeg(std::move(jpeg), timestamp_ms);
+    }
+
+    // A frame that is already JPEG (a camera's MJPG output), stored as is
+    void push_jpeg(std::shared_ptr<const std::vector<unsigned char>> jpeg, int64_t timestamp_ms) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bytes_ += jpeg->size();
+        frames_.push_back({timestamp_ms, std::move(jpeg)});
+        while (!frames_.empty() &&
+               (timestamp_ms - frames_.front().timestamp_ms > seconds_ * 1000 || bytes_ > max_bytes_)) {
+            bytes_ -= frames_.front().jpeg->size();
+            frames_.pop_front();
+        }
+    }
+
+    // Frames from the last `seconds`, oldest first (shares the encoded data)
+    std::vector<Frame> recent(int64_t seconds) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<Frame> result;
+        if (frames_.empty()) {
+            return result;
+        }
+        int64_t since = frames_.back().timestamp_ms - seconds * 1000;
+        auto first = std::lower_bound(frames_.begin(), frames_.end(), since,
+            [](const Frame& frame, int64_t ts) { return frame.timestamp_ms < ts; });
+        result.assign(first, frames_.end());
+        return result;
+    }
+
+    json stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        double buffered = frames_.size() < 2 ? 0.0 : (frames_.back().timestamp_ms - frames_.front().timestamp_ms) / 1000.0;
+        return {
+            {"enabled", seconds_ > 0},
+            {"capacity_seconds", seconds_},
+            {"max_bytes", max_bytes_},
+            {"frames", frames_.size()},
+            {"bytes", bytes_},
+            {"buffered_seconds", buffered}
+        };
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::deque<Frame> frames_;
+    size_t bytes_ = 0;
+    int64_t seconds_ = 0;
+    size_t max_bytes_ = 0;
+    int quality_ = 80;
+};
+FrameRing camera_ring;
+std::atomic<bool> camera_ring_paused{false};     // A camera run needs the device
+std::atomic<bool> camera_ring_capturing{false};  // The capture thread has the device open
+
+// The ring's own camera capture (see v4l2_capture.hpp), set up from
+// PRESAGE_CAMERA_* in main. Only camera_ring_loop opens and reads it.
+V4l2Options camera_capture_options;
+V4l2Capture camera_capture;
+std::mutex camera_capture_mutex;
+json camera_capture_info = json::object();  // Device, format and size while open
+
+// Capture settings and counters, for /status
+json camera_capture_status() {
+    json status;
+    {
+        std::lock_guard<std::mutex> lock(camera_capture_mutex);
+        status = camera_capture_info;
+    }
+    V4l2Stats stats = camera_capture.stats();
+    status["open"] = camera_ring_capturing.load();
+    status["frames"] = stats.frames;
+    status["dropped"] = stats.dropped;
+    status["errors"] = stats.errors;
+    status["latency_ms_avg"] = stats.frames > 0 ? stats.latency_us_sum / 1000.0 / stats.frames : 0.0;
+    status["latency_ms_max"] = stats.latency_us_max / 1000.0;
+    return status;
+}
+
+int64_t wall_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+int64_t stall_timeout_s = 60;  // PRESAGE_STALL_TIMEOUT_S
+
+int64_t steady_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Read an integer setting from the environment, falling back to a default
+int64_t env_int(const char* name, int64_t default_value) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return default_value;
+    }
+    try {
+        return std::stoll(value);
+    } catch (const std::exception&) {
+        std::cerr << "Warning: ignoring invalid " << name << "=" << value << std::endl;
+        return default_value;
+    }
+}
+
+// V4L2 device index of a /dev/videoN path (-1 if it isn't one)
+int camera_device_index(const std::string& device_path) {
+    const std::string prefix = "/dev/video";
+    if (device_path.compare(0, prefix.size(), prefix) != 0 || device_path.size() == prefix.size()) {
+        return -1;
+    }
+    std::string number = device_path.substr(prefix.size());
+    if (!std::all_of(number.begin(), number.end(), ::isdigit)) {
+        return -1;
+    }
+    return std::stoi(number);
+}
+
+// List V4L2 capture devices, including virtual ones (see virtual_camera.cpp)
+json list_camera_devices() {
+    json devices = json::array();
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator("/sys/class/video4linux", ec)) {
+        std::string node = entry.path().filename().string();
+        std::string name;
+        std::ifstream name_file(entry.path() / "name");
+        std::getline(name_file, name);
+        devices.push_back({
+            {"device", "/dev/" + node},
+            {"index", camera_device_index("/dev/" + node)},
+            {"name", name}
+        });
+    }
+    std::sort(devices.begin(), devices.end(), [](const json& a, const json& b) {
+        return a["index"].get<int>() < b["index"].get<int>();
+    });
+    return devices;
+}
+
+// Check if camera device exists
+bool check_camera_device(const std::string& device_path = camera_device_path) {
+    struct stat buffer;
+    if (stat(device_path.c_str(), &buffer) != 0) {
+        std::cerr << "Error: Camera device " << device_path << " not found!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Summary of the single-job readings behind /process-video
+json calculate_vitals_summary() {
+    std::lock_guard<InstrumentedMutex> lock(vitals_readings_mutex);
+    return calculate_vitals_summary(all_vitals_readings);
+}
+
+std::string session_dir(const std::string& session_id) {
+    return session_archive_dir + "/" + session_id;
+}
+
+// A process as /proc/<pid>/stat describes it. Its start time (clock ticks
+// since boot) tells a pid apart from an earlier process that had it, e.g. the
+// engine of the container's previous life.
+struct ProcessStat {
+    std::string comm;
+    char state = 0;
+    int64_t start_ticks = 0;
+};
+
+std::optional<ProcessStat> process_stat(const std::string& pid) {
+    std::ifstream file("/proc/" + pid + "/stat");
+    std::string stat;
+    std::getline(file, stat);
+    size_t open = stat.find('(');
+    size_t close = stat.rfind(')');
+    if (open == std::string::npos || close == std::string::npos || close + 2 >= stat.size()) {
+        return std::nullopt;
+    }
+    // "pid (comm) state ppid ..." - starttime is field 22, the 20th after comm
+    ProcessStat result;
+    result.comm = stat.substr(open + 1, close - open - 1);
+    std::istringstream fields(stat.substr(close + 2));
+    std::string field;
+    for (int i = 0; i < 20 && fields >> field; ++i) {
+        if (i == 0) {
+            result.state = field[0];
+        } else if (i == 19) {
+            result.start_ticks = std::atoll(field.c_str());
+        }
+    }
+    return result;
+}
+
+const int64_t engine_start_ticks = [] {
+    auto stat = process_stat("self");
+    return stat ? stat->start_ticks : int64_t{0};
+}();
+
+// Who a checkpoint belongs to: this engine, another engine that is still
+// running (and may still update it), or nobody - it outlived its engine
+enum class CheckpointOwner { Ours, LiveEngine, Gone };
+
+CheckpointOwner checkpoint_owner(const json& checkpoint) {
+    pid_t pid = static_cast<pid_t>(checkpoint.value("owner_pid", int64_t{0}));
+    int64_t started = checkpoint.value("owner_started", int64_t{0});
+    if (pid <= 0) {
+        return CheckpointOwner::Gone;
+    }
+    if (pid == getpid() && started == engine_start_ticks) {
+        return CheckpointOwner::Ours;
+    }
+    auto theirs = process_stat(std::to_string(pid));
+    auto ours = process_stat("self");
+    if (!theirs || !ours || theirs->state == 'Z' || theirs->comm != ours->comm ||
+        (started > 0 && theirs->start_ticks != started)) {
+        return CheckpointOwner::Gone;
+    }
+    return CheckpointOwner::LiveEngine;
+}
+
+// Persist a run's frame offset; its readings are already in the session's store
+void write_session_checkpoint(ContainerRun& run) {
+    int64_t frame_offset = run.frame_offset.load();
+    int64_t frame_timestamp = run.last_frame_timestamp.load();
+    if (run.resume && frame_timestamp == 0) {
+        // A resumed run with no frames yet is still at the checkpoint it came from
+        frame_offset = run.resume->checkpoint_frame;
+        frame_timestamp = run.resume->checkpoint_timestamp;
+    }
+    json checkpoint = {
+        {"session_id", run.session_id},
+        {"video_path", run.video_path},
+        {"settings", run.processing.to_json()},
+        {"frame_offset", frame_offset},
+        {"first_frame_timestamp", run.first_frame_timestamp.load()},
+        {"frame_timestamp", frame_timestamp},
+        {"updated_at", static_cast<int64_t>(std::time(nullptr))},
+        // Resumed only once this engine is gone (see resume_loop)
+        {"owner_pid", static_cast<int64_t>(getpid())},
+        {"owner_started", engine_start_ticks}
+    };
+    {
+        std::lock_guard<std::mutex> lock(run.readings_mutex);
+        checkpoint["readings_count"] = run.readings.size();
+    }
+    if (!write_json_file(session_dir(run.session_id) + "/checkpoint.json", checkpoint)) {
+        std::cerr << "Failed to write checkpoint for " << run.session_id << std::endl;
+    }
+}
+
+// Record the final result of a run and drop its checkpoint; details are merged into the summary
+void archive_session_result(const std::string& session_id, const std::string& video_path,
+                            const std::string& status, const std::string& error = "",
+                            const json& details = json::object()) {
+    json result = {
+        {"session_id", session_id},
+        {"status", status},
+        {"video_path", video_path},
+        {"completed_at", static_cast<int64_t>(std::time(nullptr))}
+    };
+    if (!details.contains("vitals")) {
+        result["vitals"] = calculate_vitals_summary();
+    }
+    if (!error.empty()) {
+        result["error"] = error;
+    }
+    result.update(details);
+    std::string dir = session_dir(session_id);
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (!write_json_file(dir + "/summary.json", result)) {
+        std::cerr << "Failed to write summary for " << session_id << std::endl;
+    }
+    std::filesystem::remove(dir + "/checkpoint.json", ec);
+}
+
+// What a run has cost so far. cpu_s is the best estimate of the whole cost:
+// the stages before the container plus its share of process CPU while the
+// container ran. thread_cpu_s counts only threads that worked for it alone.
+json usage_summary(ContainerRun& run) {
+    const SessionUsage& usage = run.usage;
+    double stage_cpu_s = usage.stage_cpu_ns.load() / 1e9;
+    double cpu_s = stage_cpu_s + usage.cpu_share_ns.load() / 1e9;
+    json summary = {
+        {"cpu_s", cpu_s},
+        {"thread_cpu_s", stage_cpu_s + usage.sdk_thread_cpu_ns.load() / 1e9},
+        {"cpu_share_s", usage.cpu_share_ns.load() / 1e9},
+        {"rss_share_bytes_peak", usage.rss_share_peak.load()},
+        {"memory_bytes_peak", usage.memory_peak.load()},
+        {"bytes_in", usage.bytes_in.load()},
+        {"bytes_out", session_egress.get(run.session_id)},
+        {"frames_decoded", usage.frames_decoded.load()},
+        {"frames_processed", run.frames.load()}
+    };
+    if (run.features && run.features->duration_s > 0) {
+        summary["cpu_s_per_video_s"] = cpu_s / run.features->duration_s;
+    }
+    return summary;
+}
+
+// Archive a run with the vitals from its own readings, and add its usage to the totals
+void archive_run_result(ContainerRun& run, const std::string& status, const std::string& error = "",
+                        const json& details = json::object()) {
+    json merged = details;
+    merged["usage"] = usage_summary(run);
+    const SessionUsage& usage = run.usage;
+    if (run.shadow_of.empty()) {
+        // Shadow runs are reported by ShadowEvaluation, not as served sessions
+        usage_totals.sessions++;
+        usage_totals.cpu_ns += usage.stage_cpu_ns.load() + usage.cpu_share_ns.load();
+        usage_totals.thread_cpu_ns += usage.stage_cpu_ns.load() + usage.sdk_thread_cpu_ns.load();
+        usage_totals.bytes_in += usage.bytes_in.load();
+        usage_totals.frames_decoded += usage.frames_decoded.load();
+        usage_totals.frames_processed += run.frames.load();
+        if (merged["usage"].contains("cpu_s_per_video_s")) {
+            usage_totals.cpu_per_video_second.observe(merged["usage"]["cpu_s_per_video_s"].get<double>());
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(run.readings_mutex);
+        merged["vitals"] = calculate_vitals_summary(run.readings);
+    }
+    if (!run.roi_crop.empty()) {
+        merged["roi_crop"] = run.roi_crop;
+    }
+    archive_session_result(run.session_id, run.video_path, status, error, merged);
+    run.archived = true;
+}
+
+// What the crop stage did to a video, for the session summary
+json roi_crop_summary(const RoiCropStats& stats) {
+    return {
+        {"applied", true},
+        {"source_size", {stats.source_size.width, stats.source_size.height}},
+        {"output_size", {stats.output_size.width, stats.output_size.height}},
+        {"pixel_ratio", stats.pixel_ratio()},
+        {"frames", stats.frames},
+        {"detections", stats.detections},
+        {"detections_missed", stats.detections_missed},
+        {"tracked_frames", stats.tracked_frames},
+        {"lost_frames", stats.lost_frames},
+        {"seconds", stats.seconds}
+    };
+}
+
+// Per-job REST integration latency statistics
+json integration_latency_summary(ContainerRun& run) {
+    std::vector<double> values;
+    {
+        std::lock_guard<std::mutex> lock(run.latency_mutex);
+        values = run.integration_latency_ms;
+    }
+    if (values.empty()) {
+        return {{"count", 0}};
+    }
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (double v : values) {
+        sum += v;
+    }
+    auto percentile = [&values](double p) {
+        return values[std::min(values.size() - 1, static_cast<size_t>(p * values.size()))];
+    };
+    return {
+        {"count", values.size()},
+        {"avg_ms", sum / values.size()},
+        {"p50_ms", percentile(0.50)},
+        {"p95_ms", percentile(0.95)},
+        {"max_ms", values.back()},
+        {"total_ms", sum}
+    };
+}
+
+// What a stalled container was last seen doing
+json stall_diagnostics(const ContainerRun& run) {
+    int64_t now = steady_now_ms();
+    auto seconds_since = [now](int64_t ms) -> json {
+        return ms > 0 ? json((now - ms) / 1000.0) : json(nullptr);
+    };
+    return {
+        {"reason", "No frames or SDK callbacks for " + std::to_string(stall_timeout_s) + "s"},
+        {"frames", run.frames.load()},
+        {"callbacks", run.callbacks.load()},
+        {"running_seconds", seconds_since(run.started_ms.load())},
+        {"seconds_since_last_frame", seconds_since(run.last_frame_ms.load())},
+        {"seconds_since_last_callback", seconds_since(run.last_callback_ms.load())}
+    };
+}
+
+// Share out the process CPU used since the last sample, and the current RSS,
+// among the running containers by the frames each processed meanwhile (evenly
+// if none did). Called by the watchdog with containers_mutex held.
+void sample_session_usage() {
+    constexpr int64_t reading_bytes = 400;  // One reading's json object, roughly
+    static int64_t last_cpu_ns = -1;
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    int64_t cpu_ns = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    int64_t cpu_delta = last_cpu_ns < 0 ? 0 : cpu_ns - last_cpu_ns;
+    last_cpu_ns = cpu_ns;
+
+    std::vector<std::shared_ptr<ContainerRun>> running;
+    for (const auto& run : active_containers) {
+        if (!run->finished.load() && !run->stalled.load()) {
+            running.push_back(run);
+        }
+    }
+    if (running.empty()) {
+        return;
+    }
+    int64_t rss = 0;
+    long pages = 0, resident = 0;
+    std::ifstream statm("/proc/self/statm");
+    if (statm >> pages >> resident) {
+        rss = static_cast<int64_t>(resident) * sysconf(_SC_PAGESIZE);
+    }
+    std::vector<int64_t> frames;
+    int64_t total_frames = 0;
+    for (const auto& run : running) {
+        int64_t now_frames = run->frames.load();
+        frames.push_back(now_frames - run->usage.frames_at_sample);
+        total_frames += frames.back();
+        run->usage.frames_at_sample = now_frames;
+    }
+    for (size_t i = 0; i < running.size(); ++i) {
+        ContainerRun& run = *running[i];
+        double weight = total_frames > 0 ? static_cast<double>(frames[i]) / total_frames : 1.0 / running.size();
+        run.usage.cpu_share_ns += static_cast<int64_t>(cpu_delta * weight);
+        run.usage.rss_share_peak = std::max(run.usage.rss_share_peak.load(), static_cast<int64_t>(rss * weight));
+        int64_t memory;
+        {
+            std::lock_guard<std::mutex> lock(run.readings_mutex);
+            memory = static_cast<int64_t>(run.readings.size()) * reading_bytes;
+        }
+        {
+            std::lock_guard<std::mutex> lock(run.latency_mutex);
+            memory += static_cast<int64_t>(run.frame_times.size() * sizeof(run.frame_times.front()) +
+                                           run.integration_latency_ms.size() * sizeof(double));
+        }
+        run.usage.memory_peak = std::max(run.usage.memory_peak.load(), memory);
+    }
+}
+
+// Mark containers stalled once they go quiet for stall_timeout_s; the job
+// waiting on a stalled container then abandons it and fails (see run_container).
+// Abandoned SDK threads are joined here if their Run() ever returns. Each
+// tick also samples the running sessions' usage.
+void watchdog_loop() {
+    while (!engine_stopping.load()) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        int64_t now = steady_now_ms();
+        std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+        for (auto it = abandoned_runs.begin(); it != abandoned_runs.end();) {
+            if (it->first->finished.load()) {
+                it->second.join();
+                it = abandoned_runs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (const auto& run : active_containers) {
+            if (run->finished.load() || run->stalled.load()) {
+                continue;
+            }
+            int64_t last_activity = std::max({run->started_ms.load(), run->last_frame_ms.load(), run->last_callback_ms.load()});
+            if (now - last_activity > stall_timeout_s * 1000) {
+                std::cerr << "Watchdog: container for " << run->session_id << " stalled after "
+                          << run->frames.load() << " frames and " << run->callbacks.load()
+                          << " callbacks - recycling" << std::endl;
+                run->stalled = true;
+                run->ended.set();
+            }
+        }
+        sample_session_usage();
+    }
+}
+
+// Name the calling thread so profiles and /proc show what it is (15 chars max)
+void set_thread_name(const char* name) {
+    pthread_setname_np(pthread_self(), name);
+}
+
+// Give the calling thread only CPU time no other thread wants (SCHED_IDLE).
+// Without CAP_SYS_NICE there is no way back, so only for threads that end
+// with the work (shadow runs)
+bool set_thread_idle_priority() {
+    sched_param param{};
+    return pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) == 0;
+}
+
+// Sampling profiler behind GET /debug/profile. A process CPU-time timer
+// (ITIMER_PROF) delivers SIGPROF to whichever thread is burning CPU; the
+// handler stores that thread's id and raw stack into a preallocated buffer.
+// Symbolisation and folding happen after the timer is disarmed, so the cost
+// while profiling is one backtrace() per sample.
+struct ProfileSample {
+    static constexpr int max_depth = 48;
+    pid_t tid;
+    int depth;
+    void* frames[max_depth];
+};
+
+std::atomic<bool> profiler_busy{false};
+std::atomic<ProfileSample*> profile_samples{nullptr};
+std::atomic<size_t> profile_next{0};
+std::atomic<size_t> profile_dropped{0};
+size_t profile_capacity = 0;
+
+void profiler_signal_handler(int) {
+    int saved_errno = errno;
+    ProfileSample* samples = profile_samples.load(std::memory_order_acquire);
+    if (samples) {
+        size_t index = profile_next.fetch_add(1, std::memory_order_relaxed);
+        if (index < profile_capacity) {
+            ProfileSample& sample = samples[index];
+            sample.tid = static_cast<pid_t>(syscall(SYS_gettid));
+            sample.depth = backtrace(sample.frames, ProfileSample::max_depth);
+        } else {
+            profile_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    errno = saved_errno;
+}
+
+std::string symbolize_frame(void* address) {
+    Dl_info info;
+    // Return addresses point after the call; step back into the calling instruction
+    void* lookup = static_cast<char*>(address) - 1;
+    if (dladdr(lookup, &info) && info.dli_sname) {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = (status == 0 && demangled) ? demangled : info.dli_sname;
+        std::free(demangled);
+        std::replace(name.begin(), name.end(), ';', ':');
+        return name;
+    }
+    if (dladdr(lookup, &info) && info.dli_fname) {
+        std::string module = info.dli_fname;
+        module = module.substr(module.rfind('/') + 1);
+        char offset[32];
+        snprintf(offset, sizeof(offset), "+0x%lx",
+                 static_cast<unsigned long>(static_cast<char*>(lookup) - static_cast<char*>(info.dli_fbase)));
+        return module + offset;
+    }
+    return "[unknown]";
+}
+
+std::string thread_name(pid_t tid) {
+    std::ifstream comm("/proc/self/task/" + std::to_string(tid) + "/comm");
+    std::string name;
+    std::getline(comm, name);
+    return name.empty() ? "tid-" + std::to_string(tid) : name;
+}
+
+// Sample all threads for the given duration and return folded stacks
+// ("thread;outer;...;inner count"), the input format of flamegraph.pl
+std::string run_profile(int seconds, int hz, size_t& sample_count, size_t& dropped) {
+    profile_capacity = static_cast<size_t>(seconds) * hz * std::max(1u, std::thread::hardware_concurrency());
+    std::vector<ProfileSample> samples(profile_capacity);
+    profile_next = 0;
+    profile_dropped = 0;
+
+    // backtrace() loads libgcc on first use, which is not signal safe - do it here
+    void* warmup[4];
+    backtrace(warmup, 4);
+
+    struct sigaction action{};
+    struct sigaction previous{};
+    action.sa_handler = profiler_signal_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &previous);
+    profile_samples.store(samples.data(), std::memory_order_release);
+
+    itimerval timer{};
+    timer.it_interval.tv_usec = 1000000 / hz;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    itimerval disarm{};
+    setitimer(ITIMER_PROF, &disarm, nullptr);
+
+    // Let handlers already in flight finish before reading the buffer
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    profile_samples.store(nullptr, std::memory_order_release);
+    sigaction(SIGPROF, &previous, nullptr);
+
+    sample_count = std::min(profile_next.load(), profile_capacity);
+    dropped = profile_dropped.load();
+
+    std::map<pid_t, std::string> thread_names;
+    std::map<void*, std::string> symbols;
+    std::map<std::string, int64_t> folded;
+    for (size_t i = 0; i < sample_count; ++i) {
+        const ProfileSample& sample = samples[i];
+        auto name = thread_names.find(sample.tid);
+        if (name == thread_names.end()) {
+            name = thread_names.emplace(sample.tid, thread_name(sample.tid)).first;
+        }
+        std::string stack = name->second;
+        // Skip the signal handler and the kernel's signal trampoline
+        for (int f = sample.depth - 1; f >= 2; --f) {
+            auto symbol = symbols.find(sample.frames[f]);
+            if (symbol == symbols.end()) {
+                symbol = symbols.emplace(sample.frames[f], symbolize_frame(sample.frames[f])).first;
+            }
+            stack += ";" + symbol->second;
+        }
+        folded[stack]++;
+    }
+
+    std::string out;
+    for (const auto& [stack, count] : folded) {
+        out += stack + " " + std::to_string(count) + "\n";
+    }
+    return out;
+}
+
+// Streaming listener - an epoll event loop for long-lived connections (SSE
+// subscribers and long-polls), so they cost a few hundred bytes each instead
+// of an httplib worker thread. httplib keeps the request/response routes.
+//
+//   GET /live/stream               Server-sent events, one per SDK reading
+//   GET /live/poll?after=N&timeout=S
+//                                  Next reading after sequence N, or 204 on timeout
+//   GET /live/metrics              Raw SDK MetricsBuffer messages, length-prefixed
+//                                  (opt-in, PRESAGE_METRICS_STREAM=1)
+//   GET /ward/stream?sessions=a,b&rate=R
+//                                  Server-sent events with the newest reading of
+//                                  each chosen session, at most R per second
+//   GET /artifacts/sessions/{id}/{file}
+//   GET /artifacts/uploads/{file}  Stored files, with Range support (HEAD too)
+//
+// Messages are serialised once by the publisher and shared by every subscriber.
+// Ward subscribers asking for the same sessions at the same rate share a view,
+// which serialises one event per tick for all of them.
+// Files go from the page cache to the socket with sendfile, so a download
+// holds a descriptor and an offset, never the file's contents.
+class StreamServer {
+public:
+    // Bind the listening socket and start the event loop thread
+    bool start(int port) {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) {
+            return false;
+        }
+        int one = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        // The next engine binds alongside this one during a handoff
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            listen(listen_fd_, SOMAXCONN) != 0) {
+            close(listen_fd_);
+            listen_fd_ = -1;
+            return false;
+        }
+
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = listen_fd_;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &event);
+        event.data.fd = wake_fd_;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+
+        loop_thread_ = std::thread([this]() {
+            set_thread_name("stream-loop");
+            run();
+        });
+        return true;
+    }
+
+    // Close the listening socket; open connections are still served (drain)
+    void stop_accepting() {
+        accepting_ = false;
+        wake();
+    }
+
+    // Flush what subscribers were sent, close every connection and join the
+    // event loop thread
+    void stop() {
+        if (!loop_thread_.joinable()) {
+            return;
+        }
+        stopping_ = true;
+        wake();
+        loop_thread_.join();
+        std::vector<int> fds;
+        for (const auto& [fd, conn] : connections_) {
+            fds.push_back(fd);
+        }
+        for (int fd : fds) {
+            close_connection(fd);
+        }
+        if (listen_fd_ >= 0) {
+            close(listen_fd_);
+            listen_fd_ = -1;
+        }
+    }
+
+    // Queue a message for every subscriber of a topic (any thread)
+    void publish(const std::string& topic, std::string payload) {
+        enqueue(Pending{topic, std::move(payload), false});
+    }
+
+    // Queue an already framed binary message, sent to subscribers as is
+    void publish_binary(const std::string& topic, std::string frame) {
+        enqueue(Pending{topic, std::move(frame), true});
+    }
+
+    // Record a session's newest reading for /ward/stream (any thread)
+    void publish_reading(const std::string& session_id, const ReadingRow& row) {
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            pending_readings_.emplace_back(session_id, row);
+        }
+        wake();
+    }
+
+    // Serve /live/metrics; call before start()
+    void enable_metrics_stream() { metrics_stream_enabled_ = true; }
+    bool metrics_stream_enabled() const { return metrics_stream_enabled_; }
+
+    size_t subscriber_count() const { return subscribers_.load(); }
+    size_t metrics_subscriber_count() const { return metrics_subscribers_.load(); }
+    size_t connection_count() const { return connections_count_.load(); }
+    // User-space bytes held for open connections (structs and buffers; not kernel socket buffers)
+    size_t connection_bytes() const { return connection_bytes_.load(); }
+    int64_t messages_sent() const { return messages_sent_.load(); }
+    int64_t slow_disconnects() const { return slow_disconnects_.load(); }
+    size_t active_downloads() const { return downloads_active_.load(); }
+    int64_t downloads() const { return downloads_.load(); }
+    int64_t download_bytes() const { return download_bytes_.load(); }
+    size_t ward_view_count() const { return ward_view_count_.load(); }
+    size_t ward_subscriber_count() const { return ward_subscribers_.load(); }
+    int64_t ward_events() const { return ward_events_.load(); }
+
+private:
+    enum class Kind { Request, Subscriber, LongPoll, Closing };
+
+    struct Connection {
+        int fd = -1;
+        Kind kind = Kind::Request;
+        std::string topic;
+        std::string in;
+        std::string out;
+        size_t out_offset = 0;
+        bool want_write = false;
+        uint64_t poll_after = 0;
+        int64_t deadline_ms = 0;
+        int file_fd = -1;  // Artifact being sent once `out` (the headers) drains
+        off_t file_offset = 0;
+        off_t file_end = 0;
+        std::string file_session;  // Session the artifact belongs to, for its usage
+        std::string ward_key;      // The ward view this subscriber belongs to
+        bool read_closed = false;  // The client half-closed; only writing is left
+    };
+
+    struct Topic {
+        uint64_t seq = 0;
+        std::string last_json;  // Latest message, for long-polls that arrive after it
+    };
+
+    struct Pending {
+        std::string topic;
+        std::string payload;
+        bool binary = false;
+    };
+
+    struct WardReading {
+        ReadingRow row;
+        uint64_t version = 0;  // ward_version_ when it arrived
+        int64_t updated_ms = 0;
+    };
+
+    // Subscribers sharing a session list and rate
+    struct WardView {
+        std::vector<std::string> sessions;  // Empty: every session
+        int64_t interval_ms = 1000;
+        int64_t next_tick_ms = 0;
+        uint64_t sent_version = 0;          // Readings up to this version are out
+        std::vector<int> fds;
+    };
+
+    static constexpr size_t max_request_bytes = 8192;
+    static constexpr size_t max_buffered_bytes = 1 << 20;  // Slow subscribers past this are dropped
+    static constexpr int64_t keepalive_interval_ms = 15000;
+    static constexpr size_t sendfile_turn_bytes = 1 << 20;  // Per download per loop turn, so none holds the loop
+    static constexpr size_t max_ward_sessions = 256;
+    static constexpr int64_t ward_forget_ms = 600000;  // Sessions silent this long drop out of ward views
+    static constexpr int64_t stop_flush_ms = 2000;     // How long stop() waits for slow sockets to take their data
+
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+    std::thread loop_thread_;
+    std::atomic<bool> stopping_{false};
+    std::atomic<bool> accepting_{true};
+    bool metrics_stream_enabled_ = false;
+    std::mutex pending_mutex_;
+    std::vector<Pending> pending_;
+    std::vector<std::pair<std::string, ReadingRow>> pending_readings_;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+    std::map<std::string, Topic> topics_;
+    int64_t last_keepalive_ms_ = 0;
+    std::unordered_map<std::string, WardReading> ward_latest_;
+    uint64_t ward_version_ = 0;
+    std::map<std::string, WardView> ward_views_;  // By rate and session list
+
+    std::atomic<size_t> subscribers_{0};
+    std::atomic<size_t> metrics_subscribers_{0};
+    std::atomic<size_t> connections_count_{0};
+    std::atomic<size_t> connection_bytes_{0};
+    std::atomic<int64_t> messages_sent_{0};
+    std::atomic<int64_t> slow_disconnects_{0};
+    std::atomic<size_t> downloads_active_{0};
+    std::atomic<int64_t> downloads_{0};
+    std::atomic<int64_t> download_bytes_{0};
+    std::atomic<size_t> ward_view_count_{0};
+    std::atomic<size_t> ward_subscribers_{0};
+    std::atomic<int64_t> ward_events_{0};
+
+    void enqueue(Pending message) {
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            pending_.push_back(std::move(message));
+        }
+        wake();
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_fd_, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    void run() {
+        std::vector<epoll_event> events(1024);
+        while (!stopping_.load()) {
+            if (!accepting_.load() && listen_fd_ >= 0) {
+                epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, listen_fd_, nullptr);
+                close(listen_fd_);
+                listen_fd_ = -1;
+            }
+            // Wake for the next ward tick too
+            int64_t timeout_ms = 1000;
+            int64_t now = steady_now_ms();
+            for (const auto& [key, view] : ward_views_) {
+                timeout_ms = std::min(timeout_ms, std::max<int64_t>(0, view.next_tick_ms - now));
+            }
+            int ready = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), static_cast<int>(timeout_ms));
+            for (int i = 0; i < ready; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == listen_fd_) {
+                    accept_connections();
+                } else if (fd == wake_fd_) {
+                    uint64_t count;
+                    ssize_t ignored = read(wake_fd_, &count, sizeof(count));
+                    (void)ignored;
+                    deliver_pending();
+                } else {
+                    handle_event(fd, events[i].events);
+                }
+            }
+            expire_timers();
+            tick_ward_views();
+            update_stats();
+        }
+
+        // Deliver what was published before stop(), and give slow sockets a moment to take it
+        deliver_pending();
+        int64_t deadline = steady_now_ms() + stop_flush_ms;
+        auto unsent = [this]() {
+            return std::any_of(connections_.begin(), connections_.end(),
+                               [](const auto& entry) { return entry.second->out_offset < entry.second->out.size(); });
+        };
+        while (unsent() && steady_now_ms() < deadline) {
+            int ready = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), 100);
+            for (int i = 0; i < ready; ++i) {
+                int fd = events[i].data.fd;
+                if (fd != listen_fd_ && fd != wake_fd_) {
+                    handle_event(fd, events[i].events);
+                }
+            }
+        }
+    }
+
+    void accept_connections() {
+        while (true) {
+            int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EMFILE || errno == ENFILE) {
+                    std::cerr << "Stream listener out of file descriptors" << std::endl;
+                }
+                return;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            auto conn = std::make_unique<Connection>();
+            conn->fd = fd;
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.fd = fd;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+            connections_[fd] = std::move(conn);
+        }
+    }
+
+    void handle_event(int fd, uint32_t events) {
+        auto it = connections_.find(fd);
+        if (it == connections_.end()) {
+            return;
+        }
+        Connection& conn = *it->second;
+        // route(), respond() and flush() close the connection once a response is
+        // written, which destroys conn; no fd is accepted meanwhile, so this is safe
+        auto open = [this, fd]() { return connections_.count(fd) > 0; };
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            close_connection(fd);
+            return;
+        }
+        if (events & (EPOLLIN | EPOLLRDHUP)) {
+            char buffer[4096];
+            while (true) {
+                ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+                if (n > 0) {
+                    // Subscribers have nothing more to say; ignore anything they send
+                    if (conn.kind == Kind::Request) {
+                        conn.in.append(buffer, static_cast<size_t>(n));
+                    }
+                    continue;
+                }
+                if (n == 0) {
+                    // A subscriber that hangs up is gone. A client may half-close
+                    // right after its request, though, so that still gets answered.
+                    if (conn.kind == Kind::Subscriber) {
+                        close_connection(fd);
+                        return;
+                    }
+                    conn.read_closed = true;
+                    break;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    close_connection(fd);
+                    return;
+                }
+                if (errno != EINTR) {
+                    break;
+                }
+            }
+            if (conn.kind == Kind::Request) {
+                if (conn.in.find("\r\n\r\n") != std::string::npos) {
+                    route(conn);
+                } else if (conn.in.size() > max_request_bytes) {
+                    respond(conn, "431 Request Header Fields Too Large", "text/plain", "");
+                } else if (conn.read_closed) {
+                    // The request can never complete
+                    close_connection(fd);
+                    return;
+                }
+            }
+            if (!open()) {
+                return;
+            }
+            if (conn.read_closed) {
+                // Stop polling for input, or the EOF would wake the loop on every turn
+                update_interest(conn);
+            }
+        }
+        if ((events & EPOLLOUT) && open()) {
+            flush(conn);
+        }
+    }
+
+    static std::string query_param(const std::string& target, const std::string& name) {
+        size_t query = target.find('?');
+        if (query == std::string::npos) {
+            return "";
+        }
+        std::string key = name + "=";
+        size_t pos = query;
+        while (pos != std::string::npos) {
+            ++pos;
+            if (target.compare(pos, key.size(), key) == 0) {
+                size_t end = target.find('&', pos);
+                return target.substr(pos + key.size(), end == std::string::npos ? std::string::npos : end - pos - key.size());
+            }
+            pos = target.find('&', pos);
+        }
+        return "";
+    }
+
+    // Value of a request header (case-insensitive name), or "" if absent
+    static std::string header_value(const std::string& request, const std::string& name) {
+        size_t line = request.find("\r\n");
+        size_t end = request.find("\r\n\r\n");
+        while (line != std::string::npos && line < end) {
+            line += 2;
+            size_t colon = request.find(':', line);
+            size_t next = request.find("\r\n", line);
+            if (colon != std::string::npos && colon < next && colon - line == name.size() &&
+                std::equal(name.begin(), name.end(), request.begin() + static_cast<std::ptrdiff_t>(line),
+                           [](char a, char b) { return std::tolower(a) == std::tolower(b); })) {
+                size_t value = request.find_first_not_of(' ', colon + 1);
+                return request.substr(value, next - value);
+            }
+            line = next;
+        }
+        return "";
+    }
+
+    // Map /artifacts/... onto a file under the archive or the uploads directory.
+    // Names are single path components, so nothing outside those two is reachable.
+    static std::string artifact_path(const std::string& path) {
+        auto valid = [](const std::string& name) {
+            return !name.empty() && name[0] != '.' &&
+                   std::all_of(name.begin(), name.end(), [](char c) {
+                       return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '.';
+                   });
+        };
+        std::vector<std::string> parts;
+        size_t pos = std::string("/artifacts/").size();
+        while (pos <= path.size()) {
+            size_t slash = path.find('/', pos);
+            parts.push_back(path.substr(pos, slash == std::string::npos ? std::string::npos : slash - pos));
+            if (slash == std::string::npos) {
+                break;
+            }
+            pos = slash + 1;
+        }
+        if (!std::all_of(parts.begin() + 1, parts.end(), valid)) {
+            return "";
+        }
+        if (parts.size() == 3 && parts[0] == "sessions") {
+            return session_archive_dir + "/" + parts[1] + "/" + parts[2];
+        }
+        if (parts.size() == 2 && parts[0] == "uploads") {
+            return "/app/uploads/" + parts[1];
+        }
+        return "";
+    }
+
+    static std::string artifact_content_type(const std::string& file) {
+        std::string extension = std::filesystem::path(file).extension().string();
+        if (extension == ".mp4") return "video/mp4";
+        if (extension == ".avi") return "video/x-msvideo";
+        if (extension == ".json") return "application/json";
+        if (extension == ".jpg" || extension == ".jpeg") return "image/jpeg";
+        if (extension == ".png") return "image/png";
+        if (extension == ".csv") return "text/csv";
+        return "application/octet-stream";
+    }
+
+    // Parse a single "bytes=" range against the file size. Multiple ranges and
+    // invalid ones are answered with the whole file, as RFC 9110 allows; only a
+    // valid range that starts past the end gets a 416.
+    static bool parse_range(const std::string& header, off_t size, off_t& first, off_t& last) {
+        if (header.compare(0, 6, "bytes=") != 0 || header.find(',') != std::string::npos) {
+            return false;
+        }
+        std::string spec = header.substr(6);
+        size_t dash = spec.find('-');
+        if (dash == std::string::npos) {
+            return false;
+        }
+        // Parse into locals: first and last must stay untouched when the range is ignored
+        off_t from = 0;
+        off_t to = 0;
+        try {
+            if (dash == 0) {
+                // Suffix: the last N bytes
+                off_t suffix = static_cast<off_t>(std::stoll(spec.substr(1)));
+                if (suffix < 0) {
+                    return false;
+                }
+                from = std::max<off_t>(0, size - suffix);
+                to = size - 1;
+            } else {
+                from = static_cast<off_t>(std::stoll(spec.substr(0, dash)));
+                to = dash + 1 < spec.size() ? static_cast<off_t>(std::stoll(spec.substr(dash + 1))) : size - 1;
+                if (from < 0 || to < from) {
+                    return false;  // Invalid, not unsatisfiable: ignored, so the whole file is sent
+                }
+                to = std::min<off_t>(to, size - 1);
+            }
+        } catch (const std::exception&) {
+            return false;
+        }
+        first = from;
+        last = to;
+        return true;
+    }
+
+    void serve_artifact(Connection& conn, const std::string& target, const std::string& range, bool head) {
+        std::string file = artifact_path(target.substr(0, target.find('?')));
+        int file_fd = file.empty() ? -1 : open(file.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        struct stat info{};
+        if (file_fd < 0 || fstat(file_fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            if (file_fd >= 0) {
+                close(file_fd);
+            }
+            respond(conn, "404 Not Found", "text/plain", "");
+            return;
+        }
+
+        off_t size = info.st_size;
+        off_t first = 0;
+        off_t last = size - 1;
+        std::string status = "200 OK";
+        std::string content_range;
+        if (!range.empty() && parse_range(range, size, first, last)) {
+            if (first >= size) {
+                close(file_fd);
+                conn.kind = Kind::Closing;
+                queue(conn, "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                            "Content-Range: bytes */" + std::to_string(size) + "\r\n"
+                            "Content-Length: 0\r\n"
+                            "Access-Control-Allow-Origin: *\r\n"
+                            "Connection: close\r\n\r\n");
+                return;
+            }
+            status = "206 Partial Content";
+            content_range = "Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" +
+                            std::to_string(size) + "\r\n";
+        }
+
+        conn.kind = Kind::Closing;
+        if (!head && last >= first) {
+            conn.file_fd = file_fd;
+            conn.file_offset = first;
+            conn.file_end = last + 1;
+            const std::string sessions_prefix = "/artifacts/sessions/";
+            if (target.compare(0, sessions_prefix.size(), sessions_prefix) == 0) {
+                size_t end = target.find('/', sessions_prefix.size());
+                conn.file_session = target.substr(sessions_prefix.size(), end - sessions_prefix.size());
+            }
+            downloads_active_++;
+            downloads_++;
+        } else {
+            close(file_fd);
+        }
+        queue(conn, "HTTP/1.1 " + status + "\r\n"
+                    "Content-Type: " + artifact_content_type(file) + "\r\n"
+                    "Content-Length: " + std::to_string(last + 1 - first) + "\r\n" + content_range +
+                    "Accept-Ranges: bytes\r\n"
+                    "Last-Modified: " + http_date(info.st_mtime) + "\r\n"
+                    "Access-Control-Allow-Origin: *\r\n"
+                    "Access-Control-Expose-Headers: Content-Range, Content-Length, Accept-Ranges\r\n"
+                    "Connection: close\r\n\r\n");
+    }
+
+    static std::string http_date(time_t t) {
+        char buffer[64];
+        std::tm tm{};
+        gmtime_r(&t, &tm);
+        strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        return buffer;
+    }
+
+    void route(Connection& conn) {
+        char method[16] = {0};
+        char target_buf[2048] = {0};
+        if (sscanf(conn.in.c_str(), "%15s %2047s", method, target_buf) != 2) {
+            respond(conn, "400 Bad Request", "text/plain", "");
+            return;
+        }
+        std::string target = target_buf;
+        std::string path = target.substr(0, target.find('?'));
+        std::string range = header_value(conn.in, "Range");
+        conn.in.clear();
+        conn.in.shrink_to_fit();
+
+        if (std::string(method) == "OPTIONS") {
+            respond(conn, "200 OK", "text/plain", "");
+        } else if ((std::string(method) == "GET" || std::string(method) == "HEAD") &&
+                   path.compare(0, 11, "/artifacts/") == 0) {
+            serve_artifact(conn, path, range, std::string(method) == "HEAD");
+        } else if (std::string(method) != "GET") {
+            respond(conn, "405 Method Not Allowed", "text/plain", "");
+        } else if (path == "/live/stream") {
+            conn.kind = Kind::Subscriber;
+            conn.topic = "live";
+            subscribers_++;
+            queue(conn, "HTTP/1.1 200 OK\r\n"
+                        "Content-Type: text/event-stream\r\n"
+                        "Cache-Control: no-cache\r\n"
+                        "Connection: keep-alive\r\n"
+                        "Access-Control-Allow-Origin: *\r\n\r\n"
+                        ": connected\n\n");
+        } else if (path == "/live/metrics" && metrics_stream_enabled_) {
+            // No Content-Length: the body is a stream of frames until either side closes
+            conn.kind = Kind::Subscriber;
+            conn.topic = "metrics";
+            subscribers_++;
+            metrics_subscribers_++;
+            queue(conn, "HTTP/1.1 200 OK\r\n"
+                        "Content-Type: application/x-presage-metrics\r\n"
+                        "Cache-Control: no-cache\r\n"
+                        "Connection: close\r\n"
+                        "Access-Control-Allow-Origin: *\r\n\r\n");
+        } else if (path == "/ward/stream") {
+            subscribe_ward(conn, target);
+        } else if (path == "/live/poll") {
+            uint64_t after = 0;
+            int64_t timeout_s = 30;
+            try {
+                std::string value = query_param(target, "after");
+                if (!value.empty()) {
+                    after = std::stoull(value);
+                }
+                value = query_param(target, "timeout");
+                if (!value.empty()) {
+                    timeout_s = std::clamp<int64_t>(std::stoll(value), 0, 300);
+                }
+            } catch (const std::exception&) {
+                respond(conn, "400 Bad Request", "text/plain", "");
+                return;
+            }
+            Topic& topic = topics_["live"];
+            if (topic.seq > after) {
+                respond(conn, "200 OK", "application/json", topic.last_json);
+                return;
+            }
+            conn.kind = Kind::LongPoll;
+            conn.topic = "live";
+            conn.poll_after = after;
+            conn.deadline_ms = steady_now_ms() + timeout_s * 1000;
+        } else {
+            respond(conn, "404 Not Found", "text/plain", "");
+        }
+    }
+
+    // GET /ward/stream?sessions=a,b,c&rate=R - newest reading per session, R events/s at most
+    void subscribe_ward(Connection& conn, const std::string& target) {
+        std::string list = query_param(target, "sessions");
+        for (size_t at; (at = list.find("%2C")) != std::string::npos || (at = list.find("%2c")) != std::string::npos;) {
+            list.replace(at, 3, ",");
+        }
+        double rate = 1.0;
+        try {
+            std::string value = query_param(target, "rate");
+            if (!value.empty()) {
+                rate = std::stod(value);
+            }
+        } catch (const std::exception&) {
+            rate = 0;
+        }
+        if (!(rate >= 0.1 && rate <= 10)) {
+            respond(conn, "400 Bad Request", "text/plain", "rate must be between 0.1 and 10\n");
+            return;
+        }
+
+        std::vector<std::string> sessions;
+        if (list != "*") {
+            std::stringstream stream(list);
+            for (std::string id; std::getline(stream, id, ',');) {
+                bool valid = !id.empty() && std::all_of(id.begin(), id.end(), [](unsigned char c) {
+                    return std::isalnum(c) || c == '_';
+                });
+                if (!valid) {
+                    respond(conn, "400 Bad Request", "text/plain", "invalid session id\n");
+                    return;
+                }
+                sessions.push_back(id);
+            }
+            std::sort(sessions.begin(), sessions.end());
+            sessions.erase(std::unique(sessions.begin(), sessions.end()), sessions.end());
+            if (sessions.size() > max_ward_sessions) {
+                respond(conn, "400 Bad Request", "text/plain", "too many sessions\n");
+                return;
+            }
+        }
+
+        // Subscribers with the same list and rate share one view
+        int64_t interval_ms = std::max<int64_t>(100, static_cast<int64_t>(std::lround(1000.0 / rate)));
+        std::string key = std::to_string(interval_ms) + ":";
+        for (const auto& id : sessions) {
+            key += id + ",";
+        }
+        auto [it, created] = ward_views_.try_emplace(key);
+        WardView& view = it->second;
+        if (created) {
+            view.sessions = std::move(sessions);
+            view.interval_ms = interval_ms;
+            view.next_tick_ms = steady_now_ms() + interval_ms;
+            view.sent_version = ward_version_;
+        }
+        view.fds.push_back(conn.fd);
+
+        conn.kind = Kind::Subscriber;
+        conn.topic = "ward";
+        conn.ward_key = key;
+        subscribers_++;
+        ward_subscribers_++;
+        ward_view_count_ = ward_views_.size();
+        // Start from everything known so far; later events carry only what changed
+        queue(conn, "HTTP/1.1 200 OK\r\n"
+                    "Content-Type: text/event-stream\r\n"
+                    "Cache-Control: no-cache\r\n"
+                    "Connection: keep-alive\r\n"
+                    "Access-Control-Allow-Origin: *\r\n\r\n" +
+                    ward_event(view, 0));
+    }
+
+    // One event with each of the view's sessions that has a reading newer than
+    // `after`: {"t":wall_ms,"r":{"id":[timestamp,hr,br],...}}, null for a
+    // channel the SDK did not report. Empty if nothing changed.
+    std::string ward_event(const WardView& view, uint64_t after) const {
+        std::string readings;
+        auto add = [&](const std::string& id, const WardReading& latest) {
+            if (latest.version <= after) {
+                return;
+            }
+            auto number = [](float value) {
+                if (std::isnan(value)) {
+                    return std::string("null");
+                }
+                char buffer[32];
+                snprintf(buffer, sizeof(buffer), "%.2f", value);
+                return std::string(buffer);
+            };
+            readings += (readings.empty() ? "\"" : ",\"") + id + "\":[" + std::to_string(latest.row.timestamp) + "," +
+                        number(latest.row.heart_rate) + "," + number(latest.row.breathing_rate) + "]";
+        };
+        if (view.sessions.empty()) {
+            for (const auto& [id, latest] : ward_latest_) {
+                add(id, latest);
+            }
+        } else {
+            for (const auto& id : view.sessions) {
+                auto it = ward_latest_.find(id);
+                if (it != ward_latest_.end()) {
+                    add(id, it->second);
+                }
+            }
+        }
+        if (readings.empty() && after > 0) {
+            return "";
+        }
+        return "data: {\"t\":" + std::to_string(wall_now_ms()) + ",\"r\":{" + readings + "}}\n\n";
+    }
+
+    // Send each due view's changes, serialised once for all its subscribers
+    void tick_ward_views() {
+        int64_t now = steady_now_ms();
+        // Delivered after the loop: a failed or slow subscriber is closed by
+        // queue(), which can erase its fd from view.fds and the view itself
+        std::vector<std::pair<std::string, std::vector<int>>> deliveries;
+        for (auto& [key, view] : ward_views_) {
+            if (now < view.next_tick_ms) {
+                continue;
+            }
+            // Keep the cadence, but don't burst to catch up after a stall
+            view.next_tick_ms = std::max(view.next_tick_ms + view.interval_ms, now + 1);
+            if (view.sent_version == ward_version_) {
+                continue;
+            }
+            std::string event = ward_event(view, view.sent_version);
+            view.sent_version = ward_version_;
+            if (event.empty()) {
+                continue;
+            }
+            ward_events_++;
+            deliveries.emplace_back(std::move(event), view.fds);
+        }
+        for (const auto& [event, fds] : deliveries) {
+            for (int fd : fds) {
+                auto it = connections_.find(fd);
+                if (it != connections_.end()) {
+                    queue(*it->second, event);
+                    messages_sent_++;
+                }
+            }
+        }
+    }
+
+    // Send a complete response and close once it's written
+    void respond(Connection& conn, const std::string& status, const std::string& content_type, const std::string& body) {
+        conn.kind = Kind::Closing;
+        queue(conn, "HTTP/1.1 " + status + "\r\n"
+                    "Content-Type: " + content_type + "\r\n"
+                    "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                    "Access-Control-Allow-Origin: *\r\n"
+                    "Access-Control-Allow-Methods: GET, HEAD, OPTIONS\r\n"
+                    "Connection: close\r\n\r\n" + body);
+    }
+
+    void queue(Connection& conn, const std::string& data) {
+        conn.out.append(data);
+        flush(conn);
+    }
+
+    void flush(Connection& conn) {
+        int fd = conn.fd;
+        while (conn.out_offset < conn.out.size()) {
+            ssize_t n = send(fd, conn.out.data() + conn.out_offset, conn.out.size() - conn.out_offset, MSG_NOSIGNAL);
+            if (n > 0) {
+                conn.out_offset += static_cast<size_t>(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (conn.out.size() - conn.out_offset > max_buffered_bytes) {
+                    slow_disconnects_++;
+                    close_connection(fd);
+                    return;
+                }
+                set_want_write(conn, true);
+                return;
+            }
+            close_connection(fd);
+            return;
+        }
+        // Fully written - release the buffer so idle subscribers stay small
+        conn.out.clear();
+        if (conn.out.capacity() > 4096) {
+            conn.out.shrink_to_fit();
+        }
+        conn.out_offset = 0;
+        if (conn.file_fd >= 0 && !send_file(conn)) {
+            return;
+        }
+        set_want_write(conn, false);
+        if (conn.kind == Kind::Closing) {
+            close_connection(fd);
+        }
+    }
+
+    // Continue an artifact body; false while it waits for the socket or after it failed
+    bool send_file(Connection& conn) {
+        int fd = conn.fd;
+        size_t budget = sendfile_turn_bytes;
+        while (conn.file_offset < conn.file_end) {
+            if (budget == 0) {
+                // The socket is still writable, so EPOLLOUT brings us back next turn
+                set_want_write(conn, true);
+                return false;
+            }
+            size_t chunk = std::min<size_t>(budget, static_cast<size_t>(conn.file_end - conn.file_offset));
+            ssize_t n = sendfile(fd, conn.file_fd, &conn.file_offset, chunk);
+            if (n > 0) {
+                download_bytes_ += n;
+                if (!conn.file_session.empty()) {
+                    session_egress.add(conn.file_session, n);
+                }
+                budget -= static_cast<size_t>(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                set_want_write(conn, true);
+                return false;
+            }
+            // Error, or the file shrank under us
+            close_connection(fd);
+            return false;
+        }
+        close(conn.file_fd);
+        conn.file_fd = -1;
+        downloads_active_--;
+        return true;
+    }
+
+    void set_want_write(Connection& conn, bool want) {
+        if (conn.want_write == want) {
+            return;
+        }
+        conn.want_write = want;
+        update_interest(conn);
+    }
+
+    void update_interest(Connection& conn) {
+        epoll_event event{};
+        event.events = (conn.read_closed ? 0u : static_cast<uint32_t>(EPOLLIN | EPOLLRDHUP)) |
+                       (conn.want_write ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        event.data.fd = conn.fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn.fd, &event);
+    }
+
+    void close_connection(int fd) {
+        auto it = connections_.find(fd);
+        if (it == connections_.end()) {
+            return;
+        }
+        if (it->second->kind == Kind::Subscriber) {
+            subscribers_--;
+            if (it->second->topic == "metrics") {
+                metrics_subscribers_--;
+            }
+            auto view = ward_views_.find(it->second->ward_key);
+            if (!it->second->ward_key.empty() && view != ward_views_.end()) {
+                auto& fds = view->second.fds;
+                fds.erase(std::remove(fds.begin(), fds.end(), fd), fds.end());
+                if (fds.empty()) {
+                    ward_views_.erase(view);
+                }
+                ward_subscribers_--;
+                ward_view_count_ = ward_views_.size();
+            }
+        }
+        if (it->second->file_fd >= 0) {
+            close(it->second->file_fd);
+            downloads_active_--;
+        }
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        connections_.erase(it);
+    }
+
+    void deliver_pending() {
+        std::vector<Pending> batch;
+        std::vector<std::pair<std::string, ReadingRow>> readings;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            batch.swap(pending_);
+            readings.swap(pending_readings_);
+        }
+        // Ward views only need the newest reading; ticks send it
+        int64_t now = steady_now_ms();
+        for (auto& [id, row] : readings) {
+            WardReading& latest = ward_latest_[id];
+            latest.row = row;
+            latest.version = ++ward_version_;
+            latest.updated_ms = now;
+        }
+        for (auto& message : batch) {
+            const std::string& topic_name = message.topic;
+            Topic& topic = topics_[topic_name];
+            topic.seq++;
+            std::string event;
+            if (message.binary) {
+                // Binary topics have no long-poll form; the frame goes out untouched
+                event = std::move(message.payload);
+            } else {
+                topic.last_json = "{\"seq\":" + std::to_string(topic.seq) + ",\"data\":" + message.payload + "}";
+                event = "id: " + std::to_string(topic.seq) + "\ndata: " + message.payload + "\n\n";
+            }
+
+            std::vector<int> fds;
+            fds.reserve(connections_.size());
+            for (const auto& [fd, conn] : connections_) {
+                if (conn->topic == topic_name) {
+                    fds.push_back(fd);
+                }
+            }
+            for (int fd : fds) {
+                auto it = connections_.find(fd);
+                if (it == connections_.end()) {
+                    continue;
+                }
+                Connection& conn = *it->second;
+                if (conn.kind == Kind::Subscriber) {
+                    queue(conn, event);
+                    messages_sent_++;
+                } else if (conn.kind == Kind::LongPoll && topic.seq > conn.poll_after) {
+                    respond(conn, "200 OK", "application/json", topic.last_json);
+                    messages_sent_++;
+                }
+            }
+        }
+    }
+
+    void expire_timers() {
+        int64_t now = steady_now_ms();
+        bool keepalive = now - last_keepalive_ms_ >= keepalive_interval_ms;
+        if (keepalive) {
+            last_keepalive_ms_ = now;
+            for (auto it = ward_latest_.begin(); it != ward_latest_.end();) {
+                it = now - it->second.updated_ms > ward_forget_ms ? ward_latest_.erase(it) : std::next(it);
+            }
+        }
+        std::vector<int> fds;
+        for (const auto& [fd, conn] : connections_) {
+            if ((conn->kind == Kind::LongPoll && now >= conn->deadline_ms) ||
+                (keepalive && conn->kind == Kind::Subscriber)) {
+                fds.push_back(fd);
+            }
+        }
+        for (int fd : fds) {
+            auto it = connections_.find(fd);
+            if (it == connections_.end()) {
+                continue;
+            }
+            Connection& conn = *it->second;
+            if (conn.kind == Kind::LongPoll) {
+                respond(conn, "204 No Content", "application/json", "");
+            } else if (conn.topic == "metrics") {
+                // A zero-length frame
+                queue(conn, std::string(4, '\0'));
+            } else {
+                queue(conn, ": keepalive\n\n");
+            }
+        }
+    }
+
+    void update_stats() {
+        size_t bytes = 0;
+        for (const auto& [fd, conn] : connections_) {
+            // Hash node + connection + heap buffers (short strings live inside the struct)
+            bytes += sizeof(*conn) + sizeof(std::pair<const int, std::unique_ptr<Connection>>) + 2 * sizeof(void*);
+            if (conn->in.capacity() > 15) {
+                bytes += conn->in.capacity();
+            }
+            if (conn->out.capacity() > 15) {
+                bytes += conn->out.capacity();
+            }
+            if (conn->topic.capacity() > 15) {
+                bytes += conn->topic.capacity();
+            }
+        }
+        connection_bytes_ = bytes;
+        connections_count_ = connections_.size();
+    }
+};
+
+StreamServer stream_server;
+
+#ifdef PRESAGE_SDK_AVAILABLE
+// Feeds /live/metrics with the SDK's own messages, skipping the JSON
+// conversion. The metrics callback only copies each MetricsBuffer into a
+// bounded queue, and only while someone is subscribed; the forwarder thread
+// serialises it once and the stream server shares the frame between
+// subscribers. Frames, all integers big-endian:
+//
+//   u32  length of the rest of the frame (0 is a keepalive)
+//   u8   format version (1)
+//   u8   session id length N
+//   u16  reserved
+//   u64  sequence number
+//   i64  SDK timestamp of the buffer
+//   i64  wall-clock ms when the engine received it
+//   N    session id
+//   ...  serialised presage.physiology.MetricsBuffer
+class MetricsForwarder {
+public:
+    static constexpr uint8_t frame_version = 1;
+    static constexpr size_t max_queued = 256;  // Past this the callback drops buffers rather than wait
+
+    void start() {
+        forward_thread_ = std::thread([this]() {
+            set_thread_name("metrics-fwd");
+            run();
+        });
+        started_ = true;
+    }
+
+    void stop() {
+        if (!forward_thread_.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_one();
+        forward_thread_.join();
+    }
+
+    // SDK callback thread: copy the buffer for the forwarder thread
+    void submit(const std::string& session_id, int64_t timestamp, const presage::physiology::MetricsBuffer& metrics) {
+        if (!started_ || stream_server.metrics_subscriber_count() == 0) {
+            return;
+        }
+        Item item{session_id, timestamp, wall_now_ms(), metrics};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queue_.size() >= max_queued) {
+                dropped_++;
+                return;
+            }
+            queue_.push_back(std::move(item));
+        }
+        cv_.notify_one();
+    }
+
+    int64_t forwarded() const { return forwarded_.load(); }
+    int64_t forwarded_bytes() const { return forwarded_bytes_.load(); }
+    int64_t dropped() const { return dropped_.load(); }
+
+private:
+    struct Item {
+        std::string session_id;
+        int64_t timestamp = 0;
+        int64_t received_ms = 0;
+        presage::physiology::MetricsBuffer metrics;
+    };
+
+    std::atomic<bool> started_{false};
+    std::thread forward_thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    std::deque<Item> queue_;
+    uint64_t seq_ = 0;
+    std::atomic<int64_t> forwarded_{0};
+    std::atomic<int64_t> forwarded_bytes_{0};
+    std::atomic<int64_t> dropped_{0};
+
+    static void append_be(std::string& out, uint64_t value, int bytes) {
+        for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<char>((value >> shift) & 0xff));
+        }
+    }
+
+    void run() {
+        std::string message;
+        while (true) {
+            Item item;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return !queue_.empty() || stopping_; });
+                if (queue_.empty()) {
+                    return;
+                }
+                item = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            if (!item.metrics.SerializeToString(&message)) {
+                dropped_++;
+                continue;
+            }
+            size_t id_length = std::min<size_t>(item.session_id.size(), 255);
+            size_t header_length = 28 + id_length;
+            std::string frame;
+            frame.reserve(4 + header_length + message.size());
+            append_be(frame, header_length + message.size(), 4);
+            append_be(frame, frame_version, 1);
+            append_be(frame, id_length, 1);
+            append_be(frame, 0, 2);
+            append_be(frame, ++seq_, 8);
+            append_be(frame, static_cast<uint64_t>(item.timestamp), 8);
+            append_be(frame, static_cast<uint64_t>(item.received_ms), 8);
+            frame.append(item.session_id, 0, id_length);
+            frame.append(message);
+            forwarded_++;
+            forwarded_bytes_ += static_cast<int64_t>(frame.size());
+            stream_server.publish_binary("metrics", std::move(frame));
+        }
+    }
+};
+
+MetricsForwarder metrics_forwarder;
+#endif
+
+// Let the process hold one descriptor per streaming subscriber
+void raise_file_limit() {
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Unique name for an uploaded video in /app/uploads
+std::string make_upload_filename() {
+    static std::atomic<int> counter{0};
+    return "video_" + std::to_string(std::time(nullptr)) + "_" + std::to_string(counter++) + ".mp4";
+}
+
+// One video written to the uploads directory by receive_upload
+struct UploadedFile {
+    std::string filename;         // Name in the uploads directory
+    std::string path;
+    std::string client_filename;  // Multipart filename, if any
+    uint64_t bytes = 0;
+};
+
+// An upload streamed to disk by receive_upload
+struct UploadResult {
+    bool ok = false;
+    std::string error;
+    std::vector<UploadedFile> files;
+    std::map<std::string, std::string> fields;   // Small multipart fields (settings, session_id, ...)
+};
+
+// Stream a request body into upload_dir as it arrives, so memory use stays flat
+// whatever the upload size. Raw bodies are a single video. For
+// multipart/form-data, httplib's reader hands over each part incrementally:
+// parts with a filename (or named "video") go to their own file, up to
+// max_files, and other parts are collected as small inline fields.
+UploadResult receive_upload(const httplib::Request& req, const httplib::ContentReader& content_reader,
+                            const std::string& upload_dir, size_t max_files = 1) {
+    constexpr size_t max_field_bytes = 64 * 1024;
+    constexpr size_t max_fields = 32;
+
+    UploadResult result;
+    std::ofstream outfile;
+    auto open_next_file = [&](const std::string& client_filename) {
+        outfile.close();
+        UploadedFile file;
+        file.filename = make_upload_filename();
+        file.path = upload_dir + "/" + file.filename;
+        file.client_filename = client_filename;
+        result.files.push_back(file);
+        outfile.open(file.path, std::ios::binary);
+        if (!outfile) {
+            result.error = "Failed to save uploaded file";
+            return false;
+        }
+        return true;
+    };
+    auto write_file = [&](const char* data, size_t length) {
+        outfile.write(data, static_cast<std::streamsize>(length));
+        result.files.back().bytes += length;
+        return outfile.good();
+    };
+
+    bool completed;
+    if (req.is_multipart_form_data()) {
+        enum class Target { File, Field, Skip } target = Target::Skip;
+        std::string field_name;
+        completed = content_reader(
+            [&](const auto& part) {
+                if (!part.filename.empty() || part.name == "video") {
+                    if (result.files.size() >= max_files) {
+                        result.error = max_files == 1 ? "Only one video may be uploaded"
+                                                      : "Too many videos (max " + std::to_string(max_files) + ")";
+                        return false;
+                    }
+                    target = Target::File;
+                    return open_next_file(part.filename);
+                }
+                if (result.fields.size() < max_fields) {
+                    target = Target::Field;
+                    field_name = part.name;
+                    result.fields[field_name].clear();
+                } else {
+                    target = Target::Skip;
+                }
+                return true;
+            },
+            [&](const char* data, size_t length) {
+                if (target == Target::File) {
+                    return write_file(data, length);
+                }
+                if (target == Target::Field) {
+                    std::string& value = result.fields[field_name];
+                    if (value.size() + length > max_field_bytes) {
+                        result.error = "Form field '" + field_name + "' is too large";
+                        return false;
+                    }
+                    value.append(data, length);
+                }
+                return true;
+            });
+    } else {
+        completed = open_next_file("") && content_reader([&](const char* data, size_t length) {
+            return write_file(data, length);
+        });
+    }
+    outfile.close();
+
+    // close() on a stream that never opened (no file fields) sets failbit too
+    if (!completed || (!result.files.empty() && !outfile)) {
+        if (result.error.empty()) {
+            result.error = "Upload was interrupted or could not be written";
+        }
+    } else if (result.files.empty() || result.files.front().bytes == 0) {
+        result.error = "No video file provided";
+    } else if (std::any_of(result.files.begin(), result.files.end(), [](const UploadedFile& f) { return f.bytes == 0; })) {
+        result.error = "Uploaded video is empty";
+    } else {
+        result.ok = true;
+    }
+    if (!result.ok) {
+        std::error_code ec;
+        for (const auto& file : result.files) {
+            std::filesystem::remove(file.path, ec);
+        }
+        result.files.clear();
+    }
+    return result;
+}
+
+// Duration, frame rate and size of a video job, for the cost model
+std::optional<JobFeatures> probe_job(const std::string& video_path, const ProcessingSettings& processing) {
+    cv::VideoCapture capture(video_path);
+    if (!capture.isOpened()) {
+        return std::nullopt;
+    }
+    JobFeatures job;
+    job.fps = capture.get(cv::CAP_PROP_FPS);
+    double frames = capture.get(cv::CAP_PROP_FRAME_COUNT);
+    job.width = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH));
+    job.height = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT));
+    if (job.fps <= 0 || frames <= 0) {
+        return std::nullopt;
+    }
+    job.duration_s = frames / job.fps;
+    job.buffer_duration_s = processing.buffer_duration_s;
+    job.roi_crop = processing.roi_crop;
+    return job;
+}
+
+// CPU seconds used by the whole process so far, all threads
+double process_cpu_seconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Replay the container pool with the cost model's predictions: running jobs
+// finish as predicted and queued ones take the next free slot in order. Fills
+// job with the state and ETA of session_id if it is scheduled, and returns
+// how long a job submitted now would wait for a slot.
+double schedule_estimate(const std::string& session_id = "", json* job = nullptr) {
+    std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+    int64_t now = steady_now_ms();
+    std::vector<double> slots(static_cast<size_t>(container_pool.size()), 0.0);  // Seconds until each is free
+    size_t next_slot = 0;
+    auto remaining = [now](const ContainerRun& run) {
+        return std::max(0.0, run.predicted_wall_s - (now - run.job_started_ms.load()) / 1000.0);
+    };
+    for (const auto& run : scheduled_runs) {
+        if (run->job_started_ms.load() == 0) {
+            continue;
+        }
+        double left = remaining(*run);
+        if (next_slot < slots.size()) {
+            slots[next_slot++] = left;
+        }
+        if (job && run->session_id == session_id) {
+            *job = {{"state", "running"}, {"predicted_seconds", run->predicted_wall_s}, {"eta_seconds", left}};
+        }
+    }
+    for (const auto& run : scheduled_runs) {
+        if (run->job_started_ms.load() != 0) {
+            continue;
+        }
+        auto slot = std::min_element(slots.begin(), slots.end());
+        double start = *slot;
+        *slot += run->predicted_wall_s;
+        if (job && run->session_id == session_id) {
+            *job = {{"state", "queued"}, {"predicted_seconds", run->predicted_wall_s},
+                    {"wait_seconds", start}, {"eta_seconds", *slot}};
+        }
+    }
+    return *std::min_element(slots.begin(), slots.end());
+}
+
+// Retry-After for a request turned away while the single-job slot is busy
+int64_t single_job_retry_after() {
+    std::string session_id;
+    {
+        std::lock_guard<InstrumentedMutex> lock(vitals_mutex);
+        session_id = current_session_id;
+    }
+    json job;
+    schedule_estimate(session_id, &job);
+    if (!job.contains("eta_seconds") || job["predicted_seconds"].get<double>() <= 0) {
+        return 10;
+    }
+    return std::max<int64_t>(1, static_cast<int64_t>(std::ceil(job["eta_seconds"].get<double>())));
+}
+
+// Keep camera_ring fed while no camera run has the device; it hands the
+// device over whenever camera_ring_paused is set (see probe_stage)
+void camera_ring_loop() {
+    std::string open_device;
+    std::string last_error;
+    auto close_capture = [] {
+        camera_capture.close();
+        camera_ring_capturing = false;
+        std::lock_guard<std::mutex> lock(camera_capture_mutex);
+        camera_capture_info = json::object();
+    };
+    while (!engine_stopping.load()) {
+        std::string device;
+        {
+            std::lock_guard<InstrumentedMutex> lock(vitals_mutex);
+            device = camera_device_path;
+        }
+        bool paused = camera_ring_paused.load();
+        if (camera_capture.is_open() && (paused || device != open_device)) {
+            close_capture();
+        }
+        if (paused) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        if (!camera_capture.is_open()) {
+            struct stat buffer;
+            V4l2Options options = camera_capture_options;
+            options.device = device;
+            std::string error;
+            if (stat(device.c_str(), &buffer) != 0 || !camera_capture.open(options, error)) {
+                if (!error.empty() && error != last_error) {
+                    std::cerr << "Camera ring: " << error << std::endl;
+                }
+                last_error = error;
+                std::this_thread::sleep_for(std::chrono::seconds(5));
+                continue;
+            }
+            last_error.clear();
+            open_device = device;
+            {
+                std::lock_guard<std::mutex> lock(camera_capture_mutex);
+                camera_capture_info = {
+                    {"device", device},
+                    {"format", V4l2Capture::format_name(camera_capture.format())},
+                    {"width", camera_capture.width()},
+                    {"height", camera_capture.height()},
+                    {"buffers", camera_capture.buffer_count()}
+                };
+            }
+            camera_ring_capturing = true;
+            std::cout << "Camera ring capturing from " << device << " ("
+                      << V4l2Capture::format_name(camera_capture.format()) << " " << camera_capture.width() << "x"
+                      << camera_capture.height() << ", " << camera_capture.buffer_count() << " buffers)" << std::endl;
+        }
+        // Short waits, so a handover or shutdown never waits on the camera
+        bool ok = camera_capture.read(200, [](const V4l2Frame& frame) {
+            if (frame.bytes == 0) {
+                return;
+            }
+            if (frame.format == V4L2_PIX_FMT_MJPEG) {
+                // Already JPEG: copied once out of the driver's buffer, never decoded here
+                camera_ring.push_jpeg(std::make_shared<const std::vector<unsigned char>>(frame.data, frame.data + frame.bytes),
+                                      frame.timestamp_ms);
+            } else {
+                camera_ring.push(V4l2Capture::to_bgr(frame), frame.timestamp_ms);
+            }
+        });
+        if (!ok) {
+            std::cerr << "Camera ring: lost " << device << std::endl;
+            close_capture();
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+    }
+    close_capture();
+}
+
+// Decode buffered ring frames into a video the SDK can read, at the rate they were captured
+bool write_ring_video(const std::vector<FrameRing::Frame>& frames, const std::string& output_path, double& fps) {
+    if (frames.size() < 2) {
+        return false;
+    }
+    double span_s = (frames.back().timestamp_ms - frames.front().timestamp_ms) / 1000.0;
+    fps = span_s > 0 ? (frames.size() - 1) / span_s : 30.0;
+    cv::Mat first = cv::imdecode(*frames.front().jpeg, cv::IMREAD_COLOR);
+    if (first.empty()) {
+        return false;
+    }
+    cv::VideoWriter writer(output_path, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps, first.size());
+    if (!writer.isOpened()) {
+        return false;
+    }
+    cv::Mat decoded;
+    cv::Mat resized;
+    for (const auto& frame : frames) {
+        decoded = cv::imdecode(*frame.jpeg, cv::IMREAD_COLOR);
+        if (decoded.empty()) {
+            continue;
+        }
+        if (decoded.size() != first.size()) {
+            // The camera was reconfigured mid-buffer; keep the first frame size
+            cv::resize(decoded, resized, first.size());
+            writer.write(resized);
+        } else {
+            writer.write(decoded);
+        }
+    }
+    return true;
+}
+
+#ifdef PRESAGE_SDK_AVAILABLE
+using namespace presage::smartspectra;
+
+// Initialize Presage SDK
+bool initialize_sdk(const std::string& api_key) {
+    try {
+        google::InitGoogleLogging("presage_engine");
+        FLAGS_alsologtostderr = true;
+        sdk_initialized = true;
+        std::cout << "========================================" << std::endl;
+        std::cout << "✓ Presage SmartSpectra SDK INITIALIZED" << std::endl;
+        std::cout << "✓ Using SDK for vital sign extraction" << std::endl;
+        std::cout << "========================================" << std::endl;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to initialize SDK: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+// SDK stage: run one SDK container to completion on run->source_path (or the
+// camera), holding a container pool slot. Readings and checkpoints go to run,
+// so several of these can run side by side. Failures are archived here; a
+// completed run is archived by the persist stage; run->completed says which.
+// Suspends while it waits for a slot and while the SDK runs.
+Task run_container(std::string api_key, std::shared_ptr<ContainerRun> run, bool use_video_file) {
+    const std::string& session_id = run->session_id;
+    const ProcessingSettings& processing = run->processing;
+
+    struct SlotGuard {
+        std::shared_ptr<ContainerRun> run;
+        ~SlotGuard() {
+            container_pool.release();
+            std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+            scheduled_runs.erase(std::remove(scheduled_runs.begin(), scheduled_runs.end(), run), scheduled_runs.end());
+        }
+    };
+    co_await container_pool.acquire();
+    SlotGuard slot_guard{run};
+    run->job_started_ms = steady_now_ms();
+    if (run->preempted.load()) {
+        archive_run_result(*run, "failed", "Shadow run preempted before it started");
+        co_return;
+    }
+
+    // CPU time is only attributed to the job if nothing else held a slot meanwhile
+    int64_t acquisitions_at_start = container_pool.acquisitions();
+    bool alone_at_start = container_pool.busy() == 1;
+    double cpu_at_start = process_cpu_seconds();
+
+    std::error_code ec;
+    std::filesystem::create_directories(session_dir(session_id), ec);
+    if (!run->resume) {
+        ReadingsStore::truncate(session_dir(session_id), 0);
+    }
+    run->store = ReadingsStore::open_for_append(session_dir(session_id));
+
+    try {
+        // Create settings
+        container::settings::Settings<
+            container::settings::OperationMode::Continuous,
+            container::settings::IntegrationMode::Rest
+        > settings;
+
+        // Configure video source
+        if (use_video_file) {
+            // Use video file input
+            settings.video_source.input_video_path = run->source_path;
+            settings.video_source.device_index = -1;  // Disable camera
+        } else {
+            // Use camera
+            settings.video_source.device_index = camera_device_index(camera_device_path);
+            settings.video_source.input_video_path = "";
+        }
+        
+        settings.video_source.capture_width_px = processing.capture_width_px;
+        settings.video_source.capture_height_px = processing.capture_height_px;
+        settings.video_source.codec = presage::camera::CaptureCodec::MJPG;
+        settings.video_source.auto_lock = true;
+        
+        settings.headless = true;  // No GUI in server mode
+        settings.enable_edge_metrics = true;
+        settings.verbosity_level = 1;
+        settings.continuous.preprocessed_data_buffer_duration_s = processing.buffer_duration_s;
+        settings.integration.api_key = api_key;
+
+        // Create container (shared so a recycled container can outlive this job)
+        auto container = std::make_shared<container::CpuContinuousRestForegroundContainer>(settings);
+
+        // Metrics callback - store all readings from REAL Presage SDK
+        auto status = container->SetOnCoreMetricsOutput(
+            [run](const presage::physiology::MetricsBuffer& metrics, int64_t timestamp) {
+                static thread_local bool thread_named = false;
+                if (!thread_named) {
+                    set_thread_name("sdk-metrics");
+                    thread_named = true;
+                }
+                if (run->stalled.load()) {
+                    return absl::CancelledError("Container recycled by watchdog");
+                }
+                ThreadCpuCharge charge{run->usage.sdk_thread_cpu_ns};
+                int64_t now_ms = steady_now_ms();
+                run->last_callback_ms = now_ms;
+                run->callbacks++;
+
+                // Match the metrics to the newest frame they cover to time the round trip
+                {
+                    std::lock_guard<std::mutex> lock(run->latency_mutex);
+                    auto covered = std::upper_bound(run->frame_times.begin(), run->frame_times.end(), timestamp,
+                        [](int64_t ts, const std::pair<int64_t, int64_t>& frame) { return ts < frame.first; });
+                    if (covered != run->frame_times.begin()) {
+                        double latency_ms = static_cast<double>(now_ms - std::prev(covered)->second);
+                        run->integration_latency_ms.push_back(latency_ms);
+                        rest_integration_latency.observe(latency_ms / 1000.0);
+                        run->frame_times.erase(run->frame_times.begin(), covered);
+                    }
+                }
+
+                int64_t original_timestamp = timestamp + run->timestamp_shift.load();
+                if (run->resume && original_timestamp <= run->resume->checkpoint_timestamp) {
+                    // Warm-up on a resumed run - covered by the readings restored from the checkpoint
+                    return absl::OkStatus();
+                }
+                if (run->shadow_of.empty()) {
+                    metrics_forwarder.submit(run->session_id, original_timestamp, metrics);
+                }
+
+                std::lock_guard<std::mutex> lock(run->readings_mutex);
+                
+                // Extract heart and breathing rate from Presage SDK
+                json reading = metrics_to_reading(metrics, original_timestamp);
+                if (reading.contains("heart_rate_bpm")) {
+                    std::cout << "[Presage SDK] " << run->session_id << " Heart Rate: " << reading["heart_rate_bpm"] << " BPM" << std::endl;
+                }
+                if (reading.contains("breathing_rate_bpm")) {
+                    std::cout << "[Presage SDK] " << run->session_id << " Breathing Rate: " << reading["breathing_rate_bpm"] << " breaths/min" << std::endl;
+                }
+                
+                // Store this reading
+                run->readings.push_back(reading);
+                ReadingRow row = reading_to_row(reading);
+                if (run->store && !run->store->append(row)) {
+                    std::cerr << "Failed to append reading to the session store" << std::endl;
+                }
+                
+                // Single jobs also feed /status and the /live endpoint
+                if (run->feeds_live) {
+                    {
+                        std::lock_guard<InstrumentedMutex> lock2(vitals_readings_mutex);
+                        all_vitals_readings.push_back(reading);
+                    }
+                    std::lock_guard<InstrumentedMutex> lock2(vitals_mutex);
+                    latest_vitals = reading;
+                }
+
+                // And push it to streaming subscribers (shadow runs are never streamed)
+                if (run->shadow_of.empty()) {
+                    json event = reading;
+                    event["session_id"] = run->session_id;
+                    stream_server.publish("live", event.dump());
+                    stream_server.publish_reading(run->session_id, row);
+                }
+                
+                return absl::OkStatus();
+            }
+        );
+
+        if (!status.ok()) {
+            std::cerr << "Failed to set metrics callback: " << status.message() << std::endl;
+            archive_run_result(*run, "failed", std::string(status.message()));
+            co_return;
+        }
+
+        // Video callback - track the frame offset checkpoints record
+        status = container->SetOnVideoOutput(
+            [run](cv::Mat& frame, int64_t timestamp) {
+                static thread_local bool thread_named = false;
+                if (!thread_named) {
+                    set_thread_name("sdk-video");
+                    thread_named = true;
+                }
+                if (run->stalled.load()) {
+                    return absl::CancelledError("Container recycled by watchdog");
+                }
+                ThreadCpuCharge charge{run->usage.sdk_thread_cpu_ns};
+                int64_t now_ms = steady_now_ms();
+                run->last_frame_ms = now_ms;
+                run->frames++;
+                {
+                    std::lock_guard<std::mutex> lock(run->latency_mutex);
+                    run->frame_times.emplace_back(timestamp, now_ms);
+                    if (run->frame_times.size() > 4096) {
+                        run->frame_times.pop_front();
+                    }
+                }
+
+                if (!run->timestamp_shift_known.load()) {
+                    run->timestamp_shift = run->resume ? run->resume->start_timestamp - timestamp : 0;
+                    run->timestamp_shift_known = true;
+                }
+                int64_t original_timestamp = timestamp + run->timestamp_shift.load();
+                if (run->first_frame_timestamp.load() < 0) {
+                    run->first_frame_timestamp = original_timestamp;
+                }
+                run->last_frame_timestamp = original_timestamp;
+                run->frame_offset++;
+                if (run->feeds_camera_ring) {
+                    camera_ring.push(frame, wall_now_ms());
+                }
+                return absl::OkStatus();
+            }
+        );
+
+        if (!status.ok()) {
+            std::cerr << "Failed to set video callback: " << status.message() << std::endl;
+            archive_run_result(*run, "failed", std::string(status.message()));
+            co_return;
+        }
+
+        // Status callback
+        container->SetOnStatusChange(
+            [](presage::physiology::StatusValue imaging_status) {
+                std::cout << "Status: " << presage::physiology::GetStatusDescription(imaging_status.value()) << std::endl;
+                return absl::OkStatus();
+            }
+        );
+
+        // Initialize
+        if (auto init_status = container->Initialize(); !init_status.ok()) {
+            std::cerr << "Failed to initialize container: " << init_status.message() << std::endl;
+            archive_run_result(*run, "failed", std::string(init_status.message()));
+            co_return;
+        }
+
+        std::cout << "Video source initialized. Processing " << session_id << "..." << std::endl;
+
+        // Run processing in a separate thread, watched by the stall watchdog
+        run->started_ms = steady_now_ms();
+        {
+            std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+            active_containers.push_back(run);
+        }
+        std::thread run_thread([container, run]() {
+            set_thread_name("sdk-run");
+            if (!run->shadow_of.empty()) {
+                // SDK threads Run() starts inherit this
+                set_thread_idle_priority();
+            }
+            {
+                ThreadCpuCharge charge{run->usage.sdk_thread_cpu_ns};
+                container->Run();
+            }
+            run->finished = true;
+            run->ended.set();
+        });
+
+        // For video files, let it process the entire video, checkpointing
+        // progress so an engine restart can resume instead of starting over.
+        // For camera, the container runs until it is stopped.
+        if (use_video_file) {
+            write_session_checkpoint(*run);
+        }
+        auto last_checkpoint = std::chrono::steady_clock::now();
+        while (!run->finished.load() && !run->stalled.load()) {
+            co_await run->ended.wait(*executor, timers.get(), std::chrono::seconds(1));
+            if (use_video_file && std::chrono::steady_clock::now() - last_checkpoint >= std::chrono::seconds(checkpoint_interval_s)) {
+                write_session_checkpoint(*run);
+                last_checkpoint = std::chrono::steady_clock::now();
+            }
+        }
+        {
+            std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+            active_containers.erase(std::remove(active_containers.begin(), active_containers.end(), run),
+                                    active_containers.end());
+        }
+
+        if (run->stalled.load()) {
+            // Abandon the stuck container - its thread keeps the only reference,
+            // and its callbacks cancel the run if the SDK ever wakes up again.
+            // The watchdog joins the thread if Run() does return.
+            {
+                std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+                abandoned_runs.emplace_back(run, std::move(run_thread));
+            }
+            if (run->preempted.load()) {
+                std::cout << "Shadow run " << session_id << " preempted by a waiting job" << std::endl;
+                archive_run_result(*run, "failed", "Shadow run preempted by a waiting job");
+                co_return;
+            }
+            containers_recycled++;
+            std::cerr << "Processing " << session_id << " failed: container recycled by watchdog" << std::endl;
+            archive_run_result(*run, "failed", "SDK container stalled and was recycled",
+                               {{"diagnostics", stall_diagnostics(*run)}, {"rest_integration", integration_latency_summary(*run)}});
+            co_return;
+        }
+        run_thread.join();
+
+        std::cout << "Processing " << session_id << " completed." << std::endl;
+        if (run->features) {
+            double wall_s = (steady_now_ms() - run->job_started_ms.load()) / 1000.0;
+            bool alone = alone_at_start && container_pool.acquisitions() == acquisitions_at_start;
+            run->cost = {{"features", run->features->to_json()}, {"predicted_wall_s", run->predicted_wall_s}, {"wall_s", wall_s}};
+            if (alone) {
+                run->cost["cpu_s"] = process_cpu_seconds() - cpu_at_start;
+            }
+        }
+        run->completed = true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error during processing of " << session_id << ": " << e.what() << std::endl;
+        archive_run_result(*run, "failed", e.what());
+        co_return;
+    }
+}
+
+#else
+// SDK not available - allow server to start for SDK installation
+bool initialize_sdk(const std::string& api_key) {
+    std::cerr << "========================================" << std::endl;
+    std::cerr << "⚠️  WARNING: Presage SmartSpectra SDK NOT AVAILABLE" << std::endl;
+    std::cerr << "⚠️  Application compiled without SDK support" << std::endl;
+    std::cerr << "========================================" << std::endl;
+    std::cerr << "To use the real Presage SDK:" << std::endl;
+    std::cerr << "1. Install libsmartspectra-dev package" << std::endl;
+    std::cerr << "2. Ensure SDK libraries are in /usr/lib or /usr/local/lib" << std::endl;
+    std::cerr << "3. Rebuild the application" << std::endl;
+    std::cerr << "========================================" << std::endl;
+    std::cerr << "Server will start in limited mode. Install SDK and rebuild to enable full functionality." << std::endl;
+    sdk_initialized = false;  // Mark as not initialized, but allow server to start
+    return true;  // Allow server to start so SDK can be installed
+}
+
+Task run_container(std::string /*api_key*/, std::shared_ptr<ContainerRun> run, bool /*use_video_file*/) {
+    std::cerr << "❌ ERROR: Cannot process " << run->session_id << " - Presage SDK not available" << std::endl;
+    std::cerr << "Install the Presage SmartSpectra SDK to extract real vital signs" << std::endl;
+    {
+        std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+        scheduled_runs.erase(std::remove(scheduled_runs.begin(), scheduled_runs.end(), run), scheduled_runs.end());
+    }
+    archive_run_result(*run, "failed", "Presage SDK not available");
+    co_return;
+}
+#endif
+
+// One job on job_pipeline. The stages fill in run as they go; a job whose SDK
+// stage fails still passes through persist and notify.
+struct Job {
+    std::string api_key;
+    std::shared_ptr<ContainerRun> run;
+    std::string input_path;             // Video to process (a resumed run's trimmed copy); empty for the camera
+    bool use_video_file = true;
+    bool single = false;                // The single-job slot (/test, /process-video, resume) - owns camera_running
+    std::function<void(Job&)> on_done;  // Called by the notify stage, on an executor thread
+    bool passes_slot_on = false;        // Set by on_done when it hands the single-job slot to the next run
+    std::promise<void> done;
+    std::shared_future<void> finished = done.get_future().share();  // Ready once notify has run
+};
+
+// The job pipeline on executor; built in main
+std::unique_ptr<Pipeline<std::shared_ptr<Job>>> job_pipeline;
+
+// Shadow evaluation - re-runs a sampled share of completed video jobs with
+// candidate settings, so a settings change is judged on production videos
+// before it is rolled out. PRESAGE_SHADOW_PERCENT of jobs are sampled (by
+// session id, so a session is always in or out) and PRESAGE_SHADOW_SETTINGS
+// holds the candidate's overrides; POST /shadow replaces both. Shadow runs go
+// one at a time and only while nothing else is queued or running. They get
+// idle CPU priority and give their pool slot up as soon as a real job waits
+// for one (see shadow_loop). Each is archived under <primary>/shadow with its
+// cost and reading deltas against the primary run; GET /shadow aggregates them.
+class ShadowEvaluation {
+public:
+    static constexpr size_t max_queued = 16;         // Oldest candidates are dropped beyond this
+    static constexpr size_t max_recent = 20;         // Comparisons GET /shadow lists
+    static constexpr int64_t match_window_ms = 1000;  // Readings further apart are not compared
+
+    // Replace the candidate and start the aggregates over; false with a message on invalid overrides
+    bool configure(double percent, const json& overrides, std::string& error) {
+        if (!(percent >= 0 && percent <= 100)) {
+            error = "percent must be between 0 and 100";
+            return false;
+        }
+        ProcessingSettings check;
+        if (!check.update_from_json(overrides, error)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        percent_ = percent;
+        overrides_ = overrides;
+        queue_.clear();
+        totals_ = Totals();
+        recent_.clear();
+        generation_++;  // A run in flight belongs to the old candidate
+        return true;
+    }
+
+    // Consider a completed primary run for a shadow run (persist stage)
+    void offer(const Job& job) {
+        const ContainerRun& run = *job.run;
+        if (!job.use_video_file || !run.completed || run.resume || !run.shadow_of.empty()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || percent_ <= 0 || std::hash<std::string>{}(run.session_id) % 10000 >= percent_ * 100) {
+            return;
+        }
+        ProcessingSettings candidate = run.processing;
+        std::string error;
+        if (!candidate.update_from_json(overrides_, error) || candidate.to_json() == run.processing.to_json()) {
+            return;  // The candidate changes nothing for this job
+        }
+        totals_.sampled++;
+        if (queue_.size() >= max_queued) {
+            queue_.pop_front();
+            totals_.dropped++;
+        }
+        queue_.push_back({run.session_id, job.input_path, run.processing, candidate});
+    }
+
+    // Submit the next shadow run if the engine is idle (shadow_loop)
+    void start_if_idle(const std::string& api_key) {
+        {
+            std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+            if (!scheduled_runs.empty()) {
+                return;
+            }
+        }
+        if (container_pool.waiting() > 0 || executor->stats().queued > 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!running_ && !stopping_ && !queue_.empty()) {
+            Candidate candidate = std::move(queue_.front());
+            queue_.pop_front();
+            std::error_code ec;
+            if (!std::filesystem::exists(candidate.input_path, ec)) {
+                totals_.dropped++;
+                continue;
+            }
+            auto run = std::make_shared<ContainerRun>();
+            run->session_id = candidate.session_id + "/shadow";
+            run->video_path = candidate.input_path;
+            run->processing = candidate.candidate;
+            run->feeds_live = false;
+            run->shadow_of = candidate.session_id;
+            auto job = std::make_shared<Job>();
+            job->api_key = api_key;
+            job->run = run;
+            job->input_path = candidate.input_path;
+            job->use_video_file = true;
+            running_ = run;
+            running_generation_ = generation_;
+            running_primary_ = candidate.primary;
+            totals_.started++;
+            std::cout << "Shadow run of " << candidate.session_id << " with candidate settings "
+                      << candidate.candidate.to_json().dump() << std::endl;
+            // Under mutex_, so stop() never misses a run that is being submitted
+            job_pipeline->submit(job);
+        }
+    }
+
+    // Stop the shadow run if a real job is waiting for a pool slot, or the
+    // engine is stopping. Before it holds a slot (while it crops), any real
+    // job in the pipeline stops it.
+    void preempt_if_needed() {
+        bool real_jobs;
+        {
+            std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+            real_jobs = !submitted_runs.empty();
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_ || running_->preempted.load()) {
+            return;
+        }
+        bool holds_slot = running_->job_started_ms.load() != 0;
+        bool in_the_way = holds_slot ? container_pool.waiting() > 0 : real_jobs;
+        if (stopping_ || in_the_way) {
+            running_->preempted = true;
+            running_->stalled = true;
+            running_->ended.set();
+        }
+    }
+
+    // No new shadow runs; the one in flight is preempted (before the pipeline drains)
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            queue_.clear();
+        }
+        preempt_if_needed();
+    }
+
+    // Compare and archive a shadow run that has been through the pipeline (persist stage)
+    void finish(ContainerRun& run) {
+        json comparison;
+        ProcessingSettings primary_settings;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            primary_settings = running_primary_;
+        }
+        if (run.completed) {
+            comparison = compare(run, primary_settings);
+            archive_run_result(run, comparison.is_null() ? "failed" : "complete",
+                               comparison.is_null() ? "Primary session summary is missing" : "",
+                               {{"shadow_of", run.shadow_of},
+                                {"settings", run.processing.to_json()},
+                                {"cost", run.cost},
+                                {"comparison", comparison}});
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool current = running_generation_ == generation_;
+        running_.reset();
+        if (!current) {
+            return;
+        }
+        if (run.preempted.load()) {
+            totals_.preempted++;
+        } else if (comparison.is_null()) {
+            totals_.failed++;
+        } else {
+            totals_.completed++;
+            totals_.add(comparison);
+            recent_.push_back(comparison);
+            if (recent_.size() > max_recent) {
+                recent_.pop_front();
+            }
+        }
+    }
+
+    json to_json() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        json response = {
+            {"percent", percent_},
+            {"candidate", overrides_},
+            {"queued", queue_.size()},
+            {"running", running_ ? json(running_->shadow_of) : json(nullptr)},
+            {"sampled", totals_.sampled},
+            {"dropped", totals_.dropped},
+            {"started", totals_.started},
+            {"completed", totals_.completed},
+            {"failed", totals_.failed},
+            {"preempted", totals_.preempted},
+            {"aggregate", totals_.to_json()},
+            {"recent", json::array()}
+        };
+        for (auto it = recent_.rbegin(); it != recent_.rend(); ++it) {
+            response["recent"].push_back(*it);
+        }
+        return response;
+    }
+
+    // Prometheus metrics for GET /metrics
+    std::string prometheus() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string out;
+        out += "# HELP presage_shadow_sampled_total Completed jobs sampled for a shadow run\n";
+        out += "# TYPE presage_shadow_sampled_total counter\n";
+        out += "presage_shadow_sampled_total " + std::to_string(totals_.sampled) + "\n";
+        out += "# HELP presage_shadow_dropped_total Sampled jobs never shadowed (queue full or input gone)\n";
+        out += "# TYPE presage_shadow_dropped_total counter\n";
+        out += "presage_shadow_dropped_total " + std::to_string(totals_.dropped) + "\n";
+        out += "# HELP presage_shadow_runs_total Shadow runs by how they ended\n";
+        out += "# TYPE presage_shadow_runs_total counter\n";
+        out += "presage_shadow_runs_total{result=\"completed\"} " + std::to_string(totals_.completed) + "\n";
+        out += "presage_shadow_runs_total{result=\"failed\"} " + std::to_string(totals_.failed) + "\n";
+        out += "presage_shadow_runs_total{result=\"preempted\"} " + std::to_string(totals_.preempted) + "\n";
+        if (totals_.cpu_ratio_count > 0) {
+            out += "# HELP presage_shadow_cpu_ratio Mean candidate/primary CPU time over compared runs\n";
+            out += "# TYPE presage_shadow_cpu_ratio gauge\n";
+            out += "presage_shadow_cpu_ratio " + std::to_string(totals_.cpu_ratio_sum / totals_.cpu_ratio_count) + "\n";
+        }
+        if (totals_.heart_rate.matched > 0) {
+            out += "# HELP presage_shadow_heart_rate_mae_bpm Mean absolute candidate/primary heart rate difference\n";
+            out += "# TYPE presage_shadow_heart_rate_mae_bpm gauge\n";
+            out += "presage_shadow_heart_rate_mae_bpm " +
+                   std::to_string(totals_.heart_rate.abs_error_sum / totals_.heart_rate.matched) + "\n";
+        }
+        if (totals_.breathing_rate.matched > 0) {
+            out += "# HELP presage_shadow_breathing_rate_mae_bpm Mean absolute candidate/primary breathing rate difference\n";
+            out += "# TYPE presage_shadow_breathing_rate_mae_bpm gauge\n";
+            out += "presage_shadow_breathing_rate_mae_bpm " +
+                   std::to_string(totals_.breathing_rate.abs_error_sum / totals_.breathing_rate.matched) + "\n";
+        }
+        return out;
+    }
+
+private:
+    struct Candidate {
+        std::string session_id;
+        std::string input_path;
+        ProcessingSettings primary;
+        ProcessingSettings candidate;
+    };
+
+    // One channel of both runs: averages, and each candidate reading against
+    // the primary reading nearest in time
+    struct ChannelDelta {
+        double primary_sum = 0.0;
+        double shadow_sum = 0.0;
+        int64_t primary_count = 0;
+        int64_t shadow_count = 0;
+        double abs_error_sum = 0.0;
+        int64_t matched = 0;
+
+        json to_json() const {
+            json out = {
+                {"primary_count", primary_count},
+                {"shadow_count", shadow_count},
+                {"matched", matched}
+            };
+            if (primary_count > 0 && shadow_count > 0) {
+                out["primary_avg"] = primary_sum / primary_count;
+                out["shadow_avg"] = shadow_sum / shadow_count;
+                out["avg_delta"] = shadow_sum / shadow_count - primary_sum / primary_count;
+            }
+            if (matched > 0) {
+                out["mean_abs_error"] = abs_error_sum / matched;
+            }
+            return out;
+        }
+    };
+
+    // Pooled over every compared run since the candidate was set
+    struct ChannelTotals {
+        double abs_error_sum = 0.0;
+        int64_t matched = 0;
+        double avg_delta_sum = 0.0;
+        int64_t avg_delta_count = 0;
+        double count_ratio_sum = 0.0;  // Candidate readings per primary reading
+        int64_t count_ratio_count = 0;
 
-// Store all vitals readings for comprehensive analysis
-std::vector<json> all_vitals_readings;
-std::mutex vitals_readings_mutex;
+        void add(const json& channel) {
+            if (channel.contains("mean_abs_error")) {
+                int64_t matched_here = channel["matched"].get<int64_t>();
+                abs_error_sum += channel["mean_abs_error"].get<double>() * matched_here;
+                matched += matched_here;
+            }
+            if (channel.contains("avg_delta")) {
+                avg_delta_sum += channel["avg_delta"].get<double>();
+                avg_delta_count++;
+            }
+            if (channel["primary_count"].get<int64_t>() > 0) {
+                count_ratio_sum += static_cast<double>(channel["shadow_count"].get<int64_t>()) /
+                                   channel["primary_count"].get<int64_t>();
+                count_ratio_count++;
+            }
+        }
 
-// Check if camera device exists
-bool check_camera_device(const std::string& device_path = "/dev/video0") {
-    struct stat buffer;
-    if (stat(device_path.c_str(), &buffer) != 0) {
-        std::cerr << "Error: Camera device " << device_path << " not found!" << std::endl;
-        return false;
-    }
-    return true;
-}
+        json to_json() const {
+            return {
+                {"matched", matched},
+                {"mean_abs_error", matched > 0 ? json(abs_error_sum / matched) : json(nullptr)},
+                {"avg_delta_mean", avg_delta_count > 0 ? json(avg_delta_sum / avg_delta_count) : json(nullptr)},
+                {"count_ratio_mean", count_ratio_count > 0 ? json(count_ratio_sum / count_ratio_count) : json(nullptr)}
+            };
+        }
+    };
 
-// Calculate vitals summary statistics
-json calculate_vitals_summary() {
-    std::lock_guard<std::mutex> lock(vitals_readings_mutex);
-    
-    if (all_vitals_readings.empty()) {
-        return json::object();
-    }
-    
-    std::vector<float> heart_rates;
-    std::vector<float> breathing_rates;
-    
-    // Extract all readings
-    for (const auto& reading : all_vitals_readings) {
-        if (reading.contains("heart_rate_bpm") && reading["heart_rate_bpm"].is_number()) {
-            heart_rates.push_back(reading["heart_rate_bpm"]);
+    struct Totals {
+        int64_t sampled = 0;
+        int64_t dropped = 0;
+        int64_t started = 0;
+        int64_t completed = 0;
+        int64_t failed = 0;
+        int64_t preempted = 0;
+        double cpu_ratio_sum = 0.0;
+        int64_t cpu_ratio_count = 0;
+        double memory_ratio_sum = 0.0;
+        int64_t memory_ratio_count = 0;
+        ChannelTotals heart_rate;
+        ChannelTotals breathing_rate;
+
+        void add(const json& comparison) {
+            const json& cost = comparison["cost"];
+            if (cost.contains("cpu_ratio")) {
+                cpu_ratio_sum += cost["cpu_ratio"].get<double>();
+                cpu_ratio_count++;
+            }
+            if (cost.contains("memory_ratio")) {
+                memory_ratio_sum += cost["memory_ratio"].get<double>();
+                memory_ratio_count++;
+            }
+            heart_rate.add(comparison["heart_rate"]);
+            breathing_rate.add(comparison["breathing_rate"]);
         }
-        if (reading.contains("breathing_rate_bpm") && reading["breathing_rate_bpm"].is_number()) {
-            breathing_rates.push_back(reading["breathing_rate_bpm"]);
+
+        json to_json() const {
+            return {
+                {"cpu_ratio_mean", cpu_ratio_count > 0 ? json(cpu_ratio_sum / cpu_ratio_count) : json(nullptr)},
+                {"memory_ratio_mean", memory_ratio_count > 0 ? json(memory_ratio_sum / memory_ratio_count) : json(nullptr)},
+                {"heart_rate", heart_rate.to_json()},
+                {"breathing_rate", breathing_rate.to_json()}
+            };
+        }
+    };
+
+    std::mutex mutex_;
+    double percent_ = 0.0;
+    json overrides_ = json::object();
+    std::deque<Candidate> queue_;
+    std::shared_ptr<ContainerRun> running_;
+    ProcessingSettings running_primary_;
+    uint64_t generation_ = 0;
+    uint64_t running_generation_ = 0;
+    bool stopping_ = false;
+    Totals totals_;
+    std::deque<json> recent_;
+
+    static ChannelDelta channel_delta(const std::vector<ReadingRow>& primary, const std::vector<ReadingRow>& shadow,
+                                      float ReadingRow::*channel) {
+        ChannelDelta delta;
+        std::vector<std::pair<int64_t, float>> reference;
+        for (const auto& row : primary) {
+            if (!std::isnan(row.*channel)) {
+                reference.emplace_back(row.timestamp, row.*channel);
+                delta.primary_sum += row.*channel;
+                delta.primary_count++;
+            }
+        }
+        std::sort(reference.begin(), reference.end());
+        for (const auto& row : shadow) {
+            float value = row.*channel;
+            if (std::isnan(value)) {
+                continue;
+            }
+            delta.shadow_sum += value;
+            delta.shadow_count++;
+            auto next = std::lower_bound(reference.begin(), reference.end(), row.timestamp,
+                [](const std::pair<int64_t, float>& entry, int64_t ts) { return entry.first < ts; });
+            int64_t best_gap = match_window_ms + 1;
+            float best = 0.0f;
+            if (next != reference.end()) {
+                best_gap = next->first - row.timestamp;
+                best = next->second;
+            }
+            if (next != reference.begin() && row.timestamp - std::prev(next)->first < best_gap) {
+                best_gap = row.timestamp - std::prev(next)->first;
+                best = std::prev(next)->second;
+            }
+            if (best_gap <= match_window_ms) {
+                delta.abs_error_sum += std::abs(value - best);
+                delta.matched++;
+            }
         }
+        return delta;
     }
-    
-    // Calculate statistics helper
-    auto calc_stats = [](const std::vector<float>& values) -> json {
-        if (values.empty()) {
-            return json::object();
+
+    // Cost and reading deltas of a completed shadow run against its primary; null without the primary's summary
+    static json compare(ContainerRun& run, const ProcessingSettings& primary_settings) {
+        std::string primary_dir = session_dir(run.shadow_of);
+        json primary;
+        if (!read_json_file(primary_dir + "/summary.json", primary) || primary.value("status", "") != "complete") {
+            return nullptr;
         }
-        
-        float sum = 0.0f;
-        float min_val = values[0];
-        float max_val = values[0];
-        
-        for (float v : values) {
-            sum += v;
-            min_val = std::min(min_val, v);
-            max_val = std::max(max_val, v);
+        std::vector<ReadingRow> primary_rows = ReadingsStore::read(primary_dir, 0, ReadingsStore::row_count(primary_dir));
+        std::vector<ReadingRow> shadow_rows;
+        {
+            std::lock_guard<std::mutex> lock(run.readings_mutex);
+            shadow_rows.reserve(run.readings.size());
+            for (const auto& reading : run.readings) {
+                shadow_rows.push_back(reading_to_row(reading));
+            }
         }
-        
+
+        json primary_usage = primary.value("usage", json::object());
+        json shadow_usage = usage_summary(run);
+        double primary_cpu = primary_usage.value("cpu_s", 0.0);
+        double shadow_cpu = shadow_usage.value("cpu_s", 0.0);
+        int64_t primary_memory = primary_usage.value("memory_bytes_peak", int64_t{0});
+        int64_t shadow_memory = shadow_usage.value("memory_bytes_peak", int64_t{0});
+        json cost = {
+            {"primary_cpu_s", primary_cpu},
+            {"shadow_cpu_s", shadow_cpu},
+            {"primary_memory_bytes_peak", primary_memory},
+            {"shadow_memory_bytes_peak", shadow_memory}
+        };
+        if (primary_cpu > 0) {
+            cost["cpu_ratio"] = shadow_cpu / primary_cpu;
+        }
+        if (primary_memory > 0) {
+            cost["memory_ratio"] = static_cast<double>(shadow_memory) / primary_memory;
+        }
+        // Wall time of the shadow run is inflated by idle priority whenever the machine is busy
+        if (primary.contains("cost") && primary["cost"].contains("wall_s")) {
+            cost["primary_wall_s"] = primary["cost"]["wall_s"];
+        }
+        if (run.cost.contains("wall_s")) {
+            cost["shadow_wall_s"] = run.cost["wall_s"];
+        }
+
         return {
-            {"avg", sum / values.size()},
-            {"min", min_val},
-            {"max", max_val},
-            {"count", values.size()}
+            {"session_id", run.shadow_of},
+            {"completed_at", static_cast<int64_t>(std::time(nullptr))},
+            {"primary_settings", primary_settings.to_json()},
+            {"candidate_settings", run.processing.to_json()},
+            {"cost", cost},
+            {"heart_rate", channel_delta(primary_rows, shadow_rows, &ReadingRow::heart_rate).to_json()},
+            {"breathing_rate", channel_delta(primary_rows, shadow_rows, &ReadingRow::breathing_rate).to_json()}
         };
+    }
+};
+ShadowEvaluation shadow_evaluation;
+
+// Start queued shadow runs while the engine is idle, and stop the one in a
+// real job's way. Runs until engine_stopping.
+void shadow_loop(const std::string& api_key) {
+    while (!engine_stopping.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        shadow_evaluation.preempt_if_needed();
+        shadow_evaluation.start_if_idle(api_key);
+    }
+}
+
+// Probe stage: predict the job's cost for ETAs and join the schedule. A camera
+// job takes the device from the ring's capture thread first.
+Task probe_stage(std::shared_ptr<Job> job_ptr) {
+    Job& job = *job_ptr;
+    ContainerRun& run = *job.run;
+    if (job.use_video_file) {
+        ThreadCpuCharge charge{run.usage.stage_cpu_ns};
+        std::error_code ec;
+        uintmax_t bytes = std::filesystem::file_size(run.video_path.empty() ? job.input_path : run.video_path, ec);
+        run.usage.bytes_in = ec ? 0 : static_cast<int64_t>(bytes);
+        if (!run.features) {
+            run.features = probe_job(job.input_path, run.processing);
+        }
+    }
+    if (run.features) {
+        run.predicted_wall_s = cost_model.predict_wall(*run.features);
+    }
+    if (!job.use_video_file) {
+        camera_ring_paused = true;
+        for (int i = 0; i < 40 && camera_ring_capturing.load(); ++i) {
+            co_await timers->sleep_for(std::chrono::milliseconds(50), *executor);
+        }
+    }
+    std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+    scheduled_runs.push_back(job.run);
+}
+
+// Crop stage: optional face crop, so the SDK decodes and preprocesses only the
+// face region. Runs before the job takes a container slot.
+Task crop_stage(std::shared_ptr<Job> job_ptr) {
+    Job& job = *job_ptr;
+    ContainerRun& run = *job.run;
+    run.source_path = job.input_path;
+    if (!job.use_video_file || !run.processing.roi_crop || run.preempted.load()) {
+        co_return;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(session_dir(run.session_id), ec);
+    std::string roi_path = session_dir(run.session_id) + "/roi.mp4";
+    RoiCropOptions roi_options;
+    roi_options.cascade_path = face_cascade_path;
+    roi_options.output_px = run.processing.roi_output_px;
+    RoiCropStats roi_stats;
+    bool cropped;
+    auto crop = [&]() {
+        ThreadCpuCharge charge{run.usage.stage_cpu_ns};
+        cropped = crop_video_to_face(job.input_path, roi_path, roi_options, roi_stats, &run.preempted);
     };
-    
-    json summary = {
-        {"heart_rate", calc_stats(heart_rates)},
-        {"breathing_rate", calc_stats(breathing_rates)},
-        {"readings_count", all_vitals_readings.size()},
-        {"all_readings", all_vitals_readings}
-    };
-    
-    return summary;
+    if (run.shadow_of.empty()) {
+        crop();
+    } else {
+        // At idle priority on its own thread, so a shadow crop never holds an
+        // executor worker; preempt_if_needed cancels it for a real job.
+        // The thread keeps the job; this frame stays suspended until done.
+        auto done = std::make_shared<AsyncEvent>();
+        std::thread([job_ptr, done, &crop, &cropped, &roi_stats]() {
+            set_thread_idle_priority();
+            try {
+                crop();
+            } catch (const std::exception& e) {
+                cropped = false;
+                roi_stats.error = e.what();
+            }
+            done->set();
+        }).detach();
+        co_await done->wait(*executor);
+    }
+    run.usage.frames_decoded += roi_stats.frames;
+    if (run.preempted.load()) {
+        co_return;
+    }
+    if (cropped) {
+        run.source_path = roi_path;
+        run.roi_crop = roi_crop_summary(roi_stats);
+        std::cout << "ROI crop for " << run.session_id << ": " << roi_stats.source_size.width << "x"
+                  << roi_stats.source_size.height << " -> " << roi_stats.output_size.width << "x"
+                  << roi_stats.output_size.height << " in " << roi_stats.seconds << "s" << std::endl;
+    } else {
+        std::cerr << "ROI crop skipped for " << run.session_id << ", using full frames: " << roi_stats.error << std::endl;
+        run.roi_crop = {{"applied", false}, {"error", roi_stats.error}};
+    }
 }
 
-#ifdef PRESAGE_SDK_AVAILABLE
-using namespace presage::smartspectra;
+// SDK stage: suspended while it waits for a pool slot and for the SDK
+Task sdk_stage(std::shared_ptr<Job> job) {
+    co_await run_container(job->api_key, job->run, job->use_video_file);
+}
 
-// Initialize Presage SDK
-bool initialize_sdk(const std::string& api_key) {
-    try {
-        google::InitGoogleLogging("presage_engine");
-        FLAGS_alsologtostderr = true;
-        sdk_initialized = true;
-        std::cout << "========================================" << std::endl;
-        std::cout << "✓ Presage SmartSpectra SDK INITIALIZED" << std::endl;
-        std::cout << "✓ Using SDK for vital sign extraction" << std::endl;
-        std::cout << "========================================" << std::endl;
-        return true;
-    } catch (const std::exception& e) {
-        std::cerr << "Failed to initialize SDK: " << e.what() << std::endl;
-        return false;
+// Persist stage: feed the cost model and archive a completed run. One at a
+// time, so cost model saves never interleave.
+Task persist_stage(std::shared_ptr<Job> job) {
+    ContainerRun& run = *job->run;
+    std::error_code ec;
+    std::filesystem::remove(session_dir(run.session_id) + "/roi.mp4", ec);  // The crop only lives as long as the run
+    if (!run.shadow_of.empty()) {
+        shadow_evaluation.finish(run);
+        co_return;
+    }
+    if (!run.completed) {
+        co_return;
+    }
+    if (run.features && run.cost.contains("wall_s")) {
+        cost_model.observe(*run.features, run.cost["wall_s"].get<double>(), run.cost.value("cpu_s", -1.0));
+        if (!write_json_file(cost_model_path, cost_model.to_json())) {
+            std::cerr << "Failed to save the cost model" << std::endl;
+        }
+    }
+    archive_run_result(run, "complete", "",
+                       {{"rest_integration", integration_latency_summary(run)},
+                        {"settings", run.processing.to_json()},
+                        {"cost", run.cost}});
+    shadow_evaluation.offer(*job);
+}
+
+// Notify stage: free the single-job slot and tell whoever is waiting
+Task notify_stage(std::shared_ptr<Job> job) {
+    {
+        std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+        submitted_runs.erase(std::remove(submitted_runs.begin(), submitted_runs.end(), job->run), submitted_runs.end());
+    }
+    if (job->on_done) {
+        job->on_done(*job);
+    }
+    if (job->single) {
+        camera_ring_paused = false;
+        // A resumed run hands the slot straight to the next one, so no request slips in between
+        if (!job->passes_slot_on) {
+            camera_running = false;
+        }
+    }
+    job->done.set_value();
+    co_return;
+}
+
+void build_job_pipeline(size_t threads) {
+    // SDK runs are suspended while they wait, so they take no executor threads
+    size_t sdk_slots = static_cast<size_t>(container_pool.size());
+    executor = std::make_unique<Executor>(threads);
+    timers = std::make_unique<TimerService>();
+    size_t workers = executor->size();
+    job_pipeline = std::make_unique<Pipeline<std::shared_ptr<Job>>>(*executor);
+    job_pipeline->add_stage("probe", 2, 64, probe_stage);
+    job_pipeline->add_stage("crop", std::max<size_t>(1, workers - 1), 16, crop_stage);
+    job_pipeline->add_stage("sdk", sdk_slots, 64, sdk_stage);
+    job_pipeline->add_stage("persist", 1, 16, persist_stage);
+    job_pipeline->add_stage("notify", 2, 16, notify_stage);
+}
+
+// Executor and per-stage pipeline counters, for /status
+json pipeline_status() {
+    Executor::Stats exec = executor->stats();
+    json stages = json::array();
+    for (const auto& stage : job_pipeline->stats()) {
+        stages.push_back({
+            {"name", stage.name},
+            {"concurrency", stage.concurrency},
+            {"capacity", stage.capacity},
+            {"queued", stage.queued},
+            {"queued_high_water", stage.queued_high_water},
+            {"running", stage.running},
+            {"parked", stage.parked},
+            {"processed", stage.processed},
+            {"busy_seconds", stage.busy_seconds}
+        });
     }
+    return {
+        {"executor", {
+            {"threads", exec.threads},
+            {"queued", exec.queued},
+            {"running", exec.running},
+            {"executed", exec.executed},
+            {"stolen", exec.stolen}
+        }},
+        {"stages", stages}
+    };
 }
 
-// Run camera test for 10 seconds
-void run_camera_test(const std::string& api_key) {
-    // Clear previous readings at start
+// Queue a job on the pipeline, waiting while the first stage is full. Video
+// jobs are checkpointed right away, so a restart resumes them even if it comes
+// before their SDK stage, and the next engine sees that this one owns them.
+std::shared_future<void> submit_job(const std::shared_ptr<Job>& job) {
+    ContainerRun& run = *job->run;
     {
-        std::lock_guard<std::mutex> lock(vitals_readings_mutex);
+        std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+        submitted_runs.push_back(job->run);
+    }
+    if (!run.video_path.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(session_dir(run.session_id), ec);
+        write_session_checkpoint(run);
+    }
+    job_pipeline->submit(job);
+    return job->finished;
+}
+
+// Wait for a job a client is waiting on; false if the engine handed it to
+// the next engine first (the client is told to poll the session instead)
+bool wait_for_job(const std::shared_future<void>& finished) {
+    while (finished.wait_for(std::chrono::milliseconds(200)) != std::future_status::ready) {
+        if (engine_handed_off.load()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 202 for a job that will finish in the next engine
+void respond_handed_off(httplib::Response& res, const std::string& session_id) {
+    res.status = 202;
+    json response = {
+        {"success", false},
+        {"session_id", session_id},
+        {"status", "processing"},
+        {"message", "Engine restarting; the session resumes in the new engine. Poll GET /sessions/" + session_id}
+    };
+    res.set_content(response.dump(), "application/json");
+}
+
+// Start the single-job run (the one /status and /live report on) on the
+// uploaded video or the camera. Video files are checkpointed to the session
+// archive while they process; a resumed run passes the point it picks up from
+// in the original video. Null if there is nothing to process.
+std::shared_ptr<Job> submit_single_job(const std::string& api_key, const std::string& session_id,
+                                       const ResumePoint* resume = nullptr,
+                                       const ProcessingSettings& processing = ProcessingSettings(),
+                                       std::function<void(Job&)> on_done = nullptr) {
+    // Clear previous readings at start (a resumed run keeps those restored from its checkpoint)
+    if (!resume) {
+        std::lock_guard<InstrumentedMutex> lock(vitals_readings_mutex);
         all_vitals_readings.clear();
     }
     
@@ -140,166 +3925,514 @@ void run_camera_test(const std::string& api_key) {
     if (!use_video_file && !check_camera_device()) {
         std::cerr << "No video file uploaded and camera check failed. Cannot proceed." << std::endl;
         std::cerr << "Upload a video file first using POST /upload" << std::endl;
-        return;
+        return nullptr;
+    }
+
+    // A resumed run reads the trimmed tail of the original video
+    std::string input_path = video_file_path;
+    if (resume && !resume->input_path.empty()) {
+        input_path = resume->input_path;
     }
 
     std::cout << "Starting video processing..." << std::endl;
     if (use_video_file) {
-        std::cout << "Using video file: " << video_file_path << std::endl;
+        std::cout << "Using video file: " << input_path << std::endl;
     } else {
-        std::cout << "Using camera device" << std::endl;
+        std::cout << "Using camera device " << camera_device_path << std::endl;
     }
     camera_running = true;
 
-    try {
-        // Create settings
-        container::settings::Settings<
-            container::settings::OperationMode::Continuous,
-            container::settings::IntegrationMode::Rest
-        > settings;
+    {
+        std::lock_guard<InstrumentedMutex> lock(vitals_mutex);
+        current_session_id = session_id;
+    }
 
-        // Configure video source
-        if (use_video_file) {
-            // Use video file input
-            settings.video_source.input_video_path = video_file_path;
-            settings.video_source.device_index = -1;  // Disable camera
-        } else {
-            // Use camera
-            settings.video_source.device_index = 0;
-            settings.video_source.input_video_path = "";
+    auto run = std::make_shared<ContainerRun>();
+    run->session_id = session_id;
+    run->video_path = video_file_path;
+    run->processing = processing;
+    run->frame_offset = resume ? resume->start_frame : 0;
+    run->first_frame_timestamp = resume ? resume->first_timestamp : -1;
+    if (resume) {
+        run->resume = *resume;
+        std::lock_guard<InstrumentedMutex> lock(vitals_readings_mutex);
+        run->readings = all_vitals_readings;
+    }
+    // Camera runs keep the ring fed while they hold the device (see probe_stage)
+    run->feeds_camera_ring = !use_video_file && camera_ring.enabled();
+
+    auto job = std::make_shared<Job>();
+    job->api_key = api_key;
+    job->run = run;
+    job->input_path = input_path;
+    job->use_video_file = use_video_file;
+    job->single = true;
+    job->on_done = std::move(on_done);
+    submit_job(job);
+    return job;
+}
+
+// Run the single job to completion; false if it was handed to the next engine instead
+bool run_single_job(const std::string& api_key, const std::string& session_id,
+                    const ResumePoint* resume = nullptr,
+                    const ProcessingSettings& processing = ProcessingSettings()) {
+    auto job = submit_single_job(api_key, session_id, resume, processing);
+    return !job || wait_for_job(job->finished);
+}
+
+// Copy a video from start_frame onwards so the SDK can pick up mid-file
+bool trim_video(const std::string& input_path, int64_t start_frame, const std::string& output_path) {
+    cv::VideoCapture capture(input_path);
+    if (!capture.isOpened()) {
+        return false;
+    }
+    double fps = capture.get(cv::CAP_PROP_FPS);
+    cv::Size frame_size(static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH)),
+                        static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT)));
+    for (int64_t i = 0; i < start_frame; ++i) {
+        if (!capture.grab()) {
+            return false;
         }
-        
-        settings.video_source.capture_width_px = 1280;
-        settings.video_source.capture_height_px = 720;
-        settings.video_source.codec = presage::camera::CaptureCodec::MJPG;
-        settings.video_source.auto_lock = true;
-        
-        settings.headless = true;  // No GUI in server mode
-        settings.enable_edge_metrics = true;
-        settings.verbosity_level = 1;
-        settings.continuous.preprocessed_data_buffer_duration_s = 0.5;
-        settings.integration.api_key = api_key;
+    }
+    cv::VideoWriter writer(output_path, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps, frame_size);
+    if (!writer.isOpened()) {
+        return false;
+    }
+    cv::Mat frame;
+    while (capture.read(frame)) {
+        writer.write(frame);
+    }
+    return true;
+}
 
-        // Create container
-        auto container = std::make_unique<container::CpuContinuousRestForegroundContainer>(settings);
+// Resume runs whose checkpoint outlived the engine process. Each restarts a
+// warm-up window before its checkpoint so the SDK has settled by the time new
+// readings are kept; readings from before the checkpoint come from the archive.
+// They go through the single-job slot one after another: resume_loop takes
+// the slot to start the chain, each resumed job's notify stage queues the next
+// checkpoint as an executor task, which inherits the slot, and the last one in
+// the chain frees it.
+std::atomic<bool> resume_chain_running{false};
 
-        // Metrics callback - store all readings from REAL Presage SDK
-        auto status = container->SetOnCoreMetricsOutput(
-            [](const presage::physiology::MetricsBuffer& metrics, int64_t timestamp) {
-                std::lock_guard<std::mutex> lock(vitals_readings_mutex);
-                
-                json reading;
-                reading["timestamp_ms"] = timestamp;
-                reading["source"] = "presage_sdk";  
-                
-                // Extract heart rate from Presage SDK
-                if (!metrics.pulse().rate().empty()) {
-                    float pulse = metrics.pulse().rate().rbegin()->value();
-                    reading["heart_rate_bpm"] = pulse;
-                    std::cout << "[Presage SDK] Heart Rate: " << pulse << " BPM" << std::endl;
-                }
-                
-                // Extract breathing rate from Presage SDK
-                if (!metrics.breathing().rate().empty()) {
-                    float breathing = metrics.breathing().rate().rbegin()->value();
-                    reading["breathing_rate_bpm"] = breathing;
-                    std::cout << "[Presage SDK] Breathing Rate: " << breathing << " breaths/min" << std::endl;
-                }
-                
-                // Store this reading
-                all_vitals_readings.push_back(reading);
-                
-                // Also update latest for /live endpoint
-                {
-                    std::lock_guard<std::mutex> lock2(vitals_mutex);
-                    latest_vitals = reading;
+void resume_from(const std::string& api_key, std::shared_ptr<const std::vector<std::string>> checkpoint_paths,
+                 size_t next) {
+    std::error_code ec;
+    for (; next < checkpoint_paths->size(); ++next) {
+        const std::string& checkpoint_path = (*checkpoint_paths)[next];
+        auto resume_rest = [api_key, checkpoint_paths, next](Job& job) {
+            job.passes_slot_on = true;
+            executor->submit([api_key, checkpoint_paths, next]() { resume_from(api_key, checkpoint_paths, next + 1); });
+        };
+        json checkpoint;
+        if (!read_json_file(checkpoint_path, checkpoint)) {
+            continue;
+        }
+        std::string session_id = checkpoint.value("session_id", "");
+        std::string original_path = checkpoint.value("video_path", "");
+        if (session_id.empty()) {
+            continue;  // Nothing to resume it into, and session_dir("") is the archive root
+        }
+
+        // Readings written after the checkpoint will be produced again by the resumed run
+        uint64_t readings_count = checkpoint.value("readings_count", uint64_t{0});
+        ReadingsStore::truncate(session_dir(session_id), readings_count);
+        {
+            std::lock_guard<InstrumentedMutex> lock(vitals_readings_mutex);
+            all_vitals_readings.clear();
+            for (const auto& row : ReadingsStore::read(session_dir(session_id), 0, readings_count)) {
+                all_vitals_readings.push_back(row_to_reading(row));
+            }
+        }
+        {
+            std::lock_guard<InstrumentedMutex> lock(vitals_mutex);
+            video_file_path = original_path;
+        }
+        if (original_path.empty() || !std::filesystem::exists(original_path, ec)) {
+            std::cerr << "Cannot resume " << session_id << ": video " << original_path << " no longer exists" << std::endl;
+            archive_session_result(session_id, original_path, "failed", "Original video no longer available");
+            continue;
+        }
+
+        ProcessingSettings processing;
+        std::string settings_error;
+        if (checkpoint.contains("settings") && !processing.update_from_json(checkpoint["settings"], settings_error)) {
+            std::cerr << "Ignoring checkpointed settings for " << session_id << ": " << settings_error << std::endl;
+            processing = ProcessingSettings();
+        }
+
+        int64_t frame_offset = checkpoint.value("frame_offset", int64_t{0});
+        int64_t first_timestamp = checkpoint.value("first_frame_timestamp", int64_t{-1});
+        int64_t frame_timestamp = checkpoint.value("frame_timestamp", int64_t{0});
+
+        if (frame_offset < 2 || first_timestamp < 0) {
+            // Interrupted before any real progress - just process it again
+            std::cout << "Restarting interrupted session " << session_id << " from the beginning" << std::endl;
+            if (submit_single_job(api_key, session_id, nullptr, processing, resume_rest)) {
+                return;
+            }
+            continue;
+        }
+
+        double fps = cv::VideoCapture(original_path).get(cv::CAP_PROP_FPS);
+        if (fps <= 0) {
+            fps = 30.0;
+        }
+        double timestamp_per_frame = static_cast<double>(frame_timestamp - first_timestamp) / (frame_offset - 1);
+        int64_t warmup_frames = static_cast<int64_t>(resume_warmup_s * fps);
+
+        ResumePoint resume;
+        resume.start_frame = std::max<int64_t>(0, frame_offset - warmup_frames);
+        resume.checkpoint_frame = frame_offset;
+        resume.checkpoint_timestamp = frame_timestamp;
+        resume.first_timestamp = first_timestamp;
+        if (resume.start_frame > 0) {
+            resume.input_path = session_dir(session_id) + "/resume.mp4";
+            if (!trim_video(original_path, resume.start_frame, resume.input_path)) {
+                std::cerr << "Failed to trim " << original_path << ", resuming from the first frame" << std::endl;
+                resume.start_frame = 0;
+                resume.input_path.clear();
+            }
+        }
+        resume.start_timestamp = first_timestamp + static_cast<int64_t>(resume.start_frame * timestamp_per_frame);
+
+        std::cout << "Resuming session " << session_id << " at frame " << frame_offset
+                  << " (SDK warm-up from frame " << resume.start_frame << ")" << std::endl;
+        std::string trimmed_path = resume.input_path;
+        auto cleanup_and_resume_rest = [trimmed_path, resume_rest](Job& job) {
+            if (!trimmed_path.empty()) {
+                std::error_code ec;
+                std::filesystem::remove(trimmed_path, ec);
+            }
+            resume_rest(job);
+        };
+        if (submit_single_job(api_key, session_id, &resume, processing, cleanup_and_resume_rest)) {
+            return;
+        }
+    }
+    resume_chain_running = false;
+    camera_running = false;
+}
+
+// Resume runs whose checkpoint outlived the engine that owned it: after a
+// crash or restart at once, after a handoff once the previous engine - which
+// may still be updating them - has exited. The previous engine keeps taking
+// jobs until it is told to drain, and checkpoints the last of them at its
+// drain deadline, so checkpoints are rescanned until a while after the
+// longest drain and for as long as another engine owns any.
+void resume_loop(const std::string& api_key) {
+    std::set<std::string> queued;        // Checkpoints already passed to resume_from
+    std::set<pid_t> reported;            // Engines we said we were waiting for
+    std::vector<std::string> pending;
+    int64_t watch_until_ms = steady_now_ms() + (drain_timeout_s + 60) * 1000;
+    while (!engine_stopping.load()) {
+        bool owners_alive = false;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(session_archive_dir, ec)) {
+            std::string checkpoint_path = entry.path().string() + "/checkpoint.json";
+            json checkpoint;
+            if (queued.count(checkpoint_path) || !read_json_file(checkpoint_path, checkpoint)) {
+                continue;
+            }
+            CheckpointOwner owner = checkpoint_owner(checkpoint);
+            if (owner == CheckpointOwner::Ours) {
+                continue;
+            }
+            if (owner == CheckpointOwner::LiveEngine) {
+                owners_alive = true;
+                pid_t pid = static_cast<pid_t>(checkpoint.value("owner_pid", int64_t{0}));
+                if (reported.insert(pid).second) {
+                    std::cout << "Waiting for engine " << pid << " to drain before resuming its sessions" << std::endl;
                 }
-                
-                return absl::OkStatus();
+                continue;
             }
-        );
+            queued.insert(checkpoint_path);
+            pending.push_back(checkpoint_path);
+        }
 
-        if (!status.ok()) {
-            std::cerr << "Failed to set metrics callback: " << status.message() << std::endl;
-            camera_running = false;
+        // Start a chain once the last one and any single job are done
+        bool slot_taken = false;
+        if (!pending.empty() && !resume_chain_running.load() && camera_running.compare_exchange_strong(slot_taken, true)) {
+            resume_chain_running = true;
+            std::sort(pending.begin(), pending.end());
+            auto checkpoint_paths = std::make_shared<const std::vector<std::string>>(std::move(pending));
+            pending.clear();
+            executor->submit([api_key, checkpoint_paths]() { resume_from(api_key, checkpoint_paths, 0); });
+        }
+
+        if (pending.empty() && !owners_alive && steady_now_ms() >= watch_until_ms) {
             return;
         }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}
 
-        // Status callback
-        container->SetOnStatusChange(
-            [](presage::physiology::StatusValue imaging_status) {
-                std::cout << "Status: " << presage::physiology::GetStatusDescription(imaging_status.value()) << std::endl;
-                return absl::OkStatus();
+// Checkpoint every unfinished video run for the next engine, from those still
+// waiting to be probed to those in the SDK; camera runs cannot be resumed and
+// are archived as failed. Returns the runs handed off.
+size_t hand_off_running_jobs() {
+    std::vector<std::shared_ptr<ContainerRun>> runs;
+    {
+        std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+        runs = submitted_runs;
+    }
+    size_t handed_off = 0;
+    for (const auto& run : runs) {
+        if (run->finished.load() || run->archived.load() || !run->shadow_of.empty()) {
+            continue;  // Being archived, or not worth resuming
+        }
+        if (run->video_path.empty()) {
+            archive_run_result(*run, "failed", "Engine restarted during a camera run");
+            continue;
+        }
+        write_session_checkpoint(*run);
+        handed_off++;
+    }
+    return handed_off;
+}
+
+// SIGTERM or SIGINT drains the engine for a deploy. Both listeners close, so
+// the next engine (bound to the same ports with SO_REUSEPORT) takes new
+// connections, while jobs in flight get PRESAGE_DRAIN_TIMEOUT_S to finish and
+// streams keep flowing. If they finish in time, main shuts down as usual.
+// Otherwise unfinished video runs are checkpointed, waiting clients get a 202,
+// streams are flushed and the process exits; the next engine resumes the runs
+// once this one is gone (see resume_loop). A second signal
+// ends the wait at once.
+void signal_loop(const std::function<void()>& stop_listening) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    timespec tick{1, 0};
+    int64_t deadline_ms = 0;
+    while (!engine_stopping.load()) {
+        int signal = sigtimedwait(&signals, nullptr, &tick);
+        if (signal > 0 && !engine_draining.exchange(true)) {
+            std::cout << "Received " << strsignal(signal) << ", draining for up to " << drain_timeout_s
+                      << "s" << std::endl;
+            stop_listening();
+            stream_server.stop_accepting();
+            shadow_evaluation.stop();
+            deadline_ms = steady_now_ms() + drain_timeout_s * 1000;
+        } else if (signal > 0) {
+            deadline_ms = 0;
+        }
+        if (!engine_draining.load() || steady_now_ms() < deadline_ms ||
+            job_pipeline->wait_idle_for(std::chrono::milliseconds(0))) {
+            continue;
+        }
+        size_t handed_off = hand_off_running_jobs();
+        engine_handed_off = true;
+        std::cout << "Drain ended with jobs in flight; " << handed_off << " runs checkpointed for the next engine"
+                  << std::endl;
+        std::this_thread::sleep_for(std::chrono::seconds(1));  // Waiting clients get their 202
+        stream_server.stop();
+        std::cout.flush();
+        std::_Exit(0);
+    }
+}
+
+
+// One video of a POST /batch request
+struct BatchItem {
+    std::string video_file;       // Name in the uploads directory
+    std::string path;
+    std::string client_filename;  // Multipart filename, if uploaded with the batch
+};
+
+// Archive a batch the engine handed off before it finished: the videos done so
+// far, and the sessions still running, which resume in the next engine
+json write_handed_off_batch(const std::string& batch_id, const std::vector<BatchItem>& items,
+                            const std::vector<std::string>& session_ids, const ProcessingSettings& processing,
+                            std::mutex& results_mutex, const std::vector<json>& results) {
+    json videos = json::array();
+    json handed_off = json::array();
+    {
+        std::lock_guard<std::mutex> lock(results_mutex);
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (!results[i].is_null()) {
+                videos.push_back(results[i]);
+                continue;
             }
-        );
+            json video = {
+                {"video_file", items[i].video_file},
+                {"session_id", session_ids[i]},
+                {"status", "processing"}
+            };
+            if (!items[i].client_filename.empty()) {
+                video["client_filename"] = items[i].client_filename;
+            }
+            videos.push_back(video);
+            handed_off.push_back(session_ids[i]);
+        }
+    }
+    json summary = {
+        {"batch_id", batch_id},
+        {"status", "handed_off"},
+        {"settings", processing.to_json()},
+        {"videos", videos},
+        {"handed_off_sessions", handed_off},
+        {"updated_at", static_cast<int64_t>(std::time(nullptr))}
+    };
+    std::string dir = session_dir(batch_id);
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (!write_json_file(dir + "/summary.json", summary)) {
+        std::cerr << "Failed to write summary for " << batch_id << std::endl;
+    }
+    return summary;
+}
 
-        // Initialize
-        if (auto init_status = container->Initialize(); !init_status.ok()) {
-            std::cerr << "Failed to initialize container: " << init_status.message() << std::endl;
-            camera_running = false;
-            return;
-        }
+// Process a batch on the container pool, one session per video, and archive
+// the per-video results plus an incident-level aggregate under batch_id.
+// With a free slot per video the batch takes about as long as its longest video.
+// Videos start longest-predicted first, so a long clip never starts last.
+// If the engine hands its jobs off while the batch runs, the summary is
+// written as it stands with status "handed_off", and lists the sessions that
+// finish in the next engine.
+json run_batch(const std::string& api_key, const std::string& batch_id, const std::vector<BatchItem>& items,
+               const ProcessingSettings& processing) {
+    auto started = std::chrono::steady_clock::now();
+    // Shared with the jobs' on_done, which may still run after a handoff returned early
+    struct Progress {
+        std::mutex mutex;
+        std::vector<json> results;
+        std::vector<std::vector<json>> readings;
+    };
+    auto progress = std::make_shared<Progress>();
+    progress->results.resize(items.size());
+    progress->readings.resize(items.size());
+    std::vector<std::string> session_ids(items.size());
 
-        std::cout << "Video source initialized. Processing..." << std::endl;
+    std::vector<std::optional<JobFeatures>> features(items.size());
+    std::vector<double> predicted(items.size(), 0.0);
+    std::vector<size_t> order(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        features[i] = probe_job(items[i].path, processing);
+        predicted[i] = features[i] ? cost_model.predict_wall(*features[i]) : 0.0;
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&predicted](size_t a, size_t b) { return predicted[a] > predicted[b]; });
 
-        // Run processing in a separate thread
-        std::thread run_thread([&container, use_video_file]() {
-            container->Run();
-        });
+    // Makespan of that order on an otherwise idle pool
+    std::vector<double> slots(static_cast<size_t>(std::min<int64_t>(container_pool.size(), items.size())), 0.0);
+    for (size_t i : order) {
+        *std::min_element(slots.begin(), slots.end()) += predicted[i];
+    }
+    double predicted_makespan = *std::max_element(slots.begin(), slots.end());
+    // One pipeline job per video; the sdk stage runs as many as the pool has slots
+    std::vector<std::shared_future<void>> done;
+    for (size_t i : order) {
+        auto run = std::make_shared<ContainerRun>();
+        run->session_id = make_session_id();
+        session_ids[i] = run->session_id;
+        run->video_path = items[i].path;
+        run->processing = processing;
+        run->feeds_live = false;
+        run->features = features[i];
 
-        if (use_video_file) {
-            // For video files, let it process the entire video
-            // Wait for thread to complete (video ends)
-            run_thread.join();
-        } else {
-            // For camera, run for 10 seconds
-            std::this_thread::sleep_for(std::chrono::seconds(10));
-            // Note: Container will continue until video ends or is stopped
-            run_thread.join();
+        auto job = std::make_shared<Job>();
+        job->api_key = api_key;
+        job->run = run;
+        job->input_path = items[i].path;
+        auto job_started = std::chrono::steady_clock::now();
+        job->on_done = [progress, item = items[i], predicted_s = predicted[i], i, job_started](Job& finished) {
+            ContainerRun& run = *finished.run;
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job_started).count();
+            json result = {
+                {"video_file", item.video_file},
+                {"session_id", run.session_id},
+                {"status", run.completed ? "complete" : "failed"},
+                {"processing_seconds", seconds},
+                {"predicted_seconds", predicted_s}
+            };
+            if (!item.client_filename.empty()) {
+                result["client_filename"] = item.client_filename;
+            }
+            std::vector<json> run_readings;
+            {
+                std::lock_guard<std::mutex> lock(run.readings_mutex);
+                run_readings = run.readings;
+            }
+            json vitals = calculate_vitals_summary(run_readings);
+            vitals.erase("all_readings");
+            result["vitals"] = vitals;
+            result["usage"] = usage_summary(run);
+            json archived;
+            if (!run.completed && read_json_file(session_dir(run.session_id) + "/summary.json", archived) && archived.contains("error")) {
+                result["error"] = archived["error"];
+            }
+            std::lock_guard<std::mutex> lock(progress->mutex);
+            progress->results[i] = result;
+            progress->readings[i] = std::move(run_readings);
+        };
+        done.push_back(submit_job(job));
+    }
+    for (const auto& finished : done) {
+        if (!wait_for_job(finished)) {
+            return write_handed_off_batch(batch_id, items, session_ids, processing, progress->mutex, progress->results);
         }
-
-        std::cout << "Processing completed." << std::endl;
-        camera_running = false;
-
-    } catch (const std::exception& e) {
-        std::cerr << "Error during camera test: " << e.what() << std::endl;
-        camera_running = false;
     }
-}
-
-#else
-// SDK not available - allow server to start for SDK installation
-bool initialize_sdk(const std::string& api_key) {
-    std::cerr << "========================================" << std::endl;
-    std::cerr << "⚠️  WARNING: Presage SmartSpectra SDK NOT AVAILABLE" << std::endl;
-    std::cerr << "⚠️  Application compiled without SDK support" << std::endl;
-    std::cerr << "========================================" << std::endl;
-    std::cerr << "To use the real Presage SDK:" << std::endl;
-    std::cerr << "1. Install libsmartspectra-dev package" << std::endl;
-    std::cerr << "2. Ensure SDK libraries are in /usr/lib or /usr/local/lib" << std::endl;
-    std::cerr << "3. Rebuild the application" << std::endl;
-    std::cerr << "========================================" << std::endl;
-    std::cerr << "Server will start in limited mode. Install SDK and rebuild to enable full functionality." << std::endl;
-    sdk_initialized = false;  // Mark as not initialized, but allow server to start
-    return true;  // Allow server to start so SDK can be installed
-}
+    const std::vector<json>& results = progress->results;
+    const std::vector<std::vector<json>>& readings = progress->readings;
 
-void run_camera_test(const std::string& api_key) {
-    std::cerr << "❌ ERROR: Cannot process video - Presage SDK not available" << std::endl;
-    std::cerr << "Install the Presage SmartSpectra SDK to extract real vital signs" << std::endl;
-    // Clear any stale data
-    {
-        std::lock_guard<std::mutex> lock(vitals_readings_mutex);
-        all_vitals_readings.clear();
+    // Incident-level view: every reading from every video, plus timing
+    size_t completed = 0;
+    double serial_seconds = 0.0;
+    std::vector<json> all_readings;
+    json usage = json::object();  // Summed over the videos, for per-incident costs
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (results[i]["status"] == "complete") {
+            completed++;
+        }
+        serial_seconds += results[i]["processing_seconds"].get<double>();
+        for (const auto& [key, value] : results[i]["usage"].items()) {
+            if (key.find("peak") != std::string::npos || key == "cpu_s_per_video_s") {
+                continue;
+            }
+            if (value.is_number_integer()) {
+                usage[key] = usage.value(key, int64_t{0}) + value.get<int64_t>();
+            } else {
+                usage[key] = usage.value(key, 0.0) + value.get<double>();
+            }
+        }
+        all_readings.insert(all_readings.end(), readings[i].begin(), readings[i].end());
     }
-    {
-        std::lock_guard<std::mutex> lock2(vitals_mutex);
-        latest_vitals = json::object();
+    json aggregate = calculate_vitals_summary(all_readings);
+    aggregate.erase("all_readings");
+    aggregate["videos"] = items.size();
+    aggregate["videos_complete"] = completed;
+    aggregate["videos_failed"] = items.size() - completed;
+    aggregate["wall_seconds"] = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    aggregate["serial_seconds"] = serial_seconds;
+    aggregate["predicted_wall_seconds"] = predicted_makespan;
+    aggregate["usage"] = usage;
+
+    json summary = {
+        {"batch_id", batch_id},
+        {"status", completed == items.size() ? "complete" : completed > 0 ? "partial" : "failed"},
+        {"settings", processing.to_json()},
+        {"videos", results},
+        {"aggregate", aggregate},
+        {"completed_at", static_cast<int64_t>(std::time(nullptr))}
+    };
+    std::string dir = session_dir(batch_id);
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (!write_json_file(dir + "/summary.json", summary)) {
+        std::cerr << "Failed to write summary for " << batch_id << std::endl;
     }
+    return summary;
 }
-#endif
 
 int main(int argc, char** argv) {
+    // Every thread inherits this mask; signal_loop takes the signals synchronously
+    sigset_t drain_signals;
+    sigemptyset(&drain_signals);
+    sigaddset(&drain_signals, SIGTERM);
+    sigaddset(&drain_signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &drain_signals, nullptr);
+
     // Get API key from environment or argument
     std::string api_key;
     if (argc > 1) {
@@ -313,10 +4446,77 @@ int main(int argc, char** argv) {
         api_key = "";  // Continue anyway for testing
     }
 
+    // Route the SDK's REST integration through a proxy, e.g. the rest_standin tool
+    // with injected latency and failures. The SDK talks HTTPS via libcurl, which
+    // honours the standard proxy variables.
+    if (const char* rest_proxy = std::getenv("PRESAGE_REST_PROXY"); rest_proxy && *rest_proxy) {
+        setenv("HTTPS_PROXY", rest_proxy, 1);
+        setenv("https_proxy", rest_proxy, 1);
+        std::cout << "REST integration routed through proxy " << rest_proxy << std::endl;
+    }
+
     // Initialize SDK (allow server to start even if SDK not available)
     initialize_sdk(api_key);
     // Note: Server will start even if SDK is not available, allowing SDK installation
 
+    if (const char* device = std::getenv("PRESAGE_CAMERA_DEVICE"); device && *device) {
+        camera_device_path = device;
+    }
+    checkpoint_interval_s = std::max<int64_t>(1, env_int("PRESAGE_CHECKPOINT_INTERVAL_S", checkpoint_interval_s));
+    resume_warmup_s = std::max<int64_t>(0, env_int("PRESAGE_RESUME_WARMUP_S", resume_warmup_s));
+    stall_timeout_s = std::max<int64_t>(5, env_int("PRESAGE_STALL_TIMEOUT_S", stall_timeout_s));
+    drain_timeout_s = std::max<int64_t>(0, env_int("PRESAGE_DRAIN_TIMEOUT_S", drain_timeout_s));
+    int stream_port = static_cast<int>(env_int("PRESAGE_STREAM_PORT", 8081));
+    if (env_int("PRESAGE_METRICS_STREAM", 0) != 0) {
+        stream_server.enable_metrics_stream();
+    }
+    container_pool.resize(static_cast<int>(env_int("PRESAGE_CONTAINER_POOL_SIZE", 4)));
+    build_job_pipeline(static_cast<size_t>(std::max<int64_t>(
+        1, env_int("PRESAGE_EXECUTOR_THREADS", std::max(1u, std::thread::hardware_concurrency())))));
+    batch_max_videos = std::max<int64_t>(1, env_int("PRESAGE_BATCH_MAX_VIDEOS", batch_max_videos));
+    roi_crop_default = env_int("PRESAGE_ROI_CROP", 0) != 0;
+    camera_ring.configure(env_int("PRESAGE_CAMERA_RING_S", 30),
+                          static_cast<size_t>(std::max<int64_t>(1, env_int("PRESAGE_CAMERA_RING_MB", 128))) * 1024 * 1024,
+                          static_cast<int>(env_int("PRESAGE_CAMERA_RING_QUALITY", 80)));
+    camera_capture_options.width = static_cast<int>(env_int("PRESAGE_CAMERA_WIDTH", camera_capture_options.width));
+    camera_capture_options.height = static_cast<int>(env_int("PRESAGE_CAMERA_HEIGHT", camera_capture_options.height));
+    camera_capture_options.fps = static_cast<int>(env_int("PRESAGE_CAMERA_FPS", camera_capture_options.fps));
+    camera_capture_options.buffers = static_cast<int>(env_int("PRESAGE_CAMERA_BUFFERS", camera_capture_options.buffers));
+    if (const char* formats = std::getenv("PRESAGE_CAMERA_FORMATS"); formats && *formats) {
+        // Comma-separated, preferred first (e.g. "yuyv,mjpg")
+        std::vector<uint32_t> parsed;
+        std::stringstream list(formats);
+        std::string name;
+        while (std::getline(list, name, ',')) {
+            if (uint32_t format = V4l2Capture::parse_format(name)) {
+                parsed.push_back(format);
+            } else {
+                std::cerr << "Warning: ignoring unknown camera format " << name << std::endl;
+            }
+        }
+        if (!parsed.empty()) {
+            camera_capture_options.formats = parsed;
+        }
+    }
+    if (const char* cascade = std::getenv("PRESAGE_FACE_CASCADE"); cascade && *cascade) {
+        face_cascade_path = cascade;
+    }
+    if (const char* percent = std::getenv("PRESAGE_SHADOW_PERCENT"); percent && *percent) {
+        const char* settings = std::getenv("PRESAGE_SHADOW_SETTINGS");
+        json overrides = json::parse(settings && *settings ? settings : "{}", nullptr, false);
+        std::string error = overrides.is_discarded() ? "PRESAGE_SHADOW_SETTINGS is not valid JSON" : "";
+        if (!error.empty() || !shadow_evaluation.configure(std::atof(percent), overrides, error)) {
+            std::cerr << "Warning: shadow evaluation disabled: " << error << std::endl;
+        }
+    }
+    std::cout << "Container pool: " << container_pool.size() << " slots, executor: " << executor->size()
+              << " threads" << std::endl;
+    json saved_cost_model;
+    if (read_json_file(cost_model_path, saved_cost_model)) {
+        cost_model.from_json(saved_cost_model);
+        std::cout << "Cost model loaded (" << cost_model.samples() << " jobs)" << std::endl;
+    }
+
     // Check camera
     bool camera_available = check_camera_device();
     std::cout << "Camera device status: " << (camera_available ? "Available" : "Not Available") << std::endl;
@@ -331,6 +4531,26 @@ int main(int argc, char** argv) {
         res.set_header("Access-Control-Allow-Headers", "Content-Type");
     };
 
+    // Name httplib worker threads on their first request, for profiles
+    svr.set_pre_routing_handler([](const httplib::Request&, httplib::Response&) {
+        static thread_local bool thread_named = false;
+        if (!thread_named) {
+            set_thread_name("http-worker");
+            thread_named = true;
+        }
+        return httplib::Server::HandlerResponse::Unhandled;
+    });
+
+    // Count what /sessions/{id}/... routes send against that session's usage
+    svr.set_logger([](const httplib::Request& req, const httplib::Response& res) {
+        const std::string prefix = "/sessions/";
+        if (req.path.compare(0, prefix.size(), prefix) == 0 && req.path.size() > prefix.size()) {
+            size_t end = req.path.find('/', prefix.size());
+            session_egress.add(req.path.substr(prefix.size(), end == std::string::npos ? end : end - prefix.size()),
+                               static_cast<int64_t>(res.body.size()));
+        }
+    });
+
     // Handle OPTIONS preflight requests for all routes
     svr.Options(".*", [set_cors_headers](const httplib::Request&, httplib::Response& res) {
         set_cors_headers(res);
@@ -348,228 +4568,1015 @@ int main(int argc, char** argv) {
         std::string sdk_status = "Presage SmartSpectra SDK is NOT AVAILABLE (compiled without SDK)";
 #endif
         json response = {
-            {"status", sdk_initialized.load() ? "SDK Ready" : "SDK Not Initialized"},
-            {"sdk_available", sdk_available},
-            {"sdk_status", sdk_status},
-            {"sdk_initialized", sdk_initialized.load()},
-            {"camera_running", camera_running.load()},
-            {"camera_available", check_camera_device()},
-            {"video_file_uploaded", !video_file_path.empty()},
-            {"video_file_path", video_file_path.empty() ? "" : video_file_path},
-            {"readings_count", all_vitals_readings.size()}
+            {"status", sdk_initialized.load() ? "SDK Ready" : "SDK Not Initialized"},
+            {"sdk_available", sdk_available},
+            {"sdk_status", sdk_status},
+            {"sdk_initialized", sdk_initialized.load()},
+            {"camera_running", camera_running.load()},
+            {"camera_available", check_camera_device()},
+            {"camera_device", camera_device_path},
+            {"video_file_uploaded", !video_file_path.empty()},
+            {"video_file_path", video_file_path.empty() ? "" : video_file_path},
+            {"readings_count", all_vitals_readings.size()},
+            {"containers_recycled", containers_recycled.load()},
+            {"container_pool", {
+                {"size", container_pool.size()},
+                {"busy", container_pool.busy()},
+                {"waiting", container_pool.waiting()}
+            }},
+            {"camera_ring", camera_ring.stats()},
+            {"camera_capture", camera_capture_status()},
+            {"pipeline", pipeline_status()},
+            {"queue", {
+                {"estimated_wait_seconds", schedule_estimate()}
+            }},
+            {"cost_model", {
+                {"samples", cost_model.samples()},
+                {"wall_mape", cost_model.wall_mape()},
+                {"cpu_mape", cost_model.cpu_mape()}
+            }}
+        };
+        res.set_content(response.dump(), "application/json");
+    });
+
+    // POST /process-video - Upload video, process, and return vitals JSON
+    // Accepts the video as the raw body or as multipart/form-data, with optional
+    // "settings" (JSON, see ProcessingSettings) and "session_id" fields
+    svr.Post("/process-video", [api_key, set_cors_headers](const httplib::Request& req, httplib::Response& res,
+                                                           const httplib::ContentReader& content_reader) {
+        set_cors_headers(res);
+        if (camera_running.load()) {
+            res.status = 409;
+            res.set_header("Retry-After", std::to_string(single_job_retry_after()));
+            json response = {{"error", "Processing already in progress. Wait for current processing to complete."}};
+            res.set_content(response.dump(), "application/json");
+            return;
+        }
+        
+        // Stream the upload straight to disk
+        std::string upload_dir = "/app/uploads";
+        
+        // Create uploads directory if it doesn't exist
+        system(("mkdir -p " + upload_dir).c_str());
+        
+        UploadResult upload = receive_upload(req, content_reader, upload_dir);
+        if (!upload.ok) {
+            res.status = upload.error == "Failed to save uploaded file" ? 500 : 400;
+            json response = {
+                {"error", upload.error},
+                {"hint", "Send video file as raw binary data in POST body, or use multipart/form-data"}
+            };
+            res.set_content(response.dump(), "application/json");
+            return;
+        }
+        
+        std::string filename = upload.files.front().filename;
+        std::string filepath = upload.files.front().path;
+        std::cout << "Video file saved: " << filepath << " (" << upload.files.front().bytes << " bytes)" << std::endl;
+
+        ProcessingSettings processing;
+        if (upload.fields.count("settings")) {
+            std::string error;
+            json overrides = json::parse(upload.fields["settings"], nullptr, false);
+            if (overrides.is_discarded()) {
+                error = "settings is not valid JSON";
+            }
+            if (!error.empty() || !processing.update_from_json(overrides, error)) {
+                std::error_code ec;
+                std::filesystem::remove(filepath, ec);
+                res.status = 400;
+                json response = {{"error", error}};
+                res.set_content(response.dump(), "application/json");
+                return;
+            }
+        }
+
+        // Clients may name the session (e.g. to correlate with their own records)
+        std::string session_id = make_session_id();
+        if (upload.fields.count("session_id")) {
+            const std::string& requested = upload.fields["session_id"];
+            std::error_code ec;
+            bool valid = !requested.empty() && requested.size() <= 64 &&
+                         std::all_of(requested.begin(), requested.end(), [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; });
+            if (!valid || std::filesystem::exists(session_dir(requested), ec)) {
+                std::filesystem::remove(filepath, ec);
+                res.status = valid ? 409 : 400;
+                json response = {{"error", valid ? "session_id already exists" : "session_id must be 1-64 letters, digits or underscores"}};
+                res.set_content(response.dump(), "application/json");
+                return;
+            }
+            session_id = requested;
+        }
+        
+        // Clear previous readings
+        {
+            std::lock_guard<InstrumentedMutex> lock(vitals_readings_mutex);
+            all_vitals_readings.clear();
+        }
+        
+        // Update global video file path
+        {
+            std::lock_guard<InstrumentedMutex> lock(vitals_mutex);
+            video_file_path = filepath;
+        }
+        
+        // Process video synchronously using Presage SDK
+        std::cout << "Processing video with Presage SmartSpectra SDK to extract REAL vitals..." << std::endl;
+        if (!run_single_job(api_key, session_id, nullptr, processing)) {
+            respond_handed_off(res, session_id);
+            return;
+        }
+        
+        // Calculate and return vitals summary from SDK data
+        json vitals_summary = calculate_vitals_summary();
+        
+        // Check if we got any data
+        if (vitals_summary.empty() || vitals_summary["readings_count"] == 0) {
+            res.status = 500;
+            json error_response = {
+                {"success", false},
+                {"error", "No vitals data extracted from video"},
+                {"message", "Presage SDK did not return any vital sign readings. Check video quality and ensure face is visible."},
+                {"video_file", filename},
+                {"session_id", session_id}
+            };
+            res.set_content(error_response.dump(), "application/json");
+            session_egress.add(session_id, static_cast<int64_t>(res.body.size()));
+            return;
+        }
+        
+        json archived;
+        read_json_file(session_dir(session_id) + "/summary.json", archived);
+
+        json response = {
+            {"success", true},
+            {"video_file", filename},
+            {"session_id", session_id},
+            {"settings", processing.to_json()},
+            {"rest_integration", archived.value("rest_integration", json::object())},
+            {"usage", archived.value("usage", json::object())},
+            {"vitals", vitals_summary},
+            {"processing_complete", true},
+            {"data_source", "presage_sdk"},
+            {"note", "Vitals extracted using Presage SmartSpectra SDK"}
+        };
+        
+        res.set_content(response.dump(), "application/json");
+        session_egress.add(session_id, static_cast<int64_t>(res.body.size()));
+    });
+
+    // POST /upload - Upload MP4 video file (legacy endpoint)
+    svr.Post("/upload", [set_cors_headers](const httplib::Request& req, httplib::Response& res,
+                                           const httplib::ContentReader& content_reader) {
+        set_cors_headers(res);
+        if (camera_running.load()) {
+            res.status = 409;  // Conflict
+            res.set_header("Retry-After", std::to_string(single_job_retry_after()));
+            json response = {{"error", "Processing already running. Wait for it to complete."}};
+            res.set_content(response.dump(), "application/json");
+            return;
+        }
+
+        // Save to /app/uploads directory
+        std::string upload_dir = "/app/uploads";
+        
+        // Create uploads directory if it doesn't exist
+        system(("mkdir -p " + upload_dir).c_str());
+        
+        // Accept file as raw binary data or multipart/form-data, streamed to disk
+        UploadResult upload = receive_upload(req, content_reader, upload_dir);
+        if (!upload.ok) {
+            res.status = upload.error == "Failed to save uploaded file" ? 500 : 400;
+            json response = {
+                {"error", upload.error},
+                {"hint", "Send video file as raw binary data in POST body, or use multipart/form-data"}
+            };
+            res.set_content(response.dump(), "application/json");
+            return;
+        }
+        std::string filename = upload.files.front().filename;
+        std::string filepath = upload.files.front().path;
+            
+        // Update global video file path
+        {
+            std::lock_guard<InstrumentedMutex> lock(vitals_mutex);
+            video_file_path = filepath;
+        }
+        
+        json response = {
+            {"message", "Video file uploaded successfully"},
+            {"filename", filename},
+            {"path", filepath},
+            {"size_bytes", static_cast<int64_t>(upload.files.front().bytes)}
+        };
+        res.set_content(response.dump(), "application/json");
+    });
+
+    // POST /batch - Process several videos in parallel on the container pool
+    // Multipart: one part per video, plus optional "settings" and "videos" (a JSON
+    // list of names already in /app/uploads). JSON: {"videos": [...], "settings": {...}}
+    svr.Post("/batch", [api_key, set_cors_headers](const httplib::Request& req, httplib::Response& res,
+                                                   const httplib::ContentReader& content_reader) {
+        set_cors_headers(res);
+        std::string upload_dir = "/app/uploads";
+        system(("mkdir -p " + upload_dir).c_str());
+
+        std::vector<BatchItem> items;
+        std::vector<std::string> uploaded_paths;  // Removed again if the request is rejected
+        json video_names = json::array();
+        json overrides;
+        auto reject = [&](int status, const std::string& error) {
+            std::error_code ec;
+            for (const auto& path : uploaded_paths) {
+                std::filesystem::remove(path, ec);
+            }
+            res.status = status;
+            json response = {
+                {"error", error},
+                {"hint", "Send videos as multipart/form-data, or JSON {\"videos\": [\"<uploaded file>\", ...]}"}
+            };
+            res.set_content(response.dump(), "application/json");
+        };
+
+        if (req.is_multipart_form_data()) {
+            UploadResult upload = receive_upload(req, content_reader, upload_dir, static_cast<size_t>(batch_max_videos));
+            if (!upload.ok && upload.error != "No video file provided") {
+                reject(upload.error == "Failed to save uploaded file" ? 500 : 400, upload.error);
+                return;
+            }
+            for (const auto& file : upload.files) {
+                items.push_back({file.filename, file.path, file.client_filename});
+                uploaded_paths.push_back(file.path);
+            }
+            if (upload.fields.count("videos")) {
+                video_names = json::parse(upload.fields["videos"], nullptr, false);
+            }
+            if (upload.fields.count("settings")) {
+                overrides = json::parse(upload.fields["settings"], nullptr, false);
+                if (overrides.is_discarded()) {
+                    reject(400, "settings is not valid JSON");
+                    return;
+                }
+            }
+        } else {
+            std::string body;
+            bool too_large = false;
+            content_reader([&](const char* data, size_t length) {
+                if (body.size() + length > 1024 * 1024) {
+                    too_large = true;
+                    return false;
+                }
+                body.append(data, length);
+                return true;
+            });
+            json request = json::parse(body, nullptr, false);
+            if (too_large || !request.is_object()) {
+                reject(400, too_large ? "Request body too large" : "Request body is not a JSON object");
+                return;
+            }
+            video_names = request.value("videos", json::array());
+            if (request.contains("settings")) {
+                overrides = request["settings"];
+            }
+        }
+
+        // Videos uploaded earlier through /upload, by the name it returned
+        if (!video_names.is_array()) {
+            reject(400, "videos must be a list of uploaded file names");
+            return;
+        }
+        for (const auto& name : video_names) {
+            std::string video_file = name.is_string() ? name.get<std::string>() : "";
+            std::string path = upload_dir + "/" + video_file;
+            std::error_code ec;
+            if (video_file.empty() || video_file.find('/') != std::string::npos || video_file[0] == '.' ||
+                !std::filesystem::is_regular_file(path, ec)) {
+                reject(400, "Unknown uploaded video: " + (name.is_string() ? video_file : name.dump()));
+                return;
+            }
+            items.push_back({video_file, path, ""});
+        }
+        if (items.empty()) {
+            reject(400, "No videos provided");
+            return;
+        }
+        if (items.size() > static_cast<size_t>(batch_max_videos)) {
+            reject(400, "Too many videos (max " + std::to_string(batch_max_videos) + ")");
+            return;
+        }
+
+        ProcessingSettings processing;
+        std::string settings_error;
+        if (!overrides.is_null() && !processing.update_from_json(overrides, settings_error)) {
+            reject(400, settings_error);
+            return;
+        }
+
+        std::string batch_id = make_session_id("batch");
+        std::cout << "Batch " << batch_id << ": " << items.size() << " videos on a pool of "
+                  << container_pool.size() << " containers" << std::endl;
+        json summary = run_batch(api_key, batch_id, items, processing);
+        if (summary["status"] == "handed_off") {
+            res.status = 202;
+            summary["success"] = false;
+            summary["message"] = "Engine restarting; the unfinished videos resume in the new engine. "
+                                 "Poll GET /sessions/{id} for each of handed_off_sessions";
+            res.set_content(summary.dump(), "application/json");
+            return;
+        }
+        std::cout << "Batch " << batch_id << " " << summary["status"].get<std::string>() << " in "
+                  << summary["aggregate"]["wall_seconds"].get<double>() << "s" << std::endl;
+
+        summary["success"] = summary["status"] != "failed";
+        if (summary["status"] == "failed") {
+            res.status = 500;
+        }
+        res.set_content(summary.dump(), "application/json");
+        session_egress.add(batch_id, static_cast<int64_t>(res.body.size()));
+    });
+
+    // GET /test - Run video processing (camera or uploaded video)
+    // GET /test?device=/dev/videoN - Use that camera (e.g. a virtual one) instead of the uploaded video
+    svr.Get("/test", [api_key, set_cors_headers](const httplib::Request& req, httplib::Response& res) {
+        set_cors_headers(res);
+        if (camera_running.load()) {
+            res.status = 409;  // Conflict
+            res.set_header("Retry-After", std::to_string(single_job_retry_after()));
+            json response = {{"error", "Processing already running"}};
+            res.set_content(response.dump(), "application/json");
+            return;
+        }
+
+        if (req.has_param("device")) {
+            std::string device = req.get_param_value("device");
+            if (camera_device_index(device) < 0 || !check_camera_device(device)) {
+                res.status = 400;
+                json response = {
+                    {"error", "Unknown camera device"},
+                    {"device", device},
+                    {"available", list_camera_devices()}
+                };
+                res.set_content(response.dump(), "application/json");
+                return;
+            }
+            std::lock_guard<InstrumentedMutex> lock(vitals_mutex);
+            camera_device_path = device;
+            video_file_path = "";
+        }
+
+        // Check if video file is available
+        std::string current_video_path;
+        {
+            std::lock_guard<InstrumentedMutex> lock(vitals_mutex);
+            current_video_path = video_file_path;
+        }
+
+        std::string message;
+        if (!current_video_path.empty()) {
+            message = "Video file processing started. Processing entire video.";
+        } else {
+            message = "Camera test started. Will run for 10 seconds.";
+        }
+
+        // Runs in the background on the job pipeline
+        std::string session_id = make_session_id();
+        submit_single_job(api_key, session_id);
+
+        json response = {
+            {"message", message},
+            {"session_id", session_id},
+            {"check_console", "Vital signs will be printed to console/stdout"},
+            {"using_video_file", !current_video_path.empty()},
+            {"camera_device", current_video_path.empty() ? camera_device_path : ""}
         };
         res.set_content(response.dump(), "application/json");
     });
 
-    // POST /process-video - Upload video, process, and return vitals JSON
-    svr.Post("/process-video", [api_key, set_cors_headers](const httplib::Request& req, httplib::Response& res) {
+    // POST /camera/analyze-recent?seconds=30 - Process the last N seconds of camera
+    // footage from the frame ring, with no new capture
+    svr.Post("/camera/analyze-recent", [api_key, set_cors_headers](const httplib::Request& req, httplib::Response& res) {
         set_cors_headers(res);
-        if (camera_running.load()) {
-            res.status = 409;
-            json response = {{"error", "Processing already in progress. Wait for current processing to complete."}};
+        if (!camera_ring.enabled()) {
+            res.status = 503;
+            json response = {{"error", "Camera frame ring is disabled"}, {"hint", "Set PRESAGE_CAMERA_RING_S"}};
             res.set_content(response.dump(), "application/json");
             return;
         }
-        
-        // Check if we have file data in the request
-        // Try multipart first, then fall back to raw body
-        std::string file_content;
-        bool has_file = false;
-        
-        // Try to get file from multipart (if available in this httplib version)
-        // For now, accept raw binary data in request body
-        if (!req.body.empty()) {
-            file_content = req.body;
-            has_file = true;
+        int64_t seconds = 30;
+        if (req.has_param("seconds")) {
+            seconds = std::atoll(req.get_param_value("seconds").c_str());
         }
-        
-        if (!has_file) {
+        if (seconds < 1 || seconds > camera_ring.capacity_seconds()) {
             res.status = 400;
+            json response = {{"error", "seconds must be between 1 and " + std::to_string(camera_ring.capacity_seconds())}};
+            res.set_content(response.dump(), "application/json");
+            return;
+        }
+
+        std::vector<FrameRing::Frame> frames = camera_ring.recent(seconds);
+        double footage_s = frames.size() < 2 ? 0.0 : (frames.back().timestamp_ms - frames.front().timestamp_ms) / 1000.0;
+        if (footage_s < 2.0) {
+            res.status = 409;
             json response = {
-                {"error", "No video file provided"},
-                {"hint", "Send video file as raw binary data in POST body, or use multipart/form-data"}
+                {"error", "Not enough buffered camera footage"},
+                {"buffered_seconds", footage_s},
+                {"camera_ring", camera_ring.stats()}
             };
             res.set_content(response.dump(), "application/json");
             return;
         }
-        
-        // Save uploaded video
-        std::string upload_dir = "/app/uploads";
-        std::string filename = "video_" + std::to_string(std::time(nullptr)) + ".mp4";
-        std::string filepath = upload_dir + "/" + filename;
-        
-        // Create uploads directory if it doesn't exist
-        system(("mkdir -p " + upload_dir).c_str());
-        
-        std::ofstream outfile(filepath, std::ios::binary);
-        if (!outfile) {
+
+        std::string session_id = make_session_id();
+        std::string video_path = session_dir(session_id) + "/recent.mp4";
+        std::error_code ec;
+        std::filesystem::create_directories(session_dir(session_id), ec);
+        double fps = 0.0;
+        if (!write_ring_video(frames, video_path, fps)) {
             res.status = 500;
-            json response = {{"error", "Failed to save uploaded file"}};
+            json response = {{"error", "Failed to write buffered footage"}, {"session_id", session_id}};
             res.set_content(response.dump(), "application/json");
             return;
         }
-        
-        outfile.write(file_content.data(), file_content.length());
-        outfile.close();
-        
-        std::cout << "Video file saved: " << filepath << " (" << file_content.length() << " bytes)" << std::endl;
-        
-        // Clear previous readings
-        {
-            std::lock_guard<std::mutex> lock(vitals_readings_mutex);
-            all_vitals_readings.clear();
+        std::cout << "Analysing " << footage_s << "s of buffered camera footage (" << frames.size()
+                  << " frames) as " << session_id << std::endl;
+
+        auto run = std::make_shared<ContainerRun>();
+        run->session_id = session_id;
+        run->video_path = video_path;
+        run->feeds_live = false;
+        auto job = std::make_shared<Job>();
+        job->api_key = api_key;
+        job->run = run;
+        job->input_path = video_path;
+        if (!wait_for_job(submit_job(job))) {
+            respond_handed_off(res, session_id);
+            return;
         }
-        
-        // Update global video file path
+
+        json vitals;
         {
-            std::lock_guard<std::mutex> lock(vitals_mutex);
-            video_file_path = filepath;
+            std::lock_guard<std::mutex> lock(run->readings_mutex);
+            vitals = calculate_vitals_summary(run->readings);
         }
-        
-        // Process video synchronously using Presage SDK
-        std::cout << "Processing video with Presage SmartSpectra SDK to extract REAL vitals..." << std::endl;
-        run_camera_test(api_key);
-        
-        // Calculate and return vitals summary from SDK data
-        json vitals_summary = calculate_vitals_summary();
-        
-        // Check if we got any data
-        if (vitals_summary.empty() || vitals_summary["readings_count"] == 0) {
+        json footage = {
+            {"seconds", footage_s},
+            {"frames", frames.size()},
+            {"fps", fps},
+            {"from_ms", frames.front().timestamp_ms},
+            {"to_ms", frames.back().timestamp_ms}
+        };
+        if (vitals.empty() || vitals["readings_count"] == 0) {
+            json archived;
+            read_json_file(session_dir(session_id) + "/summary.json", archived);
             res.status = 500;
-            json error_response = {
+            json response = {
                 {"success", false},
-                {"error", "No vitals data extracted from video"},
-                {"message", "Presage SDK did not return any vital sign readings. Check video quality and ensure face is visible."},
-                {"video_file", filename}
+                {"error", archived.value("error", "No vitals data extracted from buffered footage")},
+                {"session_id", session_id},
+                {"footage", footage},
+                {"usage", usage_summary(*run)}
             };
-            res.set_content(error_response.dump(), "application/json");
+            res.set_content(response.dump(), "application/json");
+            session_egress.add(session_id, static_cast<int64_t>(res.body.size()));
             return;
         }
-        
         json response = {
             {"success", true},
-            {"video_file", filename},
-            {"vitals", vitals_summary},
-            {"processing_complete", true},
-            {"data_source", "presage_sdk"},
-            {"note", "Vitals extracted using Presage SmartSpectra SDK"}
+            {"session_id", session_id},
+            {"footage", footage},
+            {"vitals", vitals},
+            {"usage", usage_summary(*run)},
+            {"data_source", "presage_sdk"}
         };
-        
         res.set_content(response.dump(), "application/json");
+        session_egress.add(session_id, static_cast<int64_t>(res.body.size()));
     });
 
-    // POST /upload - Upload MP4 video file (legacy endpoint)
-    svr.Post("/upload", [set_cors_headers](const httplib::Request& req, httplib::Response& res) {
+    // GET /cameras - Camera devices selectable with /test?device=
+    svr.Get("/cameras", [set_cors_headers](const httplib::Request&, httplib::Response& res) {
         set_cors_headers(res);
-        if (camera_running.load()) {
-            res.status = 409;  // Conflict
-            json response = {{"error", "Processing already running. Wait for it to complete."}};
-            res.set_content(response.dump(), "application/json");
-            return;
-        }
+        json response = {
+            {"default", camera_device_path},
+            {"devices", list_camera_devices()}
+        };
+        res.set_content(response.dump(), "application/json");
+    });
 
-        // Accept file as raw binary data in request body
-        if (!req.body.empty()) {
-            // Save to /app/uploads directory
-            std::string upload_dir = "/app/uploads";
-            std::string filename = "video_" + std::to_string(std::time(nullptr)) + ".mp4";
-            std::string filepath = upload_dir + "/" + filename;
-            
-            // Create uploads directory if it doesn't exist
-            system(("mkdir -p " + upload_dir).c_str());
-            
-            // Write file
-            std::ofstream outfile(filepath, std::ios::binary);
-            if (!outfile) {
-                res.status = 500;
-                json response = {{"error", "Failed to save uploaded file"}};
-                res.set_content(response.dump(), "application/json");
-                return;
-            }
-            
-            outfile.write(req.body.data(), req.body.length());
-            outfile.close();
-            
-            // Update global video file path
-            {
-                std::lock_guard<std::mutex> lock(vitals_mutex);
-                video_file_path = filepath;
-            }
-            
+    // GET /live - Get latest vitals
+    svr.Get("/live", [set_cors_headers](const httplib::Request&, httplib::Response& res) {
+        set_cors_headers(res);
+        std::lock_guard<InstrumentedMutex> lock(vitals_mutex);
+        if (latest_vitals.empty()) {
             json response = {
-                {"message", "Video file uploaded successfully"},
-                {"filename", filename},
-                {"path", filepath},
-                {"size_bytes", static_cast<int64_t>(req.body.length())}
+                {"message", "No vitals data available yet"},
+                {"suggestion", "Call /test first to collect data"}
             };
             res.set_content(response.dump(), "application/json");
-            
         } else {
+            res.set_content(latest_vitals.dump(), "application/json");
+        }
+    });
+
+    // GET /sessions/{id} - Result of a run from the session archive, or its progress while running
+    svr.Get(R"(/sessions/([A-Za-z0-9_]+))", [set_cors_headers](const httplib::Request& req, httplib::Response& res) {
+        set_cors_headers(res);
+        std::string session_id = req.matches[1];
+        std::string dir = session_dir(session_id);
+
+        json data;
+        if (read_json_file(dir + "/summary.json", data)) {
+            if (data.contains("usage")) {
+                // Responses served since it was archived
+                data["usage"]["bytes_out"] = std::max(data["usage"].value("bytes_out", int64_t{0}),
+                                                      session_egress.get(session_id));
+            }
+            res.set_content(data.dump(), "application/json");
+            return;
+        }
+        json schedule;
+        schedule_estimate(session_id, &schedule);
+        if (!read_json_file(dir + "/checkpoint.json", data) && !schedule.empty()) {
+            // Queued for a pool slot, or still starting up
+            schedule["session_id"] = session_id;
+            schedule["status"] = "processing";
+            res.set_content(schedule.dump(), "application/json");
+            return;
+        }
+        if (data.empty()) {
+            res.status = 404;
+            json response = {{"error", "Unknown session"}, {"session_id", session_id}};
+            res.set_content(response.dump(), "application/json");
+            return;
+        }
+
+        bool active;
+        {
+            std::lock_guard<InstrumentedMutex> lock(vitals_mutex);
+            active = camera_running.load() && current_session_id == session_id;
+        }
+        {
+            std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+            active = active || std::any_of(active_containers.begin(), active_containers.end(),
+                [&session_id](const std::shared_ptr<ContainerRun>& run) { return run->session_id == session_id; });
+        }
+        // Still waiting in this engine, or in one that is draining and hands it on
+        active = active || checkpoint_owner(data) != CheckpointOwner::Gone;
+        json response = {
+            {"session_id", session_id},
+            {"status", active ? "processing" : "interrupted"},
+            {"frame_offset", data.value("frame_offset", int64_t{0})},
+            {"readings_count", data.value("readings_count", int64_t{0})},
+            {"updated_at", data.value("updated_at", int64_t{0})}
+        };
+        response.update(schedule);
+        res.set_content(response.dump(), "application/json");
+    });
+
+    // GET /metrics - Engine counters in Prometheus text format
+    svr.Get("/metrics", [set_cors_headers](const httplib::Request&, httplib::Response& res) {
+        set_cors_headers(res);
+        size_t active;
+        {
+            std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+            active = active_containers.size();
+        }
+        std::string body;
+        body += "# HELP presage_processing_running Whether a processing run is in progress\n";
+        body += "# TYPE presage_processing_running gauge\n";
+        body += "presage_processing_running " + std::to_string(camera_running.load() ? 1 : 0) + "\n";
+        body += "# HELP presage_containers_active SDK containers currently running\n";
+        body += "# TYPE presage_containers_active gauge\n";
+        body += "presage_containers_active " + std::to_string(active) + "\n";
+        body += "# HELP presage_containers_recycled_total Stalled SDK containers recycled by the watchdog\n";
+        body += "# TYPE presage_containers_recycled_total counter\n";
+        body += "presage_containers_recycled_total " + std::to_string(containers_recycled.load()) + "\n";
+        body += "# HELP presage_container_pool_size Container pool slots (PRESAGE_CONTAINER_POOL_SIZE)\n";
+        body += "# TYPE presage_container_pool_size gauge\n";
+        body += "presage_container_pool_size " + std::to_string(container_pool.size()) + "\n";
+        body += "# HELP presage_container_pool_busy Container pool slots in use\n";
+        body += "# TYPE presage_container_pool_busy gauge\n";
+        body += "presage_container_pool_busy " + std::to_string(container_pool.busy()) + "\n";
+        body += "# HELP presage_container_pool_waiting Jobs waiting for a container pool slot\n";
+        body += "# TYPE presage_container_pool_waiting gauge\n";
+        body += "presage_container_pool_waiting " + std::to_string(container_pool.waiting()) + "\n";
+        body += "# HELP presage_cost_model_samples_total Completed jobs the cost model has learned from\n";
+        body += "# TYPE presage_cost_model_samples_total counter\n";
+        body += "presage_cost_model_samples_total " + std::to_string(cost_model.samples()) + "\n";
+        body += "# HELP presage_cost_model_wall_mape Mean absolute percentage error of wall-time predictions, last 100 jobs\n";
+        body += "# TYPE presage_cost_model_wall_mape gauge\n";
+        body += "presage_cost_model_wall_mape " + std::to_string(cost_model.wall_mape()) + "\n";
+        body += "# HELP presage_cost_model_cpu_mape Mean absolute percentage error of CPU-time predictions, last 100 jobs\n";
+        body += "# TYPE presage_cost_model_cpu_mape gauge\n";
+        body += "presage_cost_model_cpu_mape " + std::to_string(cost_model.cpu_mape()) + "\n";
+        body += cost_model.wall_error_seconds.prometheus("presage_cost_model_wall_error_seconds",
+                                                         "Absolute error of wall-time predictions");
+        body += "# HELP presage_queue_estimated_wait_seconds Predicted wait for a pool slot for a job submitted now\n";
+        body += "# TYPE presage_queue_estimated_wait_seconds gauge\n";
+        body += "presage_queue_estimated_wait_seconds " + std::to_string(schedule_estimate()) + "\n";
+        json ring = camera_ring.stats();
+        body += "# HELP presage_camera_ring_frames Camera frames held in the frame ring\n";
+        body += "# TYPE presage_camera_ring_frames gauge\n";
+        body += "presage_camera_ring_frames " + ring["frames"].dump() + "\n";
+        body += "# HELP presage_camera_ring_bytes JPEG bytes held in the frame ring\n";
+        body += "# TYPE presage_camera_ring_bytes gauge\n";
+        body += "presage_camera_ring_bytes " + ring["bytes"].dump() + "\n";
+        body += "# HELP presage_camera_ring_seconds Seconds of camera footage in the frame ring\n";
+        body += "# TYPE presage_camera_ring_seconds gauge\n";
+        body += "presage_camera_ring_seconds " + ring["buffered_seconds"].dump() + "\n";
+        size_t stream_connections = stream_server.connection_count();
+        size_t stream_bytes = stream_server.connection_bytes();
+        body += "# HELP presage_stream_connections Open connections on the streaming listener\n";
+        body += "# TYPE presage_stream_connections gauge\n";
+        body += "presage_stream_connections " + std::to_string(stream_connections) + "\n";
+        body += "# HELP presage_stream_subscribers Open /live/stream, /live/metrics and /ward/stream subscriptions\n";
+        body += "# TYPE presage_stream_subscribers gauge\n";
+        body += "presage_stream_subscribers " + std::to_string(stream_server.subscriber_count()) + "\n";
+        body += "# HELP presage_ward_subscribers Open /ward/stream subscriptions\n";
+        body += "# TYPE presage_ward_subscribers gauge\n";
+        body += "presage_ward_subscribers " + std::to_string(stream_server.ward_subscriber_count()) + "\n";
+        body += "# HELP presage_ward_views Distinct session list and rate pairs being streamed\n";
+        body += "# TYPE presage_ward_views gauge\n";
+        body += "presage_ward_views " + std::to_string(stream_server.ward_view_count()) + "\n";
+        body += "# HELP presage_ward_events_total Ward events serialised (each shared by a view's subscribers)\n";
+        body += "# TYPE presage_ward_events_total counter\n";
+        body += "presage_ward_events_total " + std::to_string(stream_server.ward_events()) + "\n";
+        body += "# HELP presage_stream_connection_bytes User-space memory held for streaming connections\n";
+        body += "# TYPE presage_stream_connection_bytes gauge\n";
+        body += "presage_stream_connection_bytes " + std::to_string(stream_bytes) + "\n";
+        body += "# HELP presage_stream_bytes_per_connection Average user-space memory per streaming connection\n";
+        body += "# TYPE presage_stream_bytes_per_connection gauge\n";
+        body += "presage_stream_bytes_per_connection " +
+                std::to_string(stream_connections ? stream_bytes / stream_connections : 0) + "\n";
+        body += "# HELP presage_stream_messages_sent_total Messages delivered to streaming connections\n";
+        body += "# TYPE presage_stream_messages_sent_total counter\n";
+        body += "presage_stream_messages_sent_total " + std::to_string(stream_server.messages_sent()) + "\n";
+        body += "# HELP presage_stream_slow_disconnects_total Subscribers dropped for falling too far behind\n";
+        body += "# TYPE presage_stream_slow_disconnects_total counter\n";
+        body += "presage_stream_slow_disconnects_total " + std::to_string(stream_server.slow_disconnects()) + "\n";
+        Executor::Stats exec = executor->stats();
+        body += "# HELP presage_executor_threads Worker threads of the job executor\n";
+        body += "# TYPE presage_executor_threads gauge\n";
+        body += "presage_executor_threads " + std::to_string(exec.threads) + "\n";
+        body += "# HELP presage_executor_tasks_queued Executor tasks waiting for a worker\n";
+        body += "# TYPE presage_executor_tasks_queued gauge\n";
+        body += "presage_executor_tasks_queued " + std::to_string(exec.queued) + "\n";
+        body += "# HELP presage_executor_tasks_total Executor tasks run\n";
+        body += "# TYPE presage_executor_tasks_total counter\n";
+        body += "presage_executor_tasks_total " + std::to_string(exec.executed) + "\n";
+        body += "# HELP presage_executor_steals_total Tasks taken from another worker's queue\n";
+        body += "# TYPE presage_executor_steals_total counter\n";
+        body += "presage_executor_steals_total " + std::to_string(exec.stolen) + "\n";
+        std::string stage_queued, stage_running, stage_processed, stage_busy;
+        for (const auto& stage : job_pipeline->stats()) {
+            std::string label = "{stage=\"" + stage.name + "\"} ";
+            stage_queued += "presage_pipeline_stage_queued" + label + std::to_string(stage.queued) + "\n";
+            stage_running += "presage_pipeline_stage_running" + label + std::to_string(stage.running) + "\n";
+            stage_processed += "presage_pipeline_stage_processed_total" + label + std::to_string(stage.processed) + "\n";
+            stage_busy += "presage_pipeline_stage_busy_seconds_total" + label + std::to_string(stage.busy_seconds) + "\n";
+        }
+        body += "# HELP presage_pipeline_stage_queued Jobs waiting in each pipeline stage's queue\n";
+        body += "# TYPE presage_pipeline_stage_queued gauge\n" + stage_queued;
+        body += "# HELP presage_pipeline_stage_running Jobs each pipeline stage is working on\n";
+        body += "# TYPE presage_pipeline_stage_running gauge\n" + stage_running;
+        body += "# HELP presage_pipeline_stage_processed_total Jobs through each pipeline stage\n";
+        body += "# TYPE presage_pipeline_stage_processed_total counter\n" + stage_processed;
+        body += "# HELP presage_pipeline_stage_busy_seconds_total Time spent in each pipeline stage\n";
+        body += "# TYPE presage_pipeline_stage_busy_seconds_total counter\n" + stage_busy;
+        body += shadow_evaluation.prometheus();
+        body += "# HELP presage_artifact_downloads_active Artifact downloads in progress\n";
+        body += "# TYPE presage_artifact_downloads_active gauge\n";
+        body += "presage_artifact_downloads_active " + std::to_string(stream_server.active_downloads()) + "\n";
+        body += "# HELP presage_artifact_downloads_total Artifact downloads started\n";
+        body += "# TYPE presage_artifact_downloads_total counter\n";
+        body += "presage_artifact_downloads_total " + std::to_string(stream_server.downloads()) + "\n";
+        body += "# HELP presage_artifact_bytes_sent_total Artifact bytes sent with sendfile\n";
+        body += "# TYPE presage_artifact_bytes_sent_total counter\n";
+        body += "presage_artifact_bytes_sent_total " + std::to_string(stream_server.download_bytes()) + "\n";
+        body += "# HELP presage_session_usage_sessions_total Sessions archived with a usage record\n";
+        body += "# TYPE presage_session_usage_sessions_total counter\n";
+        body += "presage_session_usage_sessions_total " + std::to_string(usage_totals.sessions.load()) + "\n";
+        body += "# HELP presage_session_cpu_seconds_total Estimated CPU seconds of archived sessions, shares included\n";
+        body += "# TYPE presage_session_cpu_seconds_total counter\n";
+        body += "presage_session_cpu_seconds_total " + std::to_string(usage_totals.cpu_ns.load() / 1e9) + "\n";
+        body += "# HELP presage_session_thread_cpu_seconds_total CPU seconds of threads working for a single session\n";
+        body += "# TYPE presage_session_thread_cpu_seconds_total counter\n";
+        body += "presage_session_thread_cpu_seconds_total " + std::to_string(usage_totals.thread_cpu_ns.load() / 1e9) + "\n";
+        body += "# HELP presage_session_bytes_in_total Input video bytes of archived sessions\n";
+        body += "# TYPE presage_session_bytes_in_total counter\n";
+        body += "presage_session_bytes_in_total " + std::to_string(usage_totals.bytes_in.load()) + "\n";
+        body += "# HELP presage_session_bytes_out_total Response bytes served for sessions\n";
+        body += "# TYPE presage_session_bytes_out_total counter\n";
+        body += "presage_session_bytes_out_total " + std::to_string(session_egress.total()) + "\n";
+        body += "# HELP presage_session_frames_decoded_total Frames the engine decoded itself for sessions\n";
+        body += "# TYPE presage_session_frames_decoded_total counter\n";
+        body += "presage_session_frames_decoded_total " + std::to_string(usage_totals.frames_decoded.load()) + "\n";
+        body += "# HELP presage_session_frames_processed_total Frames the SDK processed for sessions\n";
+        body += "# TYPE presage_session_frames_processed_total counter\n";
+        body += "presage_session_frames_processed_total " + std::to_string(usage_totals.frames_processed.load()) + "\n";
+        body += usage_totals.cpu_per_video_second.prometheus("presage_session_cpu_seconds_per_video_second",
+                                                             "Estimated CPU seconds per second of video, per session");
+        body += "# HELP presage_stream_metrics_subscribers Open /live/metrics subscriptions\n";
+        body += "# TYPE presage_stream_metrics_subscribers gauge\n";
+        body += "presage_stream_metrics_subscribers " + std::to_string(stream_server.metrics_subscriber_count()) + "\n";
+#ifdef PRESAGE_SDK_AVAILABLE
+        body += "# HELP presage_metrics_frames_forwarded_total MetricsBuffer frames published to /live/metrics\n";
+        body += "# TYPE presage_metrics_frames_forwarded_total counter\n";
+        body += "presage_metrics_frames_forwarded_total " + std::to_string(metrics_forwarder.forwarded()) + "\n";
+        body += "# HELP presage_metrics_frame_bytes_total Bytes of MetricsBuffer frames published\n";
+        body += "# TYPE presage_metrics_frame_bytes_total counter\n";
+        body += "presage_metrics_frame_bytes_total " + std::to_string(metrics_forwarder.forwarded_bytes()) + "\n";
+        body += "# HELP presage_metrics_frames_dropped_total MetricsBuffers dropped because the forwarder fell behind\n";
+        body += "# TYPE presage_metrics_frames_dropped_total counter\n";
+        body += "presage_metrics_frames_dropped_total " + std::to_string(metrics_forwarder.dropped()) + "\n";
+#endif
+        body += rest_integration_latency.prometheus("presage_rest_integration_latency_seconds",
+                                                    "Time from a frame reaching the SDK to metrics covering it arriving");
+        body += "# HELP presage_lock_wait_seconds Time spent waiting for a contended engine lock\n";
+        body += "# TYPE presage_lock_wait_seconds histogram\n";
+        for (const InstrumentedMutex* lock : InstrumentedMutex::registry()) {
+            body += lock->wait().prometheus("presage_lock_wait_seconds", lock->name());
+        }
+        body += "# HELP presage_lock_hold_seconds Time an engine lock was held per acquisition\n";
+        body += "# TYPE presage_lock_hold_seconds histogram\n";
+        for (const InstrumentedMutex* lock : InstrumentedMutex::registry()) {
+            body += lock->hold().prometheus("presage_lock_hold_seconds", lock->name());
+        }
+        res.set_content(body, "text/plain; version=0.0.4");
+    });
+
+    // GET /shadow - Shadow evaluation: candidate settings, run counts, aggregate and recent comparisons
+    svr.Get("/shadow", [set_cors_headers](const httplib::Request&, httplib::Response& res) {
+        set_cors_headers(res);
+        res.set_content(shadow_evaluation.to_json().dump(), "application/json");
+    });
+
+    // POST /shadow - {"percent": P, "settings": {...}} replaces the candidate and resets the comparison
+    svr.Post("/shadow", [set_cors_headers](const httplib::Request& req, httplib::Response& res) {
+        set_cors_headers(res);
+        json body = json::parse(req.body, nullptr, false);
+        std::string error;
+        if (body.is_discarded() || !body.is_object() || !body.contains("percent") || !body["percent"].is_number()) {
+            error = "Body must be JSON {\"percent\": P, \"settings\": {...}}";
+        }
+        if (!error.empty() ||
+            !shadow_evaluation.configure(body["percent"].get<double>(), body.value("settings", json::object()), error)) {
             res.status = 400;
-            json response = {
-                {"error", "No video file provided"},
-                {"hint", "Send video file as raw binary data in POST body"}
-            };
+            json response = {{"error", error}};
             res.set_content(response.dump(), "application/json");
+            return;
         }
+        res.set_content(shadow_evaluation.to_json().dump(), "application/json");
     });
 
-    // GET /test - Run video processing (camera or uploaded video)
-    svr.Get("/test", [api_key, set_cors_headers](const httplib::Request&, httplib::Response& res) {
+    // GET /debug/locks?reset=1 - Wait and hold times per engine lock (reset zeroes them afterwards)
+    svr.Get("/debug/locks", [set_cors_headers](const httplib::Request& req, httplib::Response& res) {
         set_cors_headers(res);
-        if (camera_running.load()) {
-            res.status = 409;  // Conflict
-            json response = {{"error", "Processing already running"}};
+        bool reset = req.get_param_value("reset") == "1";
+        json locks = json::array();
+        for (InstrumentedMutex* lock : InstrumentedMutex::registry()) {
+            int64_t acquisitions = lock->hold().count.load(std::memory_order_relaxed);
+            int64_t contended = lock->wait().count.load(std::memory_order_relaxed);
+            locks.push_back({
+                {"name", lock->name()},
+                {"acquisitions", acquisitions},
+                {"contended", contended},
+                {"contention_ratio", acquisitions > 0 ? static_cast<double>(contended) / acquisitions : 0.0},
+                {"wait", lock->wait().to_json()},
+                {"hold", lock->hold().to_json()}
+            });
+            if (reset) {
+                lock->reset();
+            }
+        }
+        json response = {{"locks", locks}, {"reset", reset}};
+        res.set_content(response.dump(), "application/json");
+    });
+
+    // GET /debug/profile?seconds=N&hz=H - Sample all threads, return folded stacks for flamegraph.pl
+    svr.Get("/debug/profile", [set_cors_headers](const httplib::Request& req, httplib::Response& res) {
+        set_cors_headers(res);
+        int seconds = 10;
+        int hz = 99;
+        try {
+            if (req.has_param("seconds")) {
+                seconds = std::stoi(req.get_param_value("seconds"));
+            }
+            if (req.has_param("hz")) {
+                hz = std::stoi(req.get_param_value("hz"));
+            }
+        } catch (const std::exception&) {
+            seconds = -1;
+        }
+        if (seconds < 1 || seconds > 120 || hz < 1 || hz > 1000) {
+            res.status = 400;
+            json response = {{"error", "seconds must be 1-120 and hz 1-1000"}};
+            res.set_content(response.dump(), "application/json");
+            return;
+        }
+        if (profiler_busy.exchange(true)) {
+            res.status = 409;
+            json response = {{"error", "A profile is already being collected"}};
             res.set_content(response.dump(), "application/json");
             return;
         }
 
-        // Check if video file is available
-        std::string current_video_path;
-        {
-            std::lock_guard<std::mutex> lock(vitals_mutex);
-            current_video_path = video_file_path;
+        std::cout << "Profiling all threads for " << seconds << "s at " << hz << " Hz..." << std::endl;
+        size_t samples = 0;
+        size_t dropped = 0;
+        std::string folded = run_profile(seconds, hz, samples, dropped);
+        profiler_busy = false;
+
+        res.set_header("X-Profile-Samples", std::to_string(samples));
+        res.set_header("X-Profile-Dropped", std::to_string(dropped));
+        res.set_content(folded, "text/plain");
+    });
+
+    // GET /sessions?hr_gt=130&br_lt=8&from=<ms>&to=<ms> - Archived sessions with readings matching a predicate
+    svr.Get("/sessions", [set_cors_headers](const httplib::Request& req, httplib::Response& res) {
+        set_cors_headers(res);
+        auto started = std::chrono::steady_clock::now();
+
+        ReadingPredicate predicate;
+        int64_t from_ms = 0;
+        int64_t to_ms = std::numeric_limits<int64_t>::max();
+        size_t limit = 100;
+        try {
+            auto threshold = [&req](const char* name, float& value) {
+                if (req.has_param(name)) {
+                    value = std::stof(req.get_param_value(name));
+                }
+            };
+            threshold("hr_gt", predicate.heart_rate_gt);
+            threshold("hr_lt", predicate.heart_rate_lt);
+            threshold("br_gt", predicate.breathing_rate_gt);
+            threshold("br_lt", predicate.breathing_rate_lt);
+            if (req.has_param("from")) {
+                from_ms = std::stoll(req.get_param_value("from"));
+            }
+            if (req.has_param("to")) {
+                to_ms = std::stoll(req.get_param_value("to"));
+            }
+            if (req.has_param("limit")) {
+                limit = std::clamp<size_t>(std::stoull(req.get_param_value("limit")), 1, 1000);
+            }
+        } catch (const std::exception&) {
+            res.status = 400;
+            json response = {{"error", "Thresholds must be numbers; from, to and limit integers"}};
+            res.set_content(response.dump(), "application/json");
+            return;
+        }
+        predicate.match_any = req.get_param_value("match") == "any";
+        if (predicate.empty()) {
+            res.status = 400;
+            json response = {{"error", "At least one of hr_gt, hr_lt, br_gt, br_lt is required"}};
+            res.set_content(response.dump(), "application/json");
+            return;
         }
 
-        std::string message;
-        if (!current_video_path.empty()) {
-            message = "Video file processing started. Processing entire video.";
-        } else {
-            message = "Camera test started. Will run for 10 seconds.";
+        // Session ids carry their start time, so the time range prunes whole sessions
+        std::vector<std::pair<int64_t, std::string>> candidates;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(session_archive_dir, ec)) {
+            std::string id = entry.path().filename().string();
+            size_t first = id.find('_');
+            size_t second = id.find('_', first + 1);
+            if (id.rfind("session_", 0) != 0 || second == std::string::npos || !entry.is_directory(ec)) {
+                continue;
+            }
+            int64_t started_ms = std::strtoll(id.substr(first + 1, second - first - 1).c_str(), nullptr, 10);
+            if (started_ms >= from_ms && started_ms <= to_ms) {
+                candidates.emplace_back(started_ms, id);
+            }
         }
+        std::sort(candidates.rbegin(), candidates.rend());
 
-        // Run test in background thread
-        std::thread test_thread([api_key]() {
-            run_camera_test(api_key);
-        });
-        test_thread.detach();
+        json sessions = json::array();
+        uint64_t blocks = 0;
+        uint64_t blocks_read = 0;
+        bool truncated = false;
+        for (const auto& [started_ms, id] : candidates) {
+            std::string dir = session_dir(id);
+            // Sessions archived before zone maps get one on first query
+            if (!std::filesystem::exists(dir + "/zones.col", ec) && std::filesystem::exists(dir + "/summary.json", ec)) {
+                ReadingsStore::sync_zones(dir);
+            }
+            PredicateScan scan = ReadingsStore::scan(dir, predicate);
+            blocks += scan.blocks;
+            blocks_read += scan.blocks_read;
+            if (scan.matches == 0) {
+                continue;
+            }
+            if (sessions.size() == limit) {
+                truncated = true;
+                break;
+            }
+            sessions.push_back({
+                {"session_id", id},
+                {"started_at_ms", started_ms},
+                {"readings", scan.rows},
+                {"matching_readings", scan.matches},
+                {"first_match", row_to_reading(*scan.first_match)}
+            });
+        }
 
         json response = {
-            {"message", message},
-            {"check_console", "Vital signs will be printed to console/stdout"},
-            {"using_video_file", !current_video_path.empty()}
+            {"sessions", sessions},
+            {"truncated", truncated},
+            {"sessions_in_range", candidates.size()},
+            {"blocks", blocks},
+            {"blocks_read", blocks_read},
+            {"elapsed_ms", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count()}
         };
         res.set_content(response.dump(), "application/json");
     });
 
-    // GET /live - Get latest vitals
-    svr.Get("/live", [set_cors_headers](const httplib::Request&, httplib::Response& res) {
+    // GET /sessions/{id}/artifacts - Files stored for a session, downloadable from the stream port
+    svr.Get(R"(/sessions/([A-Za-z0-9_]+)/artifacts)", [set_cors_headers](const httplib::Request& req, httplib::Response& res) {
         set_cors_headers(res);
-        std::lock_guard<std::mutex> lock(vitals_mutex);
-        if (latest_vitals.empty()) {
-            json response = {
-                {"message", "No vitals data available yet"},
-                {"suggestion", "Call /test first to collect data"}
-            };
+        std::string session_id = req.matches[1];
+        std::error_code ec;
+        std::filesystem::directory_iterator it(session_dir(session_id), ec);
+        if (ec) {
+            res.status = 404;
+            json response = {{"error", "Unknown session"}, {"session_id", session_id}};
             res.set_content(response.dump(), "application/json");
-        } else {
-            res.set_content(latest_vitals.dump(), "application/json");
+            return;
+        }
+        json artifacts = json::array();
+        for (const auto& entry : it) {
+            std::string name = entry.path().filename().string();
+            if (!entry.is_regular_file(ec) || name[0] == '.') {
+                continue;
+            }
+            artifacts.push_back({
+                {"name", name},
+                {"bytes", static_cast<int64_t>(entry.file_size(ec))},
+                {"path", "/artifacts/sessions/" + session_id + "/" + name}
+            });
+        }
+        std::sort(artifacts.begin(), artifacts.end(),
+                  [](const json& a, const json& b) { return a["name"] < b["name"]; });
+        json response = {{"session_id", session_id}, {"artifacts", artifacts}};
+        res.set_content(response.dump(), "application/json");
+    });
+
+    // GET /sessions/{id}/readings?after=<cursor>&limit=N - Readings appended since a cursor
+    svr.Get(R"(/sessions/([A-Za-z0-9_]+)/readings)", [set_cors_headers](const httplib::Request& req, httplib::Response& res) {
+        set_cors_headers(res);
+        std::string session_id = req.matches[1];
+        std::string dir = session_dir(session_id);
+        std::error_code ec;
+        if (!std::filesystem::is_directory(dir, ec)) {
+            res.status = 404;
+            json response = {{"error", "Unknown session"}, {"session_id", session_id}};
+            res.set_content(response.dump(), "application/json");
+            return;
+        }
+
+        uint64_t after = 0;
+        uint64_t limit = 1000;
+        try {
+            if (req.has_param("after")) {
+                after = std::stoull(req.get_param_value("after"));
+            }
+            if (req.has_param("limit")) {
+                limit = std::clamp<uint64_t>(std::stoull(req.get_param_value("limit")), 1, 10000);
+            }
+        } catch (const std::exception&) {
+            res.status = 400;
+            json response = {{"error", "after and limit must be non-negative integers"}};
+            res.set_content(response.dump(), "application/json");
+            return;
         }
+
+        // Whether more rows can still arrive - read before the rows so none are missed
+        bool complete = std::filesystem::exists(dir + "/summary.json", ec);
+        std::vector<ReadingRow> rows = ReadingsStore::read(dir, after, limit);
+        json readings = json::array();
+        for (const auto& row : rows) {
+            readings.push_back(row_to_reading(row));
+        }
+        uint64_t cursor = after + rows.size();
+        json response = {
+            {"session_id", session_id},
+            {"readings", readings},
+            {"cursor", cursor},
+            {"has_more", cursor < ReadingsStore::row_count(dir)},
+            {"complete", complete}
+        };
+        res.set_content(response.dump(), "application/json");
     });
 
     // Health check
+    // 503 while draining; X-Presage-Pid tells engines apart while two share the port
     svr.Get("/health", [set_cors_headers](const httplib::Request&, httplib::Response& res) {
         set_cors_headers(res);
+        res.set_header("X-Presage-Pid", std::to_string(getpid()));
+        if (engine_draining.load()) {
+            res.status = 503;
+            res.set_content("Draining", "text/plain");
+            return;
+        }
         res.set_content("OK", "text/plain");
     });
 
@@ -585,16 +5592,112 @@ int main(int argc, char** argv) {
     std::cout << "  GET /status - Check SDK status" << std::endl;
     std::cout << "  POST /process-video - Upload video, process with SDK, return vitals JSON" << std::endl;
     std::cout << "  POST /upload - Upload MP4 video file" << std::endl;
+    std::cout << "  POST /batch - Process several videos in parallel, per-video results plus an aggregate" << std::endl;
     std::cout << "  GET /test - Run video processing (uses uploaded video or camera)" << std::endl;
+    std::cout << "  POST /camera/analyze-recent?seconds=N - Process the last N seconds of buffered camera footage" << std::endl;
+    std::cout << "  GET /cameras - List camera devices (including virtual ones)" << std::endl;
     std::cout << "  GET /live - Get latest vitals data from SDK" << std::endl;
+    std::cout << "  GET /sessions/{id} - Get archived result or progress of a run" << std::endl;
+    std::cout << "  GET /sessions?hr_gt=130&from=<ms> - Sessions with readings matching a predicate" << std::endl;
+    std::cout << "  GET /sessions/{id}/readings?after=<cursor> - Readings appended since a cursor" << std::endl;
+    std::cout << "  GET /sessions/{id}/artifacts - Files stored for a session" << std::endl;
+    std::cout << "  GET /metrics - Engine metrics (Prometheus format)" << std::endl;
+    std::cout << "  GET /debug/profile?seconds=N - Sample all threads, folded stacks for flamegraphs" << std::endl;
+    std::cout << "  GET /debug/locks - Wait and hold times per engine lock" << std::endl;
+    std::cout << "  GET /shadow - Candidate settings compared with production runs (POST to change)" << std::endl;
     std::cout << "  GET /health - Health check" << std::endl;
+    std::cout << "Streaming endpoints (port " << stream_port << "):" << std::endl;
+    std::cout << "  GET /live/stream - Server-sent events, one per reading" << std::endl;
+    std::cout << "  GET /live/poll?after=N - Long-poll for the next reading" << std::endl;
+    std::cout << "  GET /artifacts/sessions/{id}/{file} - Download a session file (Range supported)" << std::endl;
+    std::cout << "  GET /artifacts/uploads/{file} - Download an uploaded video (Range supported)" << std::endl;
+    if (stream_server.metrics_stream_enabled()) {
+        std::cout << "  GET /live/metrics - Raw MetricsBuffer messages, length-prefixed" << std::endl;
+    }
     std::cout << "========================================" << std::endl;
 
-    // Start server
+    // Service loops run until engine_stopping; jobs run on the executor
+    std::vector<std::thread> service_threads;
+
+    // Pick up runs interrupted by a restart in the background while the server
+    // starts - those of the engine this one replaces once it has drained
+    service_threads.emplace_back([api_key]() {
+        set_thread_name("resume");
+        resume_loop(api_key);
+    });
+
+    // Drain on SIGTERM
+    service_threads.emplace_back([&svr]() {
+        set_thread_name("signals");
+        signal_loop([&svr]() { svr.stop(); });
+    });
+
+    // Recycle SDK containers that stop delivering frames and callbacks
+    service_threads.emplace_back([]() {
+        set_thread_name("watchdog");
+        watchdog_loop();
+    });
+
+    // Re-run sampled jobs with candidate settings while the engine is idle
+    service_threads.emplace_back([api_key]() {
+        set_thread_name("shadow");
+        shadow_loop(api_key);
+    });
+
+    // Keep the last few seconds of camera footage for /camera/analyze-recent
+    if (camera_ring.enabled()) {
+        service_threads.emplace_back([]() {
+            set_thread_name("camera-ring");
+            camera_ring_loop();
+        });
+    }
+
+    // Long-lived streaming connections get their own epoll listener
+    raise_file_limit();
+#ifdef PRESAGE_SDK_AVAILABLE
+    if (stream_server.metrics_stream_enabled()) {
+        metrics_forwarder.start();
+    }
+#endif
+    if (!stream_server.start(stream_port)) {
+        std::cerr << "Failed to start streaming listener on port " << stream_port << std::endl;
+    }
+
+    // Start server. SO_REUSEPORT lets the next engine bind while this one drains.
+    svr.set_socket_options([](int sock) {
+        int one = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    });
+    set_thread_name("http-listen");
+    int exit_code = 0;
     if (!svr.listen("0.0.0.0", 8080)) {
         std::cerr << "Failed to start server on port 8080" << std::endl;
-        return 1;
+        exit_code = 1;
     }
 
-    return 0;
+    // Jobs finish first - suspended ones still need the timers and the
+    // watchdog - then the service loops stop. A shadow run gives way at once.
+    shadow_evaluation.stop();
+    job_pipeline->wait_idle();
+    timers->stop();
+    executor->shutdown();
+    engine_stopping = true;
+    stream_server.stop();
+#ifdef PRESAGE_SDK_AVAILABLE
+    metrics_forwarder.stop();
+#endif
+    for (auto& thread : service_threads) {
+        thread.join();
+    }
+    {
+        std::lock_guard<InstrumentedMutex> lock(containers_mutex);
+        if (!abandoned_runs.empty()) {
+            // A stuck SDK call can't be joined; leave it to process exit
+            std::cerr << abandoned_runs.size() << " recycled SDK containers never returned" << std::endl;
+            std::cout.flush();
+            std::_Exit(exit_code);
+        }
+    }
+    return exit_code;
 }
@@ -0,0 +1,601 @@
+// pipeline.hpp
+// Work-stealing executor, coroutine tasks and staged job pipelines
+//
+// Every processing job in the engine (single runs, batch videos, buffered
+// camera footage, resumed sessions) goes through one Pipeline: a chain of
+// named stages joined by bounded queues. Stages are C++20 coroutines (Task)
+// on a shared Executor sized to the CPU budget. A stage that waits - for a
+// container slot, for the SDK to finish, for a timer - suspends instead of
+// holding a thread, so a waiting job costs its coroutine frame.
+//
+// A stage that finishes an item while the next stage's queue is full parks it
+// and takes no new work until there is room again, so a slow stage pushes back
+// on everything before it, down to Pipeline::submit.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <pthread.h>
+
+// Fixed set of worker threads, each with its own task deque. A worker runs its
+// newest task first and, when it has none, steals the oldest task of another
+// worker, so tasks spawned by a task stay on the same thread while idle
+// workers still pick up the backlog.
+class Executor {
+public:
+    struct Stats {
+        size_t threads = 0;
+        size_t queued = 0;
+        size_t running = 0;
+        int64_t executed = 0;
+        int64_t stolen = 0;
+    };
+
+    explicit Executor(size_t threads) {
+        threads = std::max<size_t>(1, threads);
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            workers_[i]->thread = std::thread([this, i]() { run(i); });
+        }
+    }
+
+    ~Executor() { shutdown(); }
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // Queue a task: on the calling worker's own deque, or round-robin from outside
+    void submit(std::function<void()> task) {
+        size_t index = current_owner_ == this ? current_index_ : next_worker_++ % workers_.size();
+        {
+            std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+            workers_[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            queued_++;
+        }
+        idle_.notify_one();
+    }
+
+    // Finish queued tasks, then stop and join the workers
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            if (stopping_) {
+                return;
+            }
+            stopping_ = true;
+        }
+        idle_.notify_all();
+        for (auto& worker : workers_) {
+            if (worker->thread.joinable()) {
+                worker->thread.join();
+            }
+        }
+    }
+
+    size_t size() const { return workers_.size(); }
+
+    // co_await executor.schedule() - continue the coroutine on an executor thread
+    auto schedule() {
+        struct Awaiter {
+            Executor& executor;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { executor.submit([handle]() { handle.resume(); }); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+    Stats stats() {
+        Stats stats;
+        stats.threads = workers_.size();
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            stats.queued = queued_;
+        }
+        stats.running = running_.load();
+        stats.executed = executed_.load();
+        stats.stolen = stolen_.load();
+        return stats;
+    }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> next_worker_{0};
+    std::mutex idle_mutex_;
+    std::condition_variable idle_;
+    size_t queued_ = 0;  // Tasks in any deque; guarded by idle_mutex_ so sleepers can't miss one
+    bool stopping_ = false;
+    std::atomic<size_t> running_{0};
+    std::atomic<int64_t> executed_{0};
+    std::atomic<int64_t> stolen_{0};
+
+    static thread_local Executor* current_owner_;
+    static thread_local size_t current_index_;
+
+    bool take(size_t index, std::function<void()>& task) {
+        {
+            Worker& own = *workers_[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < workers_.size(); ++offset) {
+            Worker& victim = *workers_[(index + offset) % workers_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                stolen_++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(size_t index) {
+        current_owner_ = this;
+        current_index_ = index;
+        std::string name = "exec-" + std::to_string(index);
+        pthread_setname_np(pthread_self(), name.c_str());
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(idle_mutex_);
+                idle_.wait(lock, [this]() { return queued_ > 0 || stopping_; });
+                if (queued_ == 0) {
+                    return;
+                }
+            }
+            std::function<void()> task;
+            if (!take(index, task)) {
+                // Another worker got there first
+                std::this_thread::yield();
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(idle_mutex_);
+                queued_--;
+            }
+            running_++;
+            task();
+            running_--;
+            executed_++;
+        }
+    }
+};
+
+inline thread_local Executor* Executor::current_owner_ = nullptr;
+inline thread_local size_t Executor::current_index_ = 0;
+
+// Coroutine returning nothing. It starts suspended; either co_await it from
+// another coroutine (which resumes when it finishes) or start() it with a
+// completion callback, after which it owns itself. An exception escaping the
+// coroutine is rethrown to the awaiting coroutine, or dropped by start().
+class Task {
+public:
+    struct promise_type {
+        std::coroutine_handle<> continuation;
+        std::function<void()> on_complete;
+        std::exception_ptr error;
+        bool detached = false;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        auto final_suspend() noexcept {
+            struct Final {
+                bool await_ready() const noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                    promise_type& promise = handle.promise();
+                    if (promise.detached) {
+                        std::function<void()> on_complete = std::move(promise.on_complete);
+                        handle.destroy();
+                        if (on_complete) {
+                            on_complete();
+                        }
+                        return std::noop_coroutine();
+                    }
+                    return promise.continuation ? promise.continuation : std::noop_coroutine();
+                }
+                void await_resume() const noexcept {}
+            };
+            return Final{};
+        }
+
+        void return_void() {}
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    // Run on the calling thread until the first suspension
+    void start(std::function<void()> on_complete = nullptr) {
+        auto handle = std::exchange(handle_, nullptr);
+        handle.promise().detached = true;
+        handle.promise().on_complete = std::move(on_complete);
+        handle.resume();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+    void await_resume() {
+        if (handle_.promise().error) {
+            std::rethrow_exception(handle_.promise().error);
+        }
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// One thread that runs callbacks at deadlines, for sleeps and wait timeouts.
+// Callbacks should only hand work to an executor.
+class TimerService {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TimerService() : thread_([this]() { run(); }) {}
+    ~TimerService() { stop(); }
+
+    void schedule_at(Clock::time_point deadline, std::function<void()> callback) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            timers_.push(Timer{deadline, sequence_++, std::move(callback)});
+        }
+        wake_.notify_one();
+    }
+
+    // co_await timers.sleep_for(ms, executor) - resume on the executor after the delay
+    auto sleep_for(std::chrono::milliseconds delay, Executor& executor) {
+        struct Awaiter {
+            TimerService& timers;
+            Clock::time_point deadline;
+            Executor& executor;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) {
+                Executor* target = &executor;
+                timers.schedule_at(deadline, [target, handle]() { target->submit([handle]() { handle.resume(); }); });
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this, Clock::now() + delay, executor};
+    }
+
+    size_t pending() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return timers_.size();
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+private:
+    struct Timer {
+        Clock::time_point deadline;
+        uint64_t sequence;
+        std::function<void()> callback;
+        bool operator>(const Timer& other) const {
+            return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence;
+        }
+    };
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+    uint64_t sequence_ = 0;
+    bool stopping_ = false;
+    std::thread thread_;
+
+    void run() {
+        pthread_setname_np(pthread_self(), "timers");
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            if (timers_.empty()) {
+                wake_.wait(lock);
+                continue;
+            }
+            Clock::time_point next = timers_.top().deadline;
+            if (Clock::now() < next) {
+                wake_.wait_until(lock, next);
+                continue;
+            }
+            std::function<void()> callback = std::move(const_cast<Timer&>(timers_.top()).callback);
+            timers_.pop();
+            lock.unlock();
+            callback();
+            lock.lock();
+        }
+    }
+};
+
+// One-shot event a coroutine can wait on, optionally with a timeout. set()
+// may be called from any thread, e.g. an SDK callback or the thread running
+// the container; waiters resume on their executor.
+class AsyncEvent {
+public:
+    void set() {
+        std::vector<std::shared_ptr<Waiter>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            set_ = true;
+            waiters.swap(waiters_);
+        }
+        for (auto& waiter : waiters) {
+            waiter->fire();
+        }
+    }
+
+    bool is_set() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return set_;
+    }
+
+    // co_await event.wait(executor) - true once set
+    // co_await event.wait(executor, &timers, timeout) - false if the timeout came first
+    auto wait(Executor& executor, TimerService* timers = nullptr,
+              std::chrono::milliseconds timeout = std::chrono::milliseconds(0)) {
+        struct Awaiter {
+            AsyncEvent& event;
+            Executor& executor;
+            TimerService* timers;
+            std::chrono::milliseconds timeout;
+            bool await_ready() { return event.is_set(); }
+            bool await_suspend(std::coroutine_handle<> handle) {
+                auto waiter = std::make_shared<Waiter>();
+                waiter->handle = handle;
+                waiter->executor = &executor;
+                {
+                    std::lock_guard<std::mutex> lock(event.mutex_);
+                    if (event.set_) {
+                        return false;
+                    }
+                    // Drop waiters an earlier timeout already resumed
+                    auto& waiters = event.waiters_;
+                    waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+                                                 [](const auto& w) { return w->fired.load(); }),
+                                  waiters.end());
+                    waiters.push_back(waiter);
+                }
+                if (timers) {
+                    timers->schedule_at(TimerService::Clock::now() + timeout, [waiter]() { waiter->fire(); });
+                }
+                return true;
+            }
+            bool await_resume() { return event.is_set(); }
+        };
+        return Awaiter{*this, executor, timers, timeout};
+    }
+
+private:
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        Executor* executor = nullptr;
+        std::atomic<bool> fired{false};
+        // The event and the timeout race; whichever comes first resumes
+        void fire() {
+            if (!fired.exchange(true)) {
+                auto resume = handle;
+                executor->submit([resume]() { resume.resume(); });
+            }
+        }
+    };
+
+    std::mutex mutex_;
+    bool set_ = false;
+    std::vector<std::shared_ptr<Waiter>> waiters_;
+};
+
+// A chain of stages over items of type T (typically a shared_ptr to a job).
+// Stage coroutines start on the executor, at most `concurrency` in flight per
+// stage, and see every item in order of arrival. A stage counts as busy with
+// an item until its coroutine finishes, suspended or not. Items that should
+// skip the rest of the work (a failed job) still pass through, so the last
+// stage sees every item exactly once.
+template <typename T>
+class Pipeline {
+public:
+    struct StageStats {
+        std::string name;
+        size_t concurrency = 0;
+        size_t capacity = 0;
+        size_t queued = 0;
+        size_t queued_high_water = 0;
+        size_t running = 0;
+        size_t parked = 0;  // Finished, waiting for room downstream
+        int64_t processed = 0;
+        double busy_seconds = 0.0;  // Item time in the stage, including time suspended
+    };
+
+    explicit Pipeline(Executor& executor) : executor_(executor) {}
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // Stages run in the order they are added; add them all before submitting
+    void add_stage(const std::string& name, size_t concurrency, size_t capacity, std::function<Task(T)> work) {
+        auto stage = std::make_unique<Stage>();
+        stage->name = name;
+        stage->concurrency = std::max<size_t>(1, concurrency);
+        stage->capacity = std::max<size_t>(1, capacity);
+        stage->work = std::move(work);
+        stages_.push_back(std::move(stage));
+    }
+
+    // Change a stage's concurrency limit (e.g. after the container pool is resized)
+    void set_concurrency(const std::string& name, size_t concurrency) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& stage : stages_) {
+            if (stage->name == name) {
+                stage->concurrency = std::max<size_t>(1, concurrency);
+            }
+        }
+        pump();
+    }
+
+    // Queue an item at the first stage, waiting while it is full
+    void submit(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        Stage& first = *stages_.front();
+        room_.wait(lock, [&first]() { return first.queue.size() < first.capacity; });
+        enqueue(first, std::move(item));
+        in_flight_++;
+        pump();
+    }
+
+    // Block until every submitted item has left the last stage
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this]() { return in_flight_ == 0; });
+    }
+
+    // wait_idle with a limit; false if items are still in flight when it runs out
+    bool wait_idle_for(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return idle_.wait_for(lock, timeout, [this]() { return in_flight_ == 0; });
+    }
+
+    std::vector<StageStats> stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<StageStats> all;
+        for (const auto& stage : stages_) {
+            StageStats stats;
+            stats.name = stage->name;
+            stats.concurrency = stage->concurrency;
+            stats.capacity = stage->capacity;
+            stats.queued = stage->queue.size();
+            stats.queued_high_water = stage->high_water;
+            stats.running = stage->running;
+            stats.parked = stage->parked.size();
+            stats.processed = stage->processed;
+            stats.busy_seconds = stage->busy_seconds;
+            all.push_back(stats);
+        }
+        return all;
+    }
+
+private:
+    struct Stage {
+        std::string name;
+        size_t concurrency = 1;
+        size_t capacity = 1;
+        std::function<Task(T)> work;
+        std::deque<T> queue;
+        std::deque<T> parked;
+        size_t running = 0;
+        size_t high_water = 0;
+        int64_t processed = 0;
+        double busy_seconds = 0.0;
+    };
+
+    Executor& executor_;
+    std::vector<std::unique_ptr<Stage>> stages_;
+    std::mutex mutex_;
+    std::condition_variable room_;  // Space at the first stage
+    std::condition_variable idle_;
+    size_t in_flight_ = 0;
+
+    void enqueue(Stage& stage, T item) {
+        stage.queue.push_back(std::move(item));
+        stage.high_water = std::max(stage.high_water, stage.queue.size());
+    }
+
+    // Move parked items downstream and start whatever may run; call with mutex_ held
+    void pump() {
+        // Starting work frees queue slots, which lets parked items move up,
+        // which may start more work; repeat until nothing changes
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t i = stages_.size(); i-- > 0;) {
+                Stage& stage = *stages_[i];
+                while (stage.parked.empty() && stage.running < stage.concurrency && !stage.queue.empty()) {
+                    T item = std::move(stage.queue.front());
+                    stage.queue.pop_front();
+                    stage.running++;
+                    executor_.submit([this, i, item = std::move(item)]() mutable { execute(i, std::move(item)); });
+                    changed = true;
+                }
+                if (i > 0) {
+                    Stage& previous = *stages_[i - 1];
+                    while (!previous.parked.empty() && stage.queue.size() < stage.capacity) {
+                        enqueue(stage, std::move(previous.parked.front()));
+                        previous.parked.pop_front();
+                        changed = true;
+                    }
+                }
+            }
+        }
+        if (stages_.front()->queue.size() < stages_.front()->capacity) {
+            room_.notify_all();
+        }
+    }
+
+    void execute(size_t index, T item) {
+        auto started = std::chrono::steady_clock::now();
+        Task task = stages_[index]->work(item);
+        task.start([this, index, item = std::move(item), started]() mutable { finish(index, std::move(item), started); });
+    }
+
+    void finish(size_t index, T item, std::chrono::steady_clock::time_point started) {
+        Stage& stage = *stages_[index];
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stage.running--;
+        stage.processed++;
+        stage.busy_seconds += seconds;
+        if (index + 1 < stages_.size()) {
+            stage.parked.push_back(std::move(item));
+        } else if (--in_flight_ == 0) {
+            idle_.notify_all();
+        }
+        pump();
+    }
+};
@@ -0,0 +1,143 @@
+/* presage_engine.h
+ * C ABI of presage_engine_core, the embeddable engine library
+ *
+ * Runs SmartSpectra processing inside the caller's process, without the HTTP
+ * server. Sessions are written to the same archive layout as the engine
+ * (readings store and summary.json under <archive_dir>/<session_id>), so an
+ * engine pointed at the same directory serves them through /sessions.
+ *
+ * Typical use:
+ *   presage_engine_create(api_key, "/app/uploads/sessions", &engine);
+ *   presage_session_create(engine, NULL, &session);
+ *   presage_session_process_file(session, "/app/uploads/clip.mp4");
+ *   while (presage_session_wait(session, 1000) == PRESAGE_ERROR_TIMEOUT) {
+ *       n = presage_session_poll(session, cursor, buffer, 64);  // or subscribe
+ *       cursor += n;
+ *   }
+ *   presage_session_summary(session, &json); ... presage_free(json);
+ *   presage_session_destroy(session);
+ *   presage_engine_destroy(engine);
+ *
+ * Compatibility: functions are only ever added. Structs passed by pointer keep
+ * their layout within an ABI version; check presage_engine_abi_version().
+ * Unless noted, functions are safe to call from any thread.
+ */
+
+#ifndef PRESAGE_ENGINE_H
+#define PRESAGE_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define PRESAGE_API __attribute__((visibility("default")))
+#else
+#define PRESAGE_API
+#endif
+
+#define PRESAGE_ENGINE_ABI_VERSION 1
+
+typedef struct presage_engine presage_engine;
+typedef struct presage_session presage_session;
+
+typedef enum {
+    PRESAGE_OK = 0,
+    PRESAGE_ERROR_INVALID_ARGUMENT = 1,
+    PRESAGE_ERROR_STATE = 2,      /* Call not valid in the session's current state */
+    PRESAGE_ERROR_IO = 3,
+    PRESAGE_ERROR_SDK = 4,        /* SDK missing, or it failed to process */
+    PRESAGE_ERROR_TIMEOUT = 5
+} presage_status;
+
+typedef enum {
+    PRESAGE_SESSION_IDLE = 0,       /* Created, no input yet */
+    PRESAGE_SESSION_RECEIVING = 1,  /* Frames being pushed */
+    PRESAGE_SESSION_RUNNING = 2,
+    PRESAGE_SESSION_COMPLETE = 3,
+    PRESAGE_SESSION_FAILED = 4
+} presage_session_state;
+
+/* One reading; NaN marks a channel the SDK did not report */
+typedef struct {
+    int64_t timestamp_ms;
+    float heart_rate_bpm;
+    float breathing_rate_bpm;
+} presage_reading;
+
+/* Read-only view of a session's readings columns, mapped from the archive
+ * without copying. Valid until presage_readings_view_release. */
+typedef struct {
+    uint64_t rows;
+    const int64_t* timestamp_ms;
+    const float* heart_rate_bpm;
+    const float* breathing_rate_bpm;
+    void* internal;
+} presage_readings_view;
+
+/* Called on an SDK thread for every new reading; index is its row number.
+ * Must return quickly and must not call presage_session_destroy. */
+typedef void (*presage_reading_callback)(void* user_data, const presage_reading* reading, uint64_t index);
+
+PRESAGE_API uint32_t presage_engine_abi_version(void);
+
+/* Message for the last failed call on this thread (empty if none). No call
+ * lets a C++ exception escape; an internal error is reported as a status. */
+PRESAGE_API const char* presage_last_error(void);
+
+/* Free memory returned by this library (summary JSON) */
+PRESAGE_API void presage_free(void* pointer);
+
+/* One engine per process is typical; it initialises the SDK on first use */
+PRESAGE_API presage_status presage_engine_create(const char* api_key, const char* archive_dir, presage_engine** engine);
+/* Destroy every session first */
+PRESAGE_API void presage_engine_destroy(presage_engine* engine);
+
+/* settings_json may be NULL or an object with any of:
+ *   buffer_duration_s   SDK preprocessing buffer (default 0.5)
+ *   frames_fps          Frame rate of pushed frames (default 30) */
+PRESAGE_API presage_status presage_session_create(presage_engine* engine, const char* settings_json, presage_session** session);
+/* Open a finished session from the archive, for its readings and summary */
+PRESAGE_API presage_status presage_session_open(presage_engine* engine, const char* session_id, presage_session** session);
+/* Waits for processing to finish, then frees the handle (the archive stays) */
+PRESAGE_API void presage_session_destroy(presage_session* session);
+
+PRESAGE_API const char* presage_session_id(const presage_session* session);
+PRESAGE_API presage_session_state presage_session_get_state(const presage_session* session);
+
+/* Process a video file in the background (IDLE sessions only) */
+PRESAGE_API presage_status presage_session_process_file(presage_session* session, const char* video_path);
+
+/* Append one BGR frame (8 bits per channel, rows stride bytes apart). Every
+ * frame must have the first frame's size. Frames are encoded into the
+ * session directory; presage_session_end_frames starts processing them.
+ * Push frames for a session from one thread at a time. */
+PRESAGE_API presage_status presage_session_push_frame(presage_session* session, const uint8_t* bgr,
+                                                      int width, int height, size_t stride);
+PRESAGE_API presage_status presage_session_end_frames(presage_session* session);
+
+/* Wait until the session is COMPLETE or FAILED; timeout_ms < 0 waits forever */
+PRESAGE_API presage_status presage_session_wait(presage_session* session, int timeout_ms);
+
+/* Copy up to capacity readings starting at row `after`; returns the count */
+PRESAGE_API size_t presage_session_poll(presage_session* session, uint64_t after, presage_reading* readings, size_t capacity);
+
+/* Receive every new reading as it arrives (one subscriber per session; NULL removes it) */
+PRESAGE_API presage_status presage_session_subscribe(presage_session* session, presage_reading_callback callback, void* user_data);
+
+/* Map the readings stored so far. Release every view before destroying the session. */
+PRESAGE_API presage_status presage_session_map_readings(presage_session* session, presage_readings_view* view);
+PRESAGE_API void presage_readings_view_release(presage_readings_view* view);
+
+/* Session summary as JSON (the engine's summary.json); free with presage_free.
+ * PRESAGE_ERROR_STATE until the session is COMPLETE or FAILED. */
+PRESAGE_API presage_status presage_session_summary(presage_session* session, char** summary_json);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PRESAGE_ENGINE_H */
@@ -0,0 +1,298 @@
+// rest_standin.cpp
+// Local stand-in for the SmartSpectra REST integration
+//
+// An HTTPS proxy (HTTP CONNECT) for the engine's REST traffic. Point the
+// engine at it with PRESAGE_REST_PROXY=http://127.0.0.1:3128 and it injects
+// latency and failures, so latency experiments and perf tests are
+// reproducible. With --upstream every tunnel goes to a fixed host:port, for
+// example a local server replaying recorded responses, instead of the
+// remote service.
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <mutex>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+struct StandinOptions {
+    int port = 3128;
+    int latency_ms = 0;       // Added before each response
+    int jitter_ms = 0;        // Uniform +/- on top of latency_ms
+    double fail_rate = 0.0;   // Fraction of tunnels refused with 502
+    double reset_rate = 0.0;  // Fraction of responses cut off mid-tunnel
+    unsigned seed = 1;
+    std::string upstream;     // host:port every tunnel goes to (empty: the CONNECT target)
+};
+
+StandinOptions options;
+std::mutex rng_mutex;
+std::mt19937 rng;
+std::atomic<int> next_tunnel_id{0};
+
+double random_unit() {
+    std::lock_guard<std::mutex> lock(rng_mutex);
+    return std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+}
+
+int injected_latency_ms() {
+    if (options.jitter_ms == 0) {
+        return options.latency_ms;
+    }
+    std::lock_guard<std::mutex> lock(rng_mutex);
+    int jitter = std::uniform_int_distribution<int>(-options.jitter_ms, options.jitter_ms)(rng);
+    return std::max(0, options.latency_ms + jitter);
+}
+
+bool send_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        length -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+int connect_to(const std::string& host, const std::string& port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* results = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &results) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo* ai = results; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(results);
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+// Split "host:port", defaulting the port to 443
+void split_host_port(const std::string& target, std::string& host, std::string& port) {
+    size_t colon = target.rfind(':');
+    if (colon == std::string::npos) {
+        host = target;
+        port = "443";
+    } else {
+        host = target.substr(0, colon);
+        port = target.substr(colon + 1);
+    }
+}
+
+// Serve one client: read the CONNECT request, open the tunnel and pump bytes.
+// The first upstream bytes after each client write are treated as the start of
+// a response, which is where latency and resets are injected.
+void handle_client(int client_fd) {
+    int tunnel_id = next_tunnel_id++;
+    auto started = std::chrono::steady_clock::now();
+
+    std::string request;
+    char buffer[16384];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+        ssize_t n = recv(client_fd, buffer, sizeof(buffer), 0);
+        if (n <= 0 || request.size() > 65536) {
+            close(client_fd);
+            return;
+        }
+        request.append(buffer, static_cast<size_t>(n));
+    }
+    size_t header_end = request.find("\r\n\r\n") + 4;
+    std::string early_data = request.substr(header_end);
+
+    char method[16] = {0};
+    char target[1024] = {0};
+    if (sscanf(request.c_str(), "%15s %1023s", method, target) != 2 || std::string(method) != "CONNECT") {
+        const char* reply = "HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\n\r\n";
+        send_all(client_fd, reply, strlen(reply));
+        close(client_fd);
+        return;
+    }
+
+    if (random_unit() < options.fail_rate) {
+        std::cout << "[tunnel " << tunnel_id << "] " << target << " refused (injected failure)" << std::endl;
+        const char* reply = "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n";
+        send_all(client_fd, reply, strlen(reply));
+        close(client_fd);
+        return;
+    }
+
+    std::string host, port;
+    split_host_port(options.upstream.empty() ? target : options.upstream, host, port);
+    int upstream_fd = connect_to(host, port);
+    if (upstream_fd < 0) {
+        std::cerr << "[tunnel " << tunnel_id << "] cannot reach " << host << ":" << port << std::endl;
+        const char* reply = "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n";
+        send_all(client_fd, reply, strlen(reply));
+        close(client_fd);
+        return;
+    }
+
+    const char* established = "HTTP/1.1 200 Connection Established\r\n\r\n";
+    if (!send_all(client_fd, established, strlen(established)) ||
+        (!early_data.empty() && !send_all(upstream_fd, early_data.data(), early_data.size()))) {
+        close(upstream_fd);
+        close(client_fd);
+        return;
+    }
+
+    size_t bytes_up = early_data.size();
+    size_t bytes_down = 0;
+    int responses = 0;
+    int64_t injected_ms = 0;
+    bool awaiting_response = !early_data.empty();
+    bool reset = false;
+
+    pollfd fds[2] = {{client_fd, POLLIN, 0}, {upstream_fd, POLLIN, 0}};
+    while (!reset) {
+        if (poll(fds, 2, -1) <= 0) {
+            break;
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = recv(client_fd, buffer, sizeof(buffer), 0);
+            if (n <= 0 || !send_all(upstream_fd, buffer, static_cast<size_t>(n))) {
+                break;
+            }
+            bytes_up += static_cast<size_t>(n);
+            awaiting_response = true;
+        }
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = recv(upstream_fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                break;
+            }
+            if (awaiting_response) {
+                awaiting_response = false;
+                responses++;
+                if (random_unit() < options.reset_rate) {
+                    std::cout << "[tunnel " << tunnel_id << "] response " << responses << " reset (injected failure)" << std::endl;
+                    reset = true;
+                    break;
+                }
+                int delay_ms = injected_latency_ms();
+                if (delay_ms > 0) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+                    injected_ms += delay_ms;
+                }
+            }
+            if (!send_all(client_fd, buffer, static_cast<size_t>(n))) {
+                break;
+            }
+            bytes_down += static_cast<size_t>(n);
+        }
+    }
+
+    if (reset) {
+        // RST rather than FIN, like a dropped connection
+        linger hard_close{1, 0};
+        setsockopt(client_fd, SOL_SOCKET, SO_LINGER, &hard_close, sizeof(hard_close));
+    }
+    close(upstream_fd);
+    close(client_fd);
+
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    std::cout << "[tunnel " << tunnel_id << "] " << target << " closed after " << elapsed_ms << " ms: "
+              << responses << " responses, " << bytes_up << " B up, " << bytes_down << " B down, "
+              << injected_ms << " ms injected" << std::endl;
+}
+
+void print_usage() {
+    std::cout << "Usage: ./rest_standin [options]\n";
+    std::cout << "  --port N          Listen port (default 3128)\n";
+    std::cout << "  --latency-ms N    Latency added before each response (default 0)\n";
+    std::cout << "  --jitter-ms N     Uniform +/- jitter on the latency (default 0)\n";
+    std::cout << "  --fail-rate F     Fraction of tunnels refused with 502 (default 0)\n";
+    std::cout << "  --reset-rate F    Fraction of responses cut off by a reset (default 0)\n";
+    std::cout << "  --seed N          Random seed, for reproducible runs (default 1)\n";
+    std::cout << "  --upstream H:P    Send every tunnel to H:P instead of the requested host\n";
+    std::cout << "Then start the engine with PRESAGE_REST_PROXY=http://127.0.0.1:<port>\n";
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << "\n";
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        if (arg == "--port") {
+            options.port = std::stoi(next());
+        } else if (arg == "--latency-ms") {
+            options.latency_ms = std::stoi(next());
+        } else if (arg == "--jitter-ms") {
+            options.jitter_ms = std::stoi(next());
+        } else if (arg == "--fail-rate") {
+            options.fail_rate = std::stod(next());
+        } else if (arg == "--reset-rate") {
+            options.reset_rate = std::stod(next());
+        } else if (arg == "--seed") {
+            options.seed = static_cast<unsigned>(std::stoul(next()));
+        } else if (arg == "--upstream") {
+            options.upstream = next();
+        } else {
+            print_usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    rng.seed(options.seed);
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(options.port));
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listen_fd, 128) != 0) {
+        std::cerr << "Failed to listen on port " << options.port << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    std::cout << "REST stand-in listening on port " << options.port
+              << " (latency " << options.latency_ms << "+/-" << options.jitter_ms << " ms, fail rate "
+              << options.fail_rate << ", reset rate " << options.reset_rate << ", seed " << options.seed << ")\n";
+    if (!options.upstream.empty()) {
+        std::cout << "All tunnels go to " << options.upstream << "\n";
+    }
+
+    while (true) {
+        int client_fd = accept(listen_fd, nullptr, nullptr);
+        if (client_fd < 0) {
+            continue;
+        }
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::thread(handle_client, client_fd).detach();
+    }
+}
@@ -0,0 +1,300 @@
+// roi_bench.cpp
+// Benchmark for the face-tracking ROI crop stage (roi_crop.hpp)
+//
+// Reports what the crop costs and saves on one video:
+//   1. The crop stage itself: time, detections, tracked and lost frames.
+//   2. Decode cost of the full video against the cropped one.
+//   3. Tracker accuracy against running the face detector on every frame:
+//      IoU with the detected face and how often the face stays inside the crop.
+//   4. With an API key, the SDK on both videos: process CPU time and the
+//      difference in heart and breathing rate readings.
+//
+// Run: ./roi_bench --input /app/uploads/test-video.mp4 [--api-key KEY]
+
+#include <smartspectra/container/foreground_container.hpp>
+#include <smartspectra/container/settings.hpp>
+#include <physiology/modules/messages/metrics.h>
+#include <physiology/modules/messages/status.h>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cmath>
+#include <chrono>
+#include <cstdlib>
+#include <sys/resource.h>
+
+#include "roi_crop.hpp"
+
+using namespace presage::smartspectra;
+
+struct BenchOptions {
+    std::string input;
+    std::string output = "/tmp/roi_bench_crop.mp4";
+    std::string api_key;
+    RoiCropOptions roi;
+};
+
+// CPU seconds used by the whole process so far, all threads
+double process_cpu_seconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Decode every frame and touch its pixels, as the first step of any pipeline does
+double decode_cpu_seconds(const std::string& path, int64_t& frames) {
+    double started = process_cpu_seconds();
+    cv::VideoCapture capture(path);
+    cv::Mat frame;
+    cv::Mat gray;
+    frames = 0;
+    while (capture.read(frame)) {
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+        frames++;
+    }
+    return process_cpu_seconds() - started;
+}
+
+double iou(const cv::Rect& a, const cv::Rect& b) {
+    double intersection = (a & b).area();
+    double combined = a.area() + b.area() - intersection;
+    return combined > 0 ? intersection / combined : 0.0;
+}
+
+// Replay the tracker and compare it with the detector run on every frame
+void measure_tracking(const BenchOptions& options) {
+    FaceRoiTracker tracker(options.roi);
+    FaceRoiTracker reference(options.roi);
+    if (!tracker.load() || !reference.load()) {
+        std::cerr << "Cannot load face cascade " << options.roi.cascade_path << "\n";
+        return;
+    }
+    cv::VideoCapture capture(options.input);
+    cv::Size frame_size(static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH)),
+                        static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT)));
+    std::vector<cv::Mat> samples;
+    int64_t frame_count = static_cast<int64_t>(capture.get(cv::CAP_PROP_FRAME_COUNT));
+    for (int i = 0; i < options.roi.sample_frames; ++i) {
+        capture.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(frame_count * i / options.roi.sample_frames));
+        cv::Mat frame;
+        if (capture.read(frame)) {
+            samples.push_back(frame);
+        }
+    }
+    if (!tracker.set_crop_size(samples, frame_size)) {
+        std::cerr << "No face found in sample frames\n";
+        return;
+    }
+    capture.set(cv::CAP_PROP_POS_FRAMES, 0);
+
+    int64_t compared = 0;
+    int64_t contained = 0;
+    double iou_sum = 0.0;
+    cv::Mat frame;
+    cv::Mat gray;
+    cv::Rect previous;
+    while (capture.read(frame)) {
+        cv::Rect window = tracker.next(frame);
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+        cv::Rect detected;
+        if (!reference.detect(gray, detected, previous.empty() ? nullptr : &previous)) {
+            continue;
+        }
+        previous = detected;
+        compared++;
+        iou_sum += iou(tracker.face(), detected);
+        if ((detected & window).area() == detected.area()) {
+            contained++;
+        }
+    }
+    std::cout << "Tracking vs per-frame detection (" << compared << " frames with a detected face):\n";
+    if (compared > 0) {
+        std::cout << "  mean IoU:               " << iou_sum / compared << "\n";
+        std::cout << "  face inside crop:       " << 100.0 * contained / compared << "%\n";
+    }
+}
+
+struct SdkRun {
+    bool ok = false;
+    double cpu_seconds = 0.0;
+    double wall_seconds = 0.0;
+    std::map<int64_t, std::pair<float, float>> readings;  // timestamp -> heart rate, breathing rate (NaN if absent)
+};
+
+SdkRun run_sdk(const std::string& api_key, const std::string& video_path) {
+    SdkRun result;
+    std::mutex readings_mutex;
+    container::settings::Settings<
+        container::settings::OperationMode::Continuous,
+        container::settings::IntegrationMode::Rest
+    > settings;
+    settings.video_source.device_index = -1;
+    settings.video_source.input_video_path = video_path;
+    settings.video_source.input_video_time_path = "";
+    settings.video_source.codec = presage::camera::CaptureCodec::MJPG;
+    settings.video_source.auto_lock = true;
+    settings.headless = true;
+    settings.enable_edge_metrics = true;
+    settings.verbosity_level = 0;
+    settings.continuous.preprocessed_data_buffer_duration_s = 0.5;
+    settings.integration.api_key = api_key;
+
+    auto container = std::make_unique<container::CpuContinuousRestForegroundContainer>(settings);
+    auto status = container->SetOnCoreMetricsOutput(
+        [&](const presage::physiology::MetricsBuffer& metrics, int64_t timestamp) {
+            float pulse = metrics.pulse().rate().empty() ? NAN : metrics.pulse().rate().rbegin()->value();
+            float breathing = metrics.breathing().rate().empty() ? NAN : metrics.breathing().rate().rbegin()->value();
+            std::lock_guard<std::mutex> lock(readings_mutex);
+            result.readings[timestamp] = {pulse, breathing};
+            return absl::OkStatus();
+        });
+    if (!status.ok()) {
+        std::cerr << "Failed to set metrics callback: " << status.message() << "\n";
+        return result;
+    }
+    if (auto init_status = container->Initialize(); !init_status.ok()) {
+        std::cerr << "Failed to initialize: " << init_status.message() << "\n";
+        return result;
+    }
+
+    double cpu_started = process_cpu_seconds();
+    auto wall_started = std::chrono::steady_clock::now();
+    status = container->Run();
+    result.cpu_seconds = process_cpu_seconds() - cpu_started;
+    result.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_started).count();
+    result.ok = status.ok() || !result.readings.empty();
+    return result;
+}
+
+// Mean absolute difference of readings matched to the nearest timestamp
+void compare_readings(const SdkRun& full, const SdkRun& cropped) {
+    double hr_diff = 0.0, br_diff = 0.0;
+    int hr_count = 0, br_count = 0;
+    std::cout << "  readings:               " << full.readings.size() << " full, " << cropped.readings.size() << " cropped\n";
+    if (full.readings.empty()) {
+        return;
+    }
+    for (const auto& [timestamp, values] : cropped.readings) {
+        auto match = full.readings.lower_bound(timestamp);
+        if (match == full.readings.end() ||
+            (match != full.readings.begin() && timestamp - std::prev(match)->first < match->first - timestamp)) {
+            match = std::prev(match);
+        }
+        if (!std::isnan(values.first) && !std::isnan(match->second.first)) {
+            hr_diff += std::fabs(values.first - match->second.first);
+            hr_count++;
+        }
+        if (!std::isnan(values.second) && !std::isnan(match->second.second)) {
+            br_diff += std::fabs(values.second - match->second.second);
+            br_count++;
+        }
+    }
+    if (hr_count > 0) {
+        std::cout << "  heart rate MAE:         " << hr_diff / hr_count << " BPM (" << hr_count << " pairs)\n";
+    }
+    if (br_count > 0) {
+        std::cout << "  breathing rate MAE:     " << br_diff / br_count << " breaths/min (" << br_count << " pairs)\n";
+    }
+}
+
+void print_usage() {
+    std::cout << "Usage: ./roi_bench --input VIDEO [options]\n";
+    std::cout << "  --input VIDEO          Video to benchmark\n";
+    std::cout << "  --output PATH          Where to write the cropped video (default /tmp/roi_bench_crop.mp4)\n";
+    std::cout << "  --api-key KEY          Also run the SDK on both videos (or SMARTSPECTRA_API_KEY)\n";
+    std::cout << "  --detect-interval N    Frames between face detections (default 15)\n";
+    std::cout << "  --margin F             Padding around the face, fraction of its size (default 0.6)\n";
+    std::cout << "  --output-px N          Side of the cropped frames (default 480)\n";
+    std::cout << "  --cascade PATH         Haar cascade for face detection\n";
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (const char* env_key = std::getenv("SMARTSPECTRA_API_KEY")) {
+        options.api_key = env_key;
+    }
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << "\n";
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        if (arg == "--input") {
+            options.input = next();
+        } else if (arg == "--output") {
+            options.output = next();
+        } else if (arg == "--api-key") {
+            options.api_key = next();
+        } else if (arg == "--detect-interval") {
+            options.roi.detect_interval = std::max(1, std::stoi(next()));
+        } else if (arg == "--margin") {
+            options.roi.margin = std::stod(next());
+        } else if (arg == "--output-px") {
+            options.roi.output_px = std::stoi(next());
+        } else if (arg == "--cascade") {
+            options.roi.cascade_path = next();
+        } else {
+            print_usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if (options.input.empty()) {
+        print_usage();
+        return 1;
+    }
+
+    google::InitGoogleLogging(argv[0]);
+
+    double crop_cpu_started = process_cpu_seconds();
+    RoiCropStats stats;
+    if (!crop_video_to_face(options.input, options.output, options.roi, stats)) {
+        std::cerr << "Crop failed: " << stats.error << "\n";
+        return 1;
+    }
+    double crop_cpu = process_cpu_seconds() - crop_cpu_started;
+    std::cout << "Crop stage:\n";
+    std::cout << "  " << stats.source_size.width << "x" << stats.source_size.height << " -> "
+              << stats.output_size.width << "x" << stats.output_size.height << " ("
+              << 100.0 * stats.pixel_ratio() << "% of pixels)\n";
+    std::cout << "  frames:                 " << stats.frames << " (" << stats.detections << " detections, "
+              << stats.detections_missed << " missed, " << stats.tracked_frames << " tracked, "
+              << stats.lost_frames << " lost)\n";
+    std::cout << "  time:                   " << stats.seconds << "s wall, " << crop_cpu << "s CPU ("
+              << stats.frames / std::max(stats.seconds, 1e-9) << " fps)\n";
+
+    int64_t full_frames = 0;
+    int64_t cropped_frames = 0;
+    double full_decode = decode_cpu_seconds(options.input, full_frames);
+    double cropped_decode = decode_cpu_seconds(options.output, cropped_frames);
+    std::cout << "Decode:\n";
+    std::cout << "  full:                   " << full_decode << "s CPU for " << full_frames << " frames\n";
+    std::cout << "  cropped:                " << cropped_decode << "s CPU for " << cropped_frames << " frames\n";
+
+    measure_tracking(options);
+
+    if (options.api_key.empty()) {
+        std::cout << "SDK comparison skipped (no --api-key)\n";
+        return 0;
+    }
+    SdkRun full = run_sdk(options.api_key, options.input);
+    SdkRun cropped = run_sdk(options.api_key, options.output);
+    if (!full.ok || !cropped.ok) {
+        std::cerr << "SDK run failed\n";
+        return 1;
+    }
+    std::cout << "SDK:\n";
+    std::cout << "  full:                   " << full.cpu_seconds << "s CPU, " << full.wall_seconds << "s wall\n";
+    std::cout << "  cropped:                " << cropped.cpu_seconds << "s CPU, " << cropped.wall_seconds
+              << "s wall (+ " << crop_cpu << "s CPU for the crop stage)\n";
+    double saved = full.cpu_seconds - cropped.cpu_seconds - crop_cpu;
+    std::cout << "  CPU saved:              " << saved << "s (" << 100.0 * saved / std::max(full.cpu_seconds, 1e-9) << "%)\n";
+    compare_readings(full, cropped);
+    return 0;
+}
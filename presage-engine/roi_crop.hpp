@@ -0,0 +1,284 @@
+// roi_crop.hpp
+// Face-tracking ROI crop stage
+//
+// Most clips are wide shots where the face covers a small part of the frame,
+// yet every pixel goes through decode and SDK preprocessing. This stage
+// re-encodes a video as a stabilised crop around the face: a Haar cascade
+// finds the face every detect_interval frames, template matching tracks it
+// in between, and the crop centre is smoothed so the SDK sees a steady ROI.
+// Frames are neither dropped nor added, so frame offsets and timestamps match
+// the original video. Used by main.cpp (the "roi_crop" setting) and roi_bench.
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct RoiCropOptions {
+    std::string cascade_path = "/usr/share/opencv4/haarcascades/haarcascade_frontalface_default.xml";
+    int detect_interval = 15;   // Frames between cascade detections; the tracker fills the gaps
+    double margin = 0.6;        // Padding on each side of the face, as a fraction of its size
+    int output_px = 480;        // Side of the square output frames (never upscaled)
+    double smoothing = 0.15;    // Weight of each new face position in the crop centre
+    int sample_frames = 8;      // Frames scanned up front to size the crop
+};
+
+struct RoiCropStats {
+    int64_t frames = 0;
+    int64_t detections = 0;         // Cascade runs
+    int64_t detections_missed = 0;  // Cascade runs that found no face
+    int64_t tracked_frames = 0;     // Frames placed by template matching
+    int64_t lost_frames = 0;        // Frames with no face estimate (crop held in place)
+    cv::Size source_size;
+    cv::Size output_size;
+    double seconds = 0.0;
+    std::string error;
+
+    // Fraction of source pixels that reach the SDK
+    double pixel_ratio() const {
+        double source = static_cast<double>(source_size.width) * source_size.height;
+        return source > 0 ? output_size.area() / source : 1.0;
+    }
+};
+
+// Follows one face through a sequence of frames and yields a fixed-size crop
+// window per frame. Call set_crop_size once, then next() for every frame.
+class FaceRoiTracker {
+public:
+    explicit FaceRoiTracker(const RoiCropOptions& options) : options_(options) {}
+
+    bool load() { return cascade_.load(options_.cascade_path) && !cascade_.empty(); }
+
+    // The SDK needs a constant frame size, so the crop is sized once from the
+    // largest face found in a few sample frames. False if none has a face.
+    bool set_crop_size(const std::vector<cv::Mat>& samples, cv::Size frame_size) {
+        frame_size_ = frame_size;
+        int largest = 0;
+        for (const auto& sample : samples) {
+            cv::Mat gray;
+            cv::cvtColor(sample, gray, cv::COLOR_BGR2GRAY);
+            cv::Rect face;
+            if (detect(gray, face, nullptr)) {
+                largest = std::max(largest, std::max(face.width, face.height));
+            }
+        }
+        if (largest == 0) {
+            return false;
+        }
+        int side = static_cast<int>(largest * (1.0 + 2.0 * options_.margin));
+        side = std::min({side, frame_size.width, frame_size.height}) & ~1;
+        crop_size_ = cv::Size(side, side);
+        centre_x_ = frame_size.width / 2.0;
+        centre_y_ = frame_size.height / 2.0;
+        return true;
+    }
+
+    cv::Size crop_size() const { return crop_size_; }
+
+    // Output frame size: the crop scaled down to output_px
+    cv::Size output_size() const {
+        int side = std::min(crop_size_.width, options_.output_px) & ~1;
+        return cv::Size(side, side);
+    }
+
+    // Crop window for the next frame, in frame pixels
+    cv::Rect next(const cv::Mat& frame) {
+        cv::Mat gray;
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+
+        cv::Rect observed;
+        bool found = false;
+        if (frame_index_ % options_.detect_interval == 0 || lost_) {
+            detections++;
+            if (detect(gray, observed, has_face_ ? &face_ : nullptr)) {
+                found = true;
+                lost_ = false;
+                template_ = gray(observed).clone();
+            } else {
+                detections_missed++;
+            }
+        }
+        if (!found && has_face_ && !lost_) {
+            found = track(gray, observed);
+            if (found) {
+                tracked_frames++;
+            } else {
+                lost_ = true;
+            }
+        }
+
+        if (found) {
+            face_ = observed;
+            double x = observed.x + observed.width / 2.0;
+            double y = observed.y + observed.height / 2.0;
+            if (!has_face_) {
+                centre_x_ = x;
+                centre_y_ = y;
+            } else {
+                centre_x_ += options_.smoothing * (x - centre_x_);
+                centre_y_ += options_.smoothing * (y - centre_y_);
+            }
+            has_face_ = true;
+        } else {
+            lost_frames++;
+        }
+        frame_index_++;
+
+        int x = static_cast<int>(centre_x_ - crop_size_.width / 2.0);
+        int y = static_cast<int>(centre_y_ - crop_size_.height / 2.0);
+        x = std::clamp(x, 0, frame_size_.width - crop_size_.width);
+        y = std::clamp(y, 0, frame_size_.height - crop_size_.height);
+        return cv::Rect(x, y, crop_size_.width, crop_size_.height);
+    }
+
+    // Latest face estimate, detected or tracked (empty before the first face)
+    cv::Rect face() const { return has_face_ ? face_ : cv::Rect(); }
+
+    // Run the cascade on a grayscale frame, downscaled for speed. With near,
+    // the face closest to it wins, so the crop stays on the same patient.
+    bool detect(const cv::Mat& gray, cv::Rect& face, const cv::Rect* near) {
+        double scale = std::min(1.0, 480.0 / std::max(1, gray.cols));
+        cv::Mat small;
+        cv::resize(gray, small, cv::Size(), scale, scale, cv::INTER_AREA);
+        cv::equalizeHist(small, small);
+        std::vector<cv::Rect> faces;
+        cascade_.detectMultiScale(small, faces, 1.1, 4, 0, cv::Size(24, 24));
+        if (faces.empty()) {
+            return false;
+        }
+        auto distance = [near](const cv::Rect& r) {
+            double dx = (r.x + r.width / 2.0) - (near->x + near->width / 2.0);
+            double dy = (r.y + r.height / 2.0) - (near->y + near->height / 2.0);
+            return dx * dx + dy * dy;
+        };
+        cv::Rect best;
+        double best_score = 0.0;
+        for (const auto& candidate : faces) {
+            cv::Rect scaled(static_cast<int>(candidate.x / scale), static_cast<int>(candidate.y / scale),
+                            static_cast<int>(candidate.width / scale), static_cast<int>(candidate.height / scale));
+            double score = near ? -distance(scaled) : static_cast<double>(scaled.area());
+            if (best.empty() || score > best_score) {
+                best = scaled;
+                best_score = score;
+            }
+        }
+        face = best & cv::Rect(0, 0, gray.cols, gray.rows);
+        return !face.empty();
+    }
+
+    int64_t detections = 0;
+    int64_t detections_missed = 0;
+    int64_t tracked_frames = 0;
+    int64_t lost_frames = 0;
+
+private:
+    // Find the last detected face's patch near where it was last seen
+    bool track(const cv::Mat& gray, cv::Rect& face) {
+        cv::Rect search(face_.x - face_.width, face_.y - face_.height, face_.width * 3, face_.height * 3);
+        search = search & cv::Rect(0, 0, gray.cols, gray.rows);
+        if (template_.empty() || search.width < template_.cols || search.height < template_.rows) {
+            return false;
+        }
+        cv::Mat scores;
+        cv::matchTemplate(gray(search), template_, scores, cv::TM_CCOEFF_NORMED);
+        double best = 0.0;
+        cv::Point location;
+        cv::minMaxLoc(scores, nullptr, &best, nullptr, &location);
+        if (best < 0.5) {
+            return false;
+        }
+        face = cv::Rect(search.x + location.x, search.y + location.y, template_.cols, template_.rows);
+        return true;
+    }
+
+    RoiCropOptions options_;
+    cv::CascadeClassifier cascade_;
+    cv::Size frame_size_;
+    cv::Size crop_size_;
+    cv::Mat template_;
+    cv::Rect face_;
+    bool has_face_ = false;
+    bool lost_ = false;
+    int64_t frame_index_ = 0;
+    double centre_x_ = 0.0;
+    double centre_y_ = 0.0;
+};
+
+// Write output_path as the face crop of input_path, one frame per input frame.
+// False (with stats.error) if the video cannot be read or has no face, in
+// which case the caller should process the full frame. Setting *cancel stops
+// the crop between frames (false, with stats.error "Cancelled").
+inline bool crop_video_to_face(const std::string& input_path, const std::string& output_path,
+                               const RoiCropOptions& options, RoiCropStats& stats,
+                               const std::atomic<bool>* cancel = nullptr) {
+    auto cancelled = [cancel, &stats]() {
+        if (cancel && cancel->load()) {
+            stats.error = "Cancelled";
+            return true;
+        }
+        return false;
+    };
+    auto started = std::chrono::steady_clock::now();
+    FaceRoiTracker tracker(options);
+    if (!tracker.load()) {
+        stats.error = "Cannot load face cascade " + options.cascade_path;
+        return false;
+    }
+    cv::VideoCapture capture(input_path);
+    if (!capture.isOpened()) {
+        stats.error = "Cannot open " + input_path;
+        return false;
+    }
+    double fps = capture.get(cv::CAP_PROP_FPS);
+    stats.source_size = cv::Size(static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH)),
+                                 static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT)));
+
+    // Samples spread over the video size the crop
+    std::vector<cv::Mat> samples;
+    int64_t frame_count = static_cast<int64_t>(capture.get(cv::CAP_PROP_FRAME_COUNT));
+    for (int i = 0; i < options.sample_frames; ++i) {
+        if (cancelled()) {
+            return false;
+        }
+        capture.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(frame_count * i / options.sample_frames));
+        cv::Mat frame;
+        if (capture.read(frame)) {
+            samples.push_back(frame);
+        }
+    }
+    if (!tracker.set_crop_size(samples, stats.source_size)) {
+        stats.error = "No face found in sample frames";
+        return false;
+    }
+    capture.set(cv::CAP_PROP_POS_FRAMES, 0);
+
+    stats.output_size = tracker.output_size();
+    cv::VideoWriter writer(output_path, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps, stats.output_size);
+    if (!writer.isOpened()) {
+        stats.error = "Cannot write " + output_path;
+        return false;
+    }
+    cv::Mat frame;
+    cv::Mat cropped;
+    while (capture.read(frame)) {
+        if (cancelled()) {
+            return false;
+        }
+        cv::Rect window = tracker.next(frame);
+        cv::resize(frame(window), cropped, stats.output_size, 0, 0, cv::INTER_AREA);
+        writer.write(cropped);
+        stats.frames++;
+    }
+
+    stats.detections = tracker.detections;
+    stats.detections_missed = tracker.detections_missed;
+    stats.tracked_frames = tracker.tracked_frames;
+    stats.lost_frames = tracker.lost_frames;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return stats.frames > 0;
+}
@@ -1,19 +1,92 @@
 #!/bin/bash
+# Builds the engine if needed and supervises it.
+#
+# Redeploy without downtime: docker-compose exec presage_core kill -HUP 1
+# rebuilds, starts the new engine next to the running one (both listen on the
+# same ports with SO_REUSEPORT), waits until it answers /health, then sends the
+# old engine SIGTERM so it drains. A failed build or a new engine that never
+# becomes healthy leaves the old one running.
+#
+# SIGTERM (docker stop) drains the running engine; keep stop_grace_period
+# above PRESAGE_DRAIN_TIMEOUT_S.
 set -e
 
 cd /app
 
+build() {
+    mkdir -p build
+    (cd build && cmake .. && make -j$(nproc))
+}
+
 # Build if needed
 if [ ! -f "build/presage_engine" ]; then
     echo "Building Presage Engine..."
-    mkdir -p build
-    cd build
-    cmake ..
-    make -j$(nproc)
-    cd ..
+    build
 fi
 
+cd build
+
+# Wait until the engine with this pid answers /health; false if it exits first
+wait_healthy() {
+    local pid=$1
+    for _ in $(seq 1 300); do
+        kill -0 "$pid" 2>/dev/null || return 1
+        # Two engines share the port during a handoff; only count answers from this one
+        if curl -s -o /dev/null -D - --max-time 2 http://localhost:8080/health 2>/dev/null |
+            grep -qi "^X-Presage-Pid: $pid"; then
+            return 0
+        fi
+        sleep 1
+    done
+    return 1
+}
+
+reload() {
+    echo "Reload: rebuilding Presage Engine..."
+    if ! (cd /app && build); then
+        echo "Reload: build failed, keeping engine $engine_pid"
+        return
+    fi
+    ./presage_engine &
+    local new_pid=$!
+    if ! wait_healthy "$new_pid"; then
+        echo "Reload: new engine $new_pid never became healthy, keeping engine $engine_pid"
+        kill -TERM "$new_pid" 2>/dev/null || true
+        wait "$new_pid" || true
+        return
+    fi
+    echo "Reload: engine $new_pid is serving, draining engine $engine_pid"
+    kill -TERM "$engine_pid" 2>/dev/null || true
+    engine_pid=$new_pid
+}
+
+reload_requested=""
+stop_requested=""
+trap 'reload_requested=1' HUP
+trap 'stop_requested=1' TERM INT
+
 # Start the server
 echo "Starting Presage Engine server..."
-cd build
-exec ./presage_engine
+./presage_engine &
+engine_pid=$!
+
+while true; do
+    # Returns early when a trapped signal arrives
+    status=0
+    wait "$engine_pid" || status=$?
+    if [ -n "$stop_requested" ]; then
+        kill -TERM "$engine_pid" 2>/dev/null || true
+        status=0
+        wait "$engine_pid" || status=$?
+        exit $status
+    fi
+    if [ -n "$reload_requested" ]; then
+        reload_requested=""
+        reload
+        continue
+    fi
+    if ! kill -0 "$engine_pid" 2>/dev/null; then
+        echo "Presage Engine exited with status $status"
+        exit $status
+    fi
+done
@@ -0,0 +1,325 @@
+// synth_video.cpp
+// Synthetic rPPG benchmark video generator
+//
+// Renders a face video with a known pulse and breathing rate, so end-to-end
+// benchmarks (hello_vitals, /process-video, /batch) and accuracy checks can
+// run without patient footage. The skin is modulated with a pulse waveform
+// (strongest in green, as blood absorption is), the head and shoulders rise
+// and fall with breathing, and optional lighting drift and sensor noise make
+// the signal harder to recover. The same options and seed always produce the
+// same frames.
+//
+// Next to the video it writes <output>.truth.json with the true heart and
+// breathing rate once per second, in the same shape as the engine's readings.
+//
+// Run: ./synth_video --output /app/uploads/synth_72bpm.mp4 --hr 72 --br 15
+//      ./synth_video --output /app/uploads/synth_face.avi --face portrait.jpg --fourcc MJPG
+
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <cstdlib>
+
+#include "deps/json.hpp"
+
+using json = nlohmann::json;
+
+struct SynthOptions {
+    std::string output;
+    std::string truth;           // Ground truth path (default: <output>.truth.json)
+    std::string face;            // Photo to animate instead of the drawn face
+    std::string fourcc = "mp4v";
+    int width = 1280;
+    int height = 720;
+    double fps = 30.0;
+    double duration_s = 30.0;
+    double heart_rate = 72.0;    // bpm at the start
+    double heart_rate_end = -1;  // bpm at the end, linear in between (-1: constant)
+    double breathing_rate = 15.0;
+    double pulse_amplitude = 0.01;   // Peak skin brightness change from the pulse, fraction
+    double breathing_px = 4.0;       // Peak vertical chest movement, pixels at 720p
+    double lighting = 0.0;           // Peak global brightness drift, fraction
+    double lighting_period_s = 20.0;
+    double noise = 0.0;              // Sensor noise standard deviation, 8-bit levels
+    unsigned seed = 1;
+};
+
+// Pulse shape over one beat: a fundamental plus a second harmonic, which gives
+// the sharp systolic rise and the dicrotic shoulder of a real PPG trace
+double pulse_waveform(double phase) {
+    return 0.75 * std::sin(phase) + 0.25 * std::sin(2.0 * phase + 0.8);
+}
+
+// A cartoon head and shoulders. Returns the frame and a mask of the skin
+// that carries the pulse (face and neck, not the eyes, mouth or hair).
+void draw_subject(const SynthOptions& options, double chest_px, const cv::Mat& background, cv::Mat& frame, cv::Mat& skin) {
+    background.copyTo(frame);
+    skin = cv::Mat::zeros(frame.size(), CV_8UC1);
+    double s = std::min(options.width, options.height);
+    auto point = [&](double x, double y) {
+        return cv::Point(static_cast<int>(options.width / 2.0 + x * s), static_cast<int>(options.height * 0.45 + y * s));
+    };
+    auto axes = [s](double a, double b) { return cv::Size(static_cast<int>(a * s), static_cast<int>(b * s)); };
+    // The chest moves fully with breathing, the head about half as much
+    double head_dy = 0.5 * chest_px / s;
+    double chest_dy = chest_px / s;
+
+    const cv::Scalar skin_colour(120, 150, 205);
+    const cv::Scalar shirt_colour(140, 90, 60);
+    const cv::Scalar hair_colour(40, 45, 60);
+
+    cv::ellipse(frame, point(0, 0.62 - chest_dy), axes(0.48, 0.26), 0, 180, 360, shirt_colour, cv::FILLED, cv::LINE_AA);
+    cv::rectangle(frame, point(-0.07, 0.22 - head_dy), point(0.07, 0.4 - chest_dy), skin_colour, cv::FILLED, cv::LINE_AA);
+    cv::rectangle(skin, point(-0.07, 0.22 - head_dy), point(0.07, 0.4 - chest_dy), 255, cv::FILLED);
+    cv::ellipse(frame, point(0, -head_dy), axes(0.17, 0.23), 0, 0, 360, skin_colour, cv::FILLED, cv::LINE_AA);
+    cv::ellipse(skin, point(0, -head_dy), axes(0.17, 0.23), 0, 0, 360, 255, cv::FILLED);
+
+    // Hair, eyes, brows and mouth are drawn over the skin and cut out of the mask
+    auto feature = [&](cv::Point centre, cv::Size size, double angle, double start, double end, const cv::Scalar& colour) {
+        cv::ellipse(frame, centre, size, angle, start, end, colour, cv::FILLED, cv::LINE_AA);
+        cv::ellipse(skin, centre, size, angle, start, end, 0, cv::FILLED);
+    };
+    feature(point(0, -0.1 - head_dy), axes(0.18, 0.15), 0, 180, 360, hair_colour);
+    for (double side : {-1.0, 1.0}) {
+        feature(point(side * 0.065, -0.03 - head_dy), axes(0.035, 0.018), 0, 0, 360, cv::Scalar(235, 235, 235));
+        feature(point(side * 0.065, -0.03 - head_dy), axes(0.014, 0.014), 0, 0, 360, cv::Scalar(50, 60, 70));
+        feature(point(side * 0.065, -0.075 - head_dy), axes(0.04, 0.008), side * -5, 0, 360, hair_colour);
+    }
+    feature(point(0, 0.13 - head_dy), axes(0.05, 0.015), 0, 0, 360, cv::Scalar(90, 90, 170));
+    cv::line(frame, point(0, 0 - head_dy), point(-0.012, 0.07 - head_dy), cv::Scalar(95, 120, 175), std::max(1, static_cast<int>(s / 240)), cv::LINE_AA);
+}
+
+// Skin pixels of a photo, by the usual YCrCb range
+cv::Mat photo_skin_mask(const cv::Mat& photo) {
+    cv::Mat ycrcb;
+    cv::Mat mask;
+    cv::cvtColor(photo, ycrcb, cv::COLOR_BGR2YCrCb);
+    cv::inRange(ycrcb, cv::Scalar(0, 133, 77), cv::Scalar(255, 173, 127), mask);
+    cv::morphologyEx(mask, mask, cv::MORPH_OPEN, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(5, 5)));
+    return mask;
+}
+
+std::string default_truth_path(const std::string& output) {
+    size_t dot = output.rfind('.');
+    size_t slash = output.rfind('/');
+    std::string stem = (dot == std::string::npos || (slash != std::string::npos && dot < slash)) ? output : output.substr(0, dot);
+    return stem + ".truth.json";
+}
+
+void print_usage() {
+    std::cout << "Usage: ./synth_video --output VIDEO [options]\n";
+    std::cout << "  --output VIDEO        Video to write (.mp4, or .avi with --fourcc MJPG)\n";
+    std::cout << "  --truth PATH          Ground truth JSON (default <output>.truth.json)\n";
+    std::cout << "  --face PHOTO          Animate a face photo instead of the drawn face\n";
+    std::cout << "  --size WxH            Resolution (default 1280x720)\n";
+    std::cout << "  --fps F               Frame rate (default 30)\n";
+    std::cout << "  --duration S          Length in seconds (default 30)\n";
+    std::cout << "  --hr BPM              Heart rate (default 72)\n";
+    std::cout << "  --hr-end BPM          Heart rate at the end, ramping linearly from --hr\n";
+    std::cout << "  --br BPM              Breathing rate (default 15)\n";
+    std::cout << "  --pulse-amplitude F   Skin brightness change from the pulse, fraction (default 0.01)\n";
+    std::cout << "  --breathing-px N      Chest movement in pixels at 720p (default 4)\n";
+    std::cout << "  --lighting F          Global brightness drift, fraction (default 0)\n";
+    std::cout << "  --lighting-period S   Period of the brightness drift (default 20)\n";
+    std::cout << "  --noise SIGMA         Gaussian sensor noise in 8-bit levels (default 0)\n";
+    std::cout << "  --fourcc CODE         Codec (default mp4v; MJPG keeps small modulations better)\n";
+    std::cout << "  --seed N              Random seed for noise and background (default 1)\n";
+}
+
+int main(int argc, char** argv) {
+    SynthOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << "\n";
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        if (arg == "--output") {
+            options.output = next();
+        } else if (arg == "--truth") {
+            options.truth = next();
+        } else if (arg == "--face") {
+            options.face = next();
+        } else if (arg == "--size") {
+            std::string size = next();
+            if (sscanf(size.c_str(), "%dx%d", &options.width, &options.height) != 2) {
+                std::cerr << "Invalid --size " << size << "\n";
+                return 1;
+            }
+        } else if (arg == "--fps") {
+            options.fps = std::stod(next());
+        } else if (arg == "--duration") {
+            options.duration_s = std::stod(next());
+        } else if (arg == "--hr") {
+            options.heart_rate = std::stod(next());
+        } else if (arg == "--hr-end") {
+            options.heart_rate_end = std::stod(next());
+        } else if (arg == "--br") {
+            options.breathing_rate = std::stod(next());
+        } else if (arg == "--pulse-amplitude") {
+            options.pulse_amplitude = std::stod(next());
+        } else if (arg == "--breathing-px") {
+            options.breathing_px = std::stod(next());
+        } else if (arg == "--lighting") {
+            options.lighting = std::stod(next());
+        } else if (arg == "--lighting-period") {
+            options.lighting_period_s = std::stod(next());
+        } else if (arg == "--noise") {
+            options.noise = std::stod(next());
+        } else if (arg == "--fourcc") {
+            options.fourcc = next();
+        } else if (arg == "--seed") {
+            options.seed = static_cast<unsigned>(std::stoul(next()));
+        } else {
+            print_usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if (options.output.empty() || options.fps <= 0 || options.duration_s <= 0 || options.fourcc.size() != 4 ||
+        options.width < 64 || options.height < 64 || options.width % 2 != 0 || options.height % 2 != 0) {
+        print_usage();
+        return 1;
+    }
+    if (options.truth.empty()) {
+        options.truth = default_truth_path(options.output);
+    }
+    if (options.heart_rate_end < 0) {
+        options.heart_rate_end = options.heart_rate;
+    }
+
+    cv::Size size(options.width, options.height);
+    cv::RNG rng(options.seed);
+
+    // Static scene: a photo, or a gradient wall with a little texture so
+    // encoders and trackers see something other than flat colour
+    cv::Mat background;
+    cv::Mat photo_skin;
+    if (!options.face.empty()) {
+        cv::Mat photo = cv::imread(options.face);
+        if (photo.empty()) {
+            std::cerr << "Cannot read face photo " << options.face << "\n";
+            return 1;
+        }
+        cv::resize(photo, background, size, 0, 0, cv::INTER_AREA);
+        photo_skin = photo_skin_mask(background);
+    } else {
+        background.create(size, CV_8UC3);
+        for (int y = 0; y < size.height; ++y) {
+            double t = static_cast<double>(y) / size.height;
+            background.row(y).setTo(cv::Scalar(170 - 40 * t, 160 - 40 * t, 150 - 30 * t));
+        }
+        cv::Mat texture(size, CV_8UC3);
+        rng.fill(texture, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(12));
+        cv::GaussianBlur(texture, texture, cv::Size(0, 0), 2.0);
+        background += texture;
+    }
+
+    cv::VideoWriter writer(options.output,
+                           cv::VideoWriter::fourcc(options.fourcc[0], options.fourcc[1], options.fourcc[2], options.fourcc[3]),
+                           options.fps, size);
+    if (!writer.isOpened()) {
+        std::cerr << "Cannot write " << options.output << " with codec " << options.fourcc << "\n";
+        return 1;
+    }
+
+    int64_t frame_count = static_cast<int64_t>(std::llround(options.duration_s * options.fps));
+    double breathing_px = options.breathing_px * options.height / 720.0;
+    // Blood absorbs green most, then blue, then red (BGR order)
+    const double channel_weight[3] = {0.5, 1.0, 0.3};
+
+    std::cout << "Rendering " << frame_count << " frames at " << options.width << "x" << options.height << " "
+              << options.fps << " fps: heart rate " << options.heart_rate << "->" << options.heart_rate_end
+              << " bpm, breathing " << options.breathing_rate << " bpm, pulse amplitude " << options.pulse_amplitude
+              << ", noise " << options.noise << ", seed " << options.seed << "\n";
+    auto started = std::chrono::steady_clock::now();
+
+    json readings = json::array();
+    double pulse_phase = 0.0;
+    double breathing_phase = 0.0;
+    cv::Mat frame;
+    cv::Mat skin;
+    cv::Mat pixels;
+    cv::Mat noise(size, CV_32FC3);
+    cv::Mat output;
+    for (int64_t n = 0; n < frame_count; ++n) {
+        double t = n / options.fps;
+        double heart_rate = options.heart_rate + (options.heart_rate_end - options.heart_rate) * t / options.duration_s;
+        // Integrate the phase so a changing rate stays continuous
+        pulse_phase += 2.0 * M_PI * heart_rate / 60.0 / options.fps;
+        breathing_phase += 2.0 * M_PI * options.breathing_rate / 60.0 / options.fps;
+        double chest_px = breathing_px * std::sin(breathing_phase);
+
+        if (options.face.empty()) {
+            draw_subject(options, chest_px, background, frame, skin);
+        } else {
+            // Move the whole photo with breathing; its skin mask moves with it
+            cv::Mat shift = (cv::Mat_<double>(2, 3) << 1, 0, 0, 0, 1, -chest_px);
+            cv::warpAffine(background, frame, shift, size, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+            cv::warpAffine(photo_skin, skin, shift, size, cv::INTER_NEAREST, cv::BORDER_REPLICATE);
+        }
+
+        // Work in float so modulations below one 8-bit level survive until the noise dithers them
+        frame.convertTo(pixels, CV_32FC3);
+        double pulse = pulse_waveform(pulse_phase);
+        cv::Scalar gain;
+        for (int c = 0; c < 3; ++c) {
+            gain[c] = 1.0 - options.pulse_amplitude * channel_weight[c] * pulse;
+        }
+        cv::Mat pulsed;
+        cv::multiply(pixels, gain, pulsed);
+        pulsed.copyTo(pixels, skin);
+        if (options.lighting > 0) {
+            pixels *= 1.0 + options.lighting * std::sin(2.0 * M_PI * t / options.lighting_period_s);
+        }
+        if (options.noise > 0) {
+            rng.fill(noise, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(options.noise));
+            pixels += noise;
+        }
+        pixels.convertTo(output, CV_8UC3);
+        writer.write(output);
+
+        // One ground truth reading per second of video
+        if (n % std::max<int64_t>(1, std::llround(options.fps)) == 0) {
+            readings.push_back({
+                {"timestamp_ms", static_cast<int64_t>(std::llround(t * 1000.0))},
+                {"heart_rate_bpm", heart_rate},
+                {"breathing_rate_bpm", options.breathing_rate}
+            });
+        }
+    }
+    writer.release();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    json truth = {
+        {"video", options.output},
+        {"frames", frame_count},
+        {"fps", options.fps},
+        {"width", options.width},
+        {"height", options.height},
+        {"heart_rate_bpm", {{"start", options.heart_rate}, {"end", options.heart_rate_end},
+                            {"mean", (options.heart_rate + options.heart_rate_end) / 2.0}}},
+        {"breathing_rate_bpm", options.breathing_rate},
+        {"settings", {{"pulse_amplitude", options.pulse_amplitude}, {"breathing_px", options.breathing_px},
+                      {"lighting", options.lighting}, {"lighting_period_s", options.lighting_period_s},
+                      {"noise", options.noise}, {"face", options.face.empty() ? json(nullptr) : json(options.face)},
+                      {"fourcc", options.fourcc}, {"seed", options.seed}}},
+        {"readings", readings}
+    };
+    std::ofstream truth_file(options.truth);
+    truth_file << truth.dump(2) << "\n";
+    if (!truth_file) {
+        std::cerr << "Cannot write " << options.truth << "\n";
+        return 1;
+    }
+
+    std::cout << "Wrote " << options.output << " (" << frame_count << " frames in " << elapsed << " s) and "
+              << options.truth << "\n";
+    return 0;
+}
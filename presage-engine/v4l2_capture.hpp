@@ -0,0 +1,357 @@
+// v4l2_capture.hpp
+// Engine-owned V4L2 camera capture with mmap streaming I/O
+//
+// Feeds the camera frame ring while no camera run holds the device, in place
+// of cv::VideoCapture. The driver's buffers (a configurable number of them)
+// are mapped into the process and handed to the caller in place: MJPG frames
+// are the compressed bytes the camera sent, raw YUYV and NV12 frames can be
+// wrapped in a cv::Mat over the mapping. The pixel format is the first of a
+// preference list the device offers. Every frame carries the kernel's capture
+// timestamp, and gaps in the driver's sequence numbers count dropped frames.
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct V4l2Options {
+    std::string device = "/dev/video0";
+    int width = 1280;
+    int height = 720;
+    int fps = 30;
+    std::vector<uint32_t> formats = {V4L2_PIX_FMT_MJPEG, V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12};  // Preferred first
+    int buffers = 4;  // Driver buffers to map; more absorb longer consumer hiccups
+};
+
+// One dequeued buffer; `data` is only valid during the read() callback
+struct V4l2Frame {
+    const uint8_t* data = nullptr;
+    size_t bytes = 0;
+    uint32_t format = 0;
+    int width = 0;
+    int height = 0;
+    int stride = 0;             // Bytes per row of raw formats
+    int64_t timestamp_ms = 0;   // Wall clock of capture, from the kernel timestamp
+    int64_t latency_us = 0;     // Kernel capture to dequeue
+    uint32_t sequence = 0;
+};
+
+struct V4l2Stats {
+    int64_t frames = 0;
+    int64_t dropped = 0;        // Sequence numbers skipped by the driver
+    int64_t errors = 0;         // Buffers flagged as corrupt
+    int64_t latency_us_sum = 0;
+    int64_t latency_us_max = 0;
+};
+
+class V4l2Capture {
+public:
+    V4l2Capture() = default;
+    V4l2Capture(const V4l2Capture&) = delete;
+    V4l2Capture& operator=(const V4l2Capture&) = delete;
+    ~V4l2Capture() { close(); }
+
+    static std::string format_name(uint32_t format) {
+        std::string name;
+        for (int i = 0; i < 4; ++i) {
+            name += static_cast<char>((format >> (8 * i)) & 0xff);
+        }
+        return name;
+    }
+
+    // "MJPG", "YUYV" or "NV12" (case-insensitive); 0 if unknown
+    static uint32_t parse_format(std::string name) {
+        for (auto& c : name) {
+            c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        }
+        if (name == "MJPG" || name == "MJPEG") {
+            return V4L2_PIX_FMT_MJPEG;
+        }
+        if (name == "YUYV") {
+            return V4L2_PIX_FMT_YUYV;
+        }
+        if (name == "NV12") {
+            return V4L2_PIX_FMT_NV12;
+        }
+        return 0;
+    }
+
+    bool open(const V4l2Options& options, std::string& error) {
+        close();
+        fd_ = ::open(options.device.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd_ < 0) {
+            error = "open " + options.device + ": " + strerror(errno);
+            return false;
+        }
+        v4l2_capability caps{};
+        if (xioctl(VIDIOC_QUERYCAP, &caps) < 0) {
+            return fail("VIDIOC_QUERYCAP", error);
+        }
+        uint32_t device_caps = (caps.capabilities & V4L2_CAP_DEVICE_CAPS) ? caps.device_caps : caps.capabilities;
+        if (!(device_caps & V4L2_CAP_VIDEO_CAPTURE) || !(device_caps & V4L2_CAP_STREAMING)) {
+            error = options.device + " is not a streaming capture device";
+            close();
+            return false;
+        }
+
+        // First preferred format the device offers
+        std::vector<uint32_t> offered;
+        v4l2_fmtdesc desc{};
+        desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        while (xioctl(VIDIOC_ENUM_FMT, &desc) == 0) {
+            offered.push_back(desc.pixelformat);
+            desc.index++;
+        }
+        uint32_t chosen = 0;
+        for (uint32_t format : options.formats) {
+            if (std::find(offered.begin(), offered.end(), format) != offered.end()) {
+                chosen = format;
+                break;
+            }
+        }
+        if (!chosen) {
+            std::string names;
+            for (uint32_t format : offered) {
+                names += (names.empty() ? "" : ",") + format_name(format);
+            }
+            error = options.device + " offers none of the requested formats (has " + names + ")";
+            close();
+            return false;
+        }
+
+        v4l2_format format{};
+        format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        format.fmt.pix.width = static_cast<uint32_t>(options.width);
+        format.fmt.pix.height = static_cast<uint32_t>(options.height);
+        format.fmt.pix.pixelformat = chosen;
+        format.fmt.pix.field = V4L2_FIELD_ANY;
+        if (xioctl(VIDIOC_S_FMT, &format) < 0) {
+            return fail("VIDIOC_S_FMT", error);
+        }
+        // The driver may adjust the size, or even the format
+        format_ = format.fmt.pix.pixelformat;
+        width_ = static_cast<int>(format.fmt.pix.width);
+        height_ = static_cast<int>(format.fmt.pix.height);
+        stride_ = static_cast<int>(format.fmt.pix.bytesperline);
+        if (std::find(options.formats.begin(), options.formats.end(), format_) == options.formats.end()) {
+            error = "driver switched to unsupported format " + format_name(format_);
+            close();
+            return false;
+        }
+
+        // Best effort; not every driver lets the rate be set
+        v4l2_streamparm parm{};
+        parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        parm.parm.capture.timeperframe.numerator = 1;
+        parm.parm.capture.timeperframe.denominator = static_cast<uint32_t>(std::max(1, options.fps));
+        xioctl(VIDIOC_S_PARM, &parm);
+
+        v4l2_requestbuffers request{};
+        request.count = static_cast<uint32_t>(std::clamp(options.buffers, 2, 32));
+        request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        request.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(VIDIOC_REQBUFS, &request) < 0) {
+            return fail("VIDIOC_REQBUFS", error);
+        }
+        if (request.count < 2) {
+            error = "driver granted only " + std::to_string(request.count) + " buffer";
+            close();
+            return false;
+        }
+        for (uint32_t i = 0; i < request.count; ++i) {
+            v4l2_buffer buffer{};
+            buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buffer.memory = V4L2_MEMORY_MMAP;
+            buffer.index = i;
+            if (xioctl(VIDIOC_QUERYBUF, &buffer) < 0) {
+                return fail("VIDIOC_QUERYBUF", error);
+            }
+            void* start = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, buffer.m.offset);
+            if (start == MAP_FAILED) {
+                return fail("mmap", error);
+            }
+            mappings_.push_back({start, buffer.length});
+            if (xioctl(VIDIOC_QBUF, &buffer) < 0) {
+                return fail("VIDIOC_QBUF", error);
+            }
+        }
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if (xioctl(VIDIOC_STREAMON, &type) < 0) {
+            return fail("VIDIOC_STREAMON", error);
+        }
+        streaming_ = true;
+        have_sequence_ = false;
+        return true;
+    }
+
+    bool is_open() const { return fd_ >= 0; }
+    uint32_t format() const { return format_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+    size_t buffer_count() const { return mappings_.size(); }
+
+    // Wait up to timeout_ms for a frame and pass it to on_frame; its buffer goes
+    // back to the driver when on_frame returns. True for a frame or a timeout,
+    // false once the device fails (unplugged, for instance).
+    bool read(int timeout_ms, const std::function<void(const V4l2Frame&)>& on_frame) {
+        pollfd pfd{fd_, POLLIN, 0};
+        int ready = poll(&pfd, 1, timeout_ms);
+        if (ready < 0) {
+            return errno == EINTR;
+        }
+        if (ready == 0) {
+            return true;
+        }
+        if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            return false;
+        }
+        v4l2_buffer buffer{};
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(VIDIOC_DQBUF, &buffer) < 0) {
+            return errno == EAGAIN;
+        }
+        struct Requeue {
+            V4l2Capture& capture;
+            v4l2_buffer& buffer;
+            ~Requeue() { capture.xioctl(VIDIOC_QBUF, &buffer); }
+        } requeue{*this, buffer};
+
+        if (have_sequence_ && buffer.sequence > last_sequence_ + 1) {
+            dropped_ += buffer.sequence - last_sequence_ - 1;
+        }
+        have_sequence_ = true;
+        last_sequence_ = buffer.sequence;
+        if (buffer.flags & V4L2_BUF_FLAG_ERROR || buffer.index >= mappings_.size()) {
+            errors_++;
+            return true;
+        }
+
+        V4l2Frame frame;
+        frame.data = static_cast<const uint8_t*>(mappings_[buffer.index].start);
+        frame.bytes = buffer.bytesused;
+        frame.format = format_;
+        frame.width = width_;
+        frame.height = height_;
+        frame.stride = stride_;
+        frame.sequence = buffer.sequence;
+        int64_t wall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        frame.timestamp_ms = wall_ms;
+        if ((buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+            timespec now{};
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            int64_t now_us = static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+            int64_t captured_us = static_cast<int64_t>(buffer.timestamp.tv_sec) * 1000000 + buffer.timestamp.tv_usec;
+            frame.latency_us = std::max<int64_t>(0, now_us - captured_us);
+            frame.timestamp_ms = wall_ms - frame.latency_us / 1000;
+        }
+        frames_++;
+        latency_us_sum_ += frame.latency_us;
+        latency_us_max_ = std::max(latency_us_max_.load(), frame.latency_us);
+        on_frame(frame);
+        return true;
+    }
+
+    // Decode or convert a frame to BGR (raw formats are read in place)
+    static cv::Mat to_bgr(const V4l2Frame& frame) {
+        cv::Mat bgr;
+        void* data = const_cast<uint8_t*>(frame.data);
+        switch (frame.format) {
+            case V4L2_PIX_FMT_MJPEG:
+                bgr = cv::imdecode(cv::Mat(1, static_cast<int>(frame.bytes), CV_8UC1, data), cv::IMREAD_COLOR);
+                break;
+            case V4L2_PIX_FMT_YUYV:
+                cv::cvtColor(cv::Mat(frame.height, frame.width, CV_8UC2, data, static_cast<size_t>(frame.stride)),
+                             bgr, cv::COLOR_YUV2BGR_YUYV);
+                break;
+            case V4L2_PIX_FMT_NV12:
+                cv::cvtColor(cv::Mat(frame.height * 3 / 2, frame.width, CV_8UC1, data, static_cast<size_t>(frame.stride)),
+                             bgr, cv::COLOR_YUV2BGR_NV12);
+                break;
+        }
+        return bgr;
+    }
+
+    V4l2Stats stats() const {
+        V4l2Stats stats;
+        stats.frames = frames_.load();
+        stats.dropped = dropped_.load();
+        stats.errors = errors_.load();
+        stats.latency_us_sum = latency_us_sum_.load();
+        stats.latency_us_max = latency_us_max_.load();
+        return stats;
+    }
+
+    void close() {
+        if (fd_ < 0) {
+            return;
+        }
+        if (streaming_) {
+            v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            xioctl(VIDIOC_STREAMOFF, &type);
+            streaming_ = false;
+        }
+        for (const auto& mapping : mappings_) {
+            munmap(mapping.start, mapping.length);
+        }
+        mappings_.clear();
+        v4l2_requestbuffers release{};
+        release.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        release.memory = V4L2_MEMORY_MMAP;
+        xioctl(VIDIOC_REQBUFS, &release);
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+private:
+    struct Mapping {
+        void* start;
+        size_t length;
+    };
+
+    int fd_ = -1;
+    bool streaming_ = false;
+    std::vector<Mapping> mappings_;
+    uint32_t format_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+    int stride_ = 0;
+    bool have_sequence_ = false;
+    uint32_t last_sequence_ = 0;
+    // Totals over every open(), read by /status while the capture thread runs
+    std::atomic<int64_t> frames_{0};
+    std::atomic<int64_t> dropped_{0};
+    std::atomic<int64_t> errors_{0};
+    std::atomic<int64_t> latency_us_sum_{0};
+    std::atomic<int64_t> latency_us_max_{0};
+
+    int xioctl(unsigned long request, void* arg) {
+        int result;
+        do {
+            result = ioctl(fd_, request, arg);
+        } while (result < 0 && errno == EINTR);
+        return result;
+    }
+
+    bool fail(const char* what, std::string& error) {
+        error = std::string(what) + ": " + strerror(errno);
+        close();
+        return false;
+    }
+};
@@ -0,0 +1,217 @@
+// virtual_camera.cpp
+// Virtual live camera for soak and scale testing
+//
+// Loops a video file into a v4l2loopback device at real capture pacing, with
+// optional timing jitter and dropped frames. The engine sees it as an
+// ordinary camera (GET /cameras, GET /test?device=/dev/videoN), so camera
+// mode can run for hours on a machine without a webcam.
+//
+// Setup (host):  sudo modprobe v4l2loopback devices=4 video_nr=10,11,12,13 exclusive_caps=1
+// Run:           ./virtual_camera --device /dev/video10 --input /app/uploads/test-video.mp4
+
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/videodev2.h>
+
+struct VirtualCameraOptions {
+    std::string device = "/dev/video10";
+    std::string input;
+    int width = 1280;
+    int height = 720;
+    double fps = 0.0;          // 0: the input's own frame rate
+    int jitter_ms = 0;         // Uniform +/- on each frame's delivery time
+    double drop_rate = 0.0;    // Fraction of frames never delivered
+    int64_t duration_s = 0;    // 0: run until killed
+    unsigned seed = 1;
+};
+
+// Pack BGR into YUYV (4:2:2), the format v4l2loopback consumers handle best
+void bgr_to_yuyv(const cv::Mat& bgr, std::vector<unsigned char>& out) {
+    cv::Mat yuv;
+    cv::cvtColor(bgr, yuv, cv::COLOR_BGR2YUV);
+    out.resize(static_cast<size_t>(bgr.cols) * bgr.rows * 2);
+    unsigned char* dst = out.data();
+    for (int y = 0; y < yuv.rows; ++y) {
+        const unsigned char* row = yuv.ptr<unsigned char>(y);
+        for (int x = 0; x + 1 < yuv.cols; x += 2) {
+            const unsigned char* p0 = row + x * 3;
+            const unsigned char* p1 = p0 + 3;
+            *dst++ = p0[0];
+            *dst++ = static_cast<unsigned char>((p0[1] + p1[1]) / 2);
+            *dst++ = p1[0];
+            *dst++ = static_cast<unsigned char>((p0[2] + p1[2]) / 2);
+        }
+    }
+}
+
+int open_loopback(const VirtualCameraOptions& options) {
+    int fd = open(options.device.c_str(), O_RDWR);
+    if (fd < 0) {
+        std::cerr << "Cannot open " << options.device << ": " << strerror(errno) << "\n";
+        std::cerr << "Is v4l2loopback loaded? sudo modprobe v4l2loopback video_nr=10 exclusive_caps=1\n";
+        return -1;
+    }
+    v4l2_format format{};
+    format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    format.fmt.pix.width = static_cast<__u32>(options.width);
+    format.fmt.pix.height = static_cast<__u32>(options.height);
+    format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    format.fmt.pix.field = V4L2_FIELD_NONE;
+    format.fmt.pix.bytesperline = static_cast<__u32>(options.width * 2);
+    format.fmt.pix.sizeimage = static_cast<__u32>(options.width * options.height * 2);
+    format.fmt.pix.colorspace = V4L2_COLORSPACE_SRGB;
+    if (ioctl(fd, VIDIOC_S_FMT, &format) < 0) {
+        std::cerr << "VIDIOC_S_FMT failed on " << options.device << ": " << strerror(errno) << "\n";
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void print_usage() {
+    std::cout << "Usage: ./virtual_camera --input VIDEO [options]\n";
+    std::cout << "  --device PATH     v4l2loopback device to feed (default /dev/video10)\n";
+    std::cout << "  --input VIDEO     Video file to loop\n";
+    std::cout << "  --size WxH        Output resolution (default 1280x720)\n";
+    std::cout << "  --fps F           Output frame rate (default: the input's)\n";
+    std::cout << "  --jitter-ms N     Uniform +/- jitter on frame delivery (default 0)\n";
+    std::cout << "  --drop-rate F     Fraction of frames dropped (default 0)\n";
+    std::cout << "  --duration S      Stop after S seconds (default: run until killed)\n";
+    std::cout << "  --seed N          Random seed for jitter and drops (default 1)\n";
+}
+
+int main(int argc, char** argv) {
+    VirtualCameraOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << "\n";
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        if (arg == "--device") {
+            options.device = next();
+        } else if (arg == "--input") {
+            options.input = next();
+        } else if (arg == "--size") {
+            std::string size = next();
+            if (sscanf(size.c_str(), "%dx%d", &options.width, &options.height) != 2) {
+                std::cerr << "Invalid --size " << size << "\n";
+                return 1;
+            }
+        } else if (arg == "--fps") {
+            options.fps = std::stod(next());
+        } else if (arg == "--jitter-ms") {
+            options.jitter_ms = std::stoi(next());
+        } else if (arg == "--drop-rate") {
+            options.drop_rate = std::stod(next());
+        } else if (arg == "--duration") {
+            options.duration_s = std::stoll(next());
+        } else if (arg == "--seed") {
+            options.seed = static_cast<unsigned>(std::stoul(next()));
+        } else {
+            print_usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if (options.input.empty() || options.width % 2 != 0) {
+        print_usage();
+        return 1;
+    }
+
+    cv::VideoCapture capture(options.input);
+    if (!capture.isOpened()) {
+        std::cerr << "Cannot open input " << options.input << "\n";
+        return 1;
+    }
+    if (options.fps <= 0) {
+        options.fps = capture.get(cv::CAP_PROP_FPS);
+        if (options.fps <= 0) {
+            options.fps = 30.0;
+        }
+    }
+
+    int fd = open_loopback(options);
+    if (fd < 0) {
+        return 1;
+    }
+
+    std::cout << "Feeding " << options.device << " from " << options.input << " at " << options.width << "x"
+              << options.height << " " << options.fps << " fps (jitter " << options.jitter_ms
+              << " ms, drop rate " << options.drop_rate << ", seed " << options.seed << ")\n";
+
+    std::mt19937 rng(options.seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::uniform_int_distribution<int> jitter(-options.jitter_ms, options.jitter_ms);
+
+    using clock = std::chrono::steady_clock;
+    auto frame_interval = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / options.fps));
+    auto started = clock::now();
+    auto next_frame = started;
+    auto last_report = started;
+    int64_t delivered = 0;
+    int64_t dropped = 0;
+    int64_t loops = 0;
+
+    cv::Mat frame;
+    cv::Mat resized;
+    std::vector<unsigned char> yuyv;
+    while (true) {
+        if (!capture.read(frame)) {
+            // Loop the input
+            loops++;
+            capture.set(cv::CAP_PROP_POS_FRAMES, 0);
+            if (!capture.read(frame)) {
+                std::cerr << "Cannot rewind " << options.input << "\n";
+                break;
+            }
+        }
+        cv::resize(frame, resized, cv::Size(options.width, options.height), 0, 0, cv::INTER_AREA);
+        bgr_to_yuyv(resized, yuyv);
+
+        // Real capture pacing: frame N is due at start + N intervals, plus jitter
+        next_frame += frame_interval;
+        auto due = next_frame;
+        if (options.jitter_ms > 0) {
+            due += std::chrono::milliseconds(jitter(rng));
+        }
+        std::this_thread::sleep_until(due);
+
+        if (options.drop_rate > 0 && unit(rng) < options.drop_rate) {
+            dropped++;
+        } else if (write(fd, yuyv.data(), yuyv.size()) < 0) {
+            std::cerr << "Write to " << options.device << " failed: " << strerror(errno) << "\n";
+            break;
+        } else {
+            delivered++;
+        }
+
+        auto now = clock::now();
+        if (now - last_report >= std::chrono::seconds(10)) {
+            double elapsed = std::chrono::duration<double>(now - started).count();
+            std::cout << "[virtual_camera] " << static_cast<int64_t>(elapsed) << "s: " << delivered
+                      << " frames delivered, " << dropped << " dropped, " << loops << " loops, "
+                      << delivered / elapsed << " fps effective\n";
+            last_report = now;
+        }
+        if (options.duration_s > 0 && now - started >= std::chrono::seconds(options.duration_s)) {
+            break;
+        }
+    }
+
+    close(fd);
+    std::cout << "Done: " << delivered << " frames delivered, " << dropped << " dropped\n";
+    return 0;
+}